@@ -67,10 +67,12 @@ typedef std::shared_ptr<ProgressDialog> PProgressDialog;
  *  creates a GUI dialog which displays progress, and all file-system monitors attached to
  *  containers are invoked correctly on the GUI thread.
  *
- *  This inherits from WorkerResult<PFsObject> so the worker thread can push file-system
- *  objects onto the member deque for file-system monitor processing on the GUI thread.
+ *  This inherits from WorkerResultQueue<PFSVector> so the worker thread can push file-system
+ *  objects onto the member deque for file-system monitor processing on the GUI thread. To
+ *  keep the GUI thread from being woken up for every single file, the worker collects the
+ *  objects it has processed and posts them in one batch every UPDATE_PROGRESS_MILLIS.
  */
-class FileOperation : public WorkerResultQueue<PFsObject>,
+class FileOperation : public WorkerResultQueue<PFSVector>,
                       public enable_shared_from_this<FileOperation>
 {
 public:
@@ -138,13 +140,13 @@ protected:
      *   -- FileOperationType::COPY: copies all files to the target folder given to the constructor.
      *      This inserts the copies into views of the target folder.
      *
-     *  This passes the source file pointer to postResultToGUI() except in the case of COPY,
-     *  when this passes the copy.
+     *  This passes the source file pointers to postResultToGUI() except in the case of COPY,
+     *  when this passes the copies.
      */
     void threadFunc();
 
     void onProgress();
-    void onProcessingNextItem(PFsObject pFS);
+    void onProcessingNextItems(PFSVector pvFiles);
 
     FileOperationType   _t;
     uint                _id;
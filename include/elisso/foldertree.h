@@ -198,6 +198,9 @@ public:
     virtual void onItemAdded(PFsObject &pFS) override;
     virtual void onItemRemoved(PFsObject &pFS) override;
     virtual void onItemRenamed(PFsObject &pFS, const std::string &strOldName, const std::string &strNewName) override;
+    virtual void onItemChanged(PFsObject &pFS) override;
+    virtual void onItemsAdded(const FsVector &vFS) override;
+    virtual void onItemsRemoved(const FsVector &vFS) override;
 
 private:
     ElissoFolderTreeMgr &_tree;
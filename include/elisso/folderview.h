@@ -366,9 +366,14 @@ private:
      *
      *  This also calls selectInFolderTree(), which causes the folder tree to follow the
      *  newly selected folder and populate sub-folders, if necessary.
+     *
+     *  This also gets called for the partial results of large folders, which get passed
+     *  on to onPopulateBatch().
      */
     void onPopulateDone(PViewPopulatedResult p);
 
+    void onPopulateBatch(PViewPopulatedResult p);
+
     /**
      *  Returns the filesystem object for the given row, looking it up by name, or nullptr
      *  if it could not be found.
@@ -376,8 +381,12 @@ private:
     PFsObject getFsObjFromRow(Gtk::TreeModel::Row &row);
 
     Gtk::ListStore::iterator insertFile(PFsObject pFS);
+    void insertFiles(FsVector &vFiles, bool fSkipInserted);
     void removeFile(PFsObject pFS);
     void renameFile(PFsObject pFS, const std::string &strOldName, const std::string &strNewName);
+    void updateFile(PFsObject pFS);
+    void addFiles(const FsVector &vFiles);
+    void removeFiles(const FsVector &vFiles);
     void connectModel(bool fConnect);
 
     void setNotebookTabTitle();
@@ -445,7 +454,7 @@ private:
  *  FsMonitorBase subclassed tailored for the folder contents list.
  *
  *  This is for updating the folder contents when file operations are
- *  going on.
+ *  going on, and when FsWatcher reports changes from other processes.
  */
 class FolderViewMonitor : public FsMonitorBase
 {
@@ -458,6 +467,9 @@ public:
     virtual void onItemAdded(PFsObject &pFS) override;
     virtual void onItemRemoved(PFsObject &pFS) override;
     virtual void onItemRenamed(PFsObject &pFS, const std::string &strOldName, const std::string &strNewName) override;
+    virtual void onItemChanged(PFsObject &pFS) override;
+    virtual void onItemsAdded(const FsVector &vFS) override;
+    virtual void onItemsRemoved(const FsVector &vFS) override;
 
 private:
     ElissoFolderView &_view;
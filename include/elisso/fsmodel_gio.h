@@ -59,9 +59,13 @@ public:
                                 const string &strBasename,
                                 bool fIsLocal) override;
 
-    virtual PFsDirEnumeratorBase beginEnumerateChildren(FsContainer &cnr) override;
+    virtual PFsDirEnumeratorBase beginEnumerateChildren(FsContainer &cnr,
+                                                        bool fNamesOnly,
+                                                        bool fDirectoriesOnly) override;
 
-    virtual bool getNextChild(PFsDirEnumeratorBase pEnum, string &strBasename) override;
+    virtual bool getNextChild(PFsDirEnumeratorBase pEnum,
+                              string &strBasename,
+                              PFsObject &pTemp) override;
 
     virtual string getSymlinkContents(FsSymlink &ln) override;
 
@@ -85,7 +89,23 @@ public:
 
     Glib::RefPtr<Gio::FileInfo> getFileInfo(PGioFile pGioFile);
 
+    /**
+     *  Returns the comma-separated list of Gio attributes that getFileInfo() and the
+     *  directory enumerator query, which is everything makeAwakeFromInfo() needs.
+     *  Owners are queried as numeric ids for local files, which saves Gio the user and
+     *  group name lookups for every file, and as names for everything else.
+     */
+    static const string& GetInfoAttributes(bool fIsLocal);
+
     static void Init();
+
+protected:
+    PFsObject makeAwakeFromInfo(const string &strBasename,
+                                Glib::RefPtr<Gio::FileInfo> pInfo);
+
+    PFsObject createObject(FSType t,
+                           const string &strBasename,
+                           const FsCoreInfo &info);
 };
 
 extern FsGioImpl *g_pFsGioImpl;
@@ -272,7 +292,7 @@ protected:
     static PFsGioSpecial Create(const string &strBasename);
 
     FsGioSpecial(const string &strBasename)
-        : FsObject(FSType::SPECIAL, strBasename, { 0, 0, "", ""})
+        : FsObject(FSType::SPECIAL, strBasename, { 0, 0, 0, 0 })
     { }
 
 
@@ -317,7 +337,7 @@ protected:
 
     FsGioMountable(const string &strName,
                    PFsGioDirectory pRootDir)
-        : FsObject(FSType::MOUNTABLE, strName, { 0, 0, "", ""}),
+        : FsObject(FSType::MOUNTABLE, strName, { 0, 0, 0, 0 }),
           _pRootDir(pRootDir)
     { }
 
@@ -360,22 +380,79 @@ private:
 
 /**
  *  Simple structure to temporarily hold the complete or partial binary contents
- *  of a file. The constructor reads them from disk via fopen().
+ *  of a file, read into a malloc()ed buffer through a Gio stream. For whole files
+ *  of any size, use FileStream instead, which only ever needs one chunk of memory.
  */
 struct FileContents
 {
     /**
      *  Constructor. This reads the file. If cbMax is not zero, then at most that many
-     *  bytes will be read.
+     *  bytes will be available. Throws FSException on errors.
      */
     FileContents(FsGioFile &file, size_t cbMax = 0);
 
     ~FileContents();
 
-    char *_pData;
-    size_t _size;       // Actual size of the data read; this is cbMax from the constructor if it was not zero.
+    FileContents(const FileContents &) = delete;
+    FileContents& operator=(const FileContents &) = delete;
+
+    const char *_pData;
+    size_t _size;       // Actual size of the data; at most cbMax from the constructor if that was not zero.
 };
 typedef std::shared_ptr<FileContents> PFileContents;
 
 
+/***************************************************************************
+ *
+ *  FileStream
+ *
+ **************************************************************************/
+
+/**
+ *  Hands out a file's contents in chunks of at most CB_CHUNK bytes, for consumers like
+ *  PixbufLoader that can start working on the first chunk while the rest is still on
+ *  its way, instead of waiting for the whole file like with FileContents.
+ *
+ *  Local regular files are read with plain read() calls, and the kernel is told to read
+ *  ahead generously, so it fetches the next chunks while the caller is busy with the
+ *  current one. Everything else is read from a Gio stream. Either way, the chunks go
+ *  into one buffer that gets reused.
+ *
+ *  Local files are deliberately not mapped: another program that truncates the file
+ *  while we read it would get us a SIGBUS, whereas read() just ends early.
+ *
+ *  The constructor only opens the file; the reading happens in next(), on whichever
+ *  thread calls it.
+ */
+class FileStream
+{
+public:
+    static const size_t CB_CHUNK = 256 * 1024;
+
+    /**
+     *  Constructor. Opens the file. Throws FSException on errors.
+     */
+    FileStream(FsGioFile &file);
+
+    ~FileStream();
+
+    FileStream(const FileStream &) = delete;
+    FileStream& operator=(const FileStream &) = delete;
+
+    /**
+     *  Sets pData and cb to the next chunk of the file and returns true, or returns false
+     *  at the end of the file. The chunk stays valid until the next call. Throws
+     *  FSException on read errors.
+     */
+    bool next(const char *&pData, size_t &cb);
+
+private:
+    int                                 _fd = -1;       // Only for local regular files.
+    string                              _strPath;       // Of _fd, for error messages.
+    Glib::RefPtr<Gio::FileInputStream>  _pStream;       // Only if _fd is -1.
+    std::vector<char>                   _buf;
+};
+typedef std::shared_ptr<FileStream> PFileStream;
+
+
 #endif // ELISSO_FSMODEL_GIO_H
@@ -0,0 +1,114 @@
+/*
+ * elisso -- fast and friendly gtkmm file manager. (C) 2016--2017 Baubadil GmbH.
+ *
+ * elisso is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the elisso main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#ifndef ELISSO_FSMODEL_POSIX_H
+#define ELISSO_FSMODEL_POSIX_H
+
+#include "elisso/fsmodel_gio.h"
+
+#include "xwp/statring.h"
+
+class FsDirEnumeratorPosix;
+struct PosixStat;
+
+
+/***************************************************************************
+ *
+ *  FsPosixImpl
+ *
+ **************************************************************************/
+
+/**
+ *  Backend for local files (those with the IS_LOCAL flag, i.e. under file:///)
+ *  which talks to the kernel directly instead of going through Gio's attribute
+ *  strings and GObject allocations for every directory entry: directories are
+ *  read with openat() and getdents64(), and entries are stat'ed with statx()
+ *  relative to the directory's file descriptor.
+ *
+ *  This derives from FsGioImpl, which remains in charge of everything else:
+ *  objects are still created as FsGioFile and FsGioDirectory instances so that
+ *  thumbnails and getGioFile() keep working, all file operations go through Gio,
+ *  and all non-local URI schemes are passed on to the Gio methods unchanged.
+ */
+class FsPosixImpl : public FsGioImpl
+{
+public:
+    virtual PFsObject makeAwake(const string &strParentPath,
+                                const string &strBasename,
+                                bool fIsLocal) override;
+
+    virtual PFsDirEnumeratorBase beginEnumerateChildren(FsContainer &cnr,
+                                                        bool fNamesOnly,
+                                                        bool fDirectoriesOnly) override;
+
+    virtual bool getNextChild(PFsDirEnumeratorBase pEnum,
+                              string &strBasename,
+                              PFsObject &pTemp) override;
+
+    virtual uint64_t getContentsStamp(FsContainer &cnr) override;
+
+    virtual void onContentsPopulated(FsContainer &cnr,
+                                     PFsDirEnumeratorBase pEnum,
+                                     const FsVector &vContents) override;
+
+    virtual string getSymlinkContents(FsSymlink &ln) override;
+
+    virtual void onMonitoringStarted(FsContainer &cnr) override;
+
+    virtual void onMonitoringStopped(FsContainer &cnr) override;
+
+    /**
+     *  Replacement for FsGioImpl::Init() which installs this backend instead.
+     *
+     *  If elisso was configured with --enable-io-uring, directory entries are stat'ed
+     *  in batches through an io_uring with a queue depth of 64, which can be changed
+     *  with the ELISSO_STATX_QUEUE_DEPTH environment variable (0 disables it).
+     *
+     *  This also enables FsSnapshot in $XDG_CACHE_HOME/elisso/snapshots: local directories
+     *  that have not changed since they were last read are then served from a snapshot
+     *  (and get the POPULATED_FROM_CACHE flag), and complete reads from disk write a new
+     *  one. This only covers ext2/3/4, xfs, btrfs, f2fs and tmpfs, since directory times
+     *  on other file systems (/proc, NFS, FUSE...) do not reliably tell whether they have
+     *  changed. Setting ELISSO_SNAPSHOTS=0 disables that.
+     *
+     *  Local directories with monitors are watched with inotify through FsWatcher so that
+     *  changes by other programs show up without a refresh. Setting ELISSO_WATCH=0
+     *  disables that.
+     *
+     *  Finally, this sets the budget for FsContainer::SetMemoryBudget() to 256 MB, which
+     *  ELISSO_CACHE_MB can change (0 disables eviction).
+     */
+    static void Init();
+
+    /**
+     *  Changes the io_uring queue depth that Init() has set, e.g. to 0 to compare the
+     *  batched statx calls with sequential ones. Has no effect on directories that are
+     *  already being read. Without io_uring support, the depth is always 0.
+     */
+    static void SetStatxQueueDepth(uint uDepth);
+
+    static uint GetStatxQueueDepth();
+
+protected:
+    void queueEntries(FsDirEnumeratorPosix &en,
+                      StatxRequestsVector &vRequests);
+
+    void statBatch(FsDirEnumeratorPosix &en,
+                   StatxRequestsVector &vRequests);
+
+    PFsObject makeAwakeAt(int fdDir,
+                          const string &strBasename,
+                          const string &strPathForErrors);
+
+    PFsObject makeAwakeFromStat(const string &strName,
+                                const PosixStat &st);
+};
+
+#endif // ELISSO_FSMODEL_POSIX_H
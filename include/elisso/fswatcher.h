@@ -0,0 +1,66 @@
+/*
+ * elisso -- fast and friendly gtkmm file manager. (C) 2016--2017 Baubadil GmbH.
+ *
+ * elisso is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the elisso main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#ifndef ELISSO_FSWATCHER_H
+#define ELISSO_FSWATCHER_H
+
+#include "xwp/fsmodel_base.h"
+
+
+/***************************************************************************
+ *
+ *  FsWatcher
+ *
+ **************************************************************************/
+
+/**
+ *  Keeps an inotify watch on every local directory that has a monitor attached, so that
+ *  changes made by other processes show up in the folder views and the tree without a
+ *  refresh. FsPosixImpl adds and removes the watches from its onMonitoringStarted() and
+ *  onMonitoringStopped() overrides.
+ *
+ *  A single thread reads the events for all directories. Since programs tend to produce
+ *  bursts of events (a compiler writing object files, rsync, tar), the thread collects the
+ *  names that were touched until no new event has arrived for a little while and then
+ *  brings each of them up to date with FsContainer::revalidateEntry(), or renameEntry()
+ *  for renames within a directory. If a directory has too many changes for that, or the
+ *  kernel's event queue has overflowed, the directory is revalidated as a whole with
+ *  getContents() instead. The resulting changes are then handed to the GUI thread, which
+ *  notifies the monitors.
+ */
+class FsWatcher : public ProhibitCopy
+{
+public:
+    /**
+     *  Returns the watcher, creating it and starting its thread on the first call, or
+     *  nullptr if inotify is not available. The first call must happen on the GUI thread.
+     */
+    static FsWatcher* Get();
+
+    /**
+     *  Starts watching the directory with the given local path, whose contents are in cnr.
+     */
+    void addWatch(FsContainer &cnr,
+                  const string &strPath);
+
+    void removeWatch(FsContainer &cnr);
+
+private:
+    FsWatcher(int fdInotify);
+
+    void run();
+    void processPending();
+    void onChangesReady();
+
+    struct Impl;
+    Impl        *_pImpl;
+};
+
+#endif // ELISSO_FSWATCHER_H
@@ -27,6 +27,7 @@ struct ViewPopulatedResult
     PFSVector       pvContents;         // Complete folder contents.
     FsVector        vAdded;             // Files that were added. Useful for refresh.
     FsVector        vRemoved;           // Files that were removed. Useful for refresh.
+    bool            fPartial = false;   // If true, this is a batch with only vAdded set, and more results will follow.
     uint            idPopulateThread;
     bool            fClickFromTree;     // true if SetDirectoryFlag::CLICK_FROM_TREE was set.
     PFsObject       pDirSelectPrevious; // Item to select among populate results, or nullptr.
@@ -66,6 +67,12 @@ typedef std::shared_ptr<PopulateThread> PPopulateThread;
  *      ViewPopulatedResult with the results from the populate thread's
  *      FsContainer::getContents() call.
  *
+ *      For large folders, the dispatcher also fires while getContents() is still
+ *      running, with ViewPopulatedResult::fPartial set and the files that have been
+ *      added since the previous batch in vAdded (see POPULATE_BATCH_SIZE). The last
+ *      result never has fPartial set and contains the complete lists as before, which
+ *      include the files from the batches.
+ *
  *   3) When the dispatcher then fires on the GUI thread, it should check
  *      ViewPopulatedResult::strError if an exception occured on the populate thread.
  *      If not, it can fill the folder view with the results.
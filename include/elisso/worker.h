@@ -17,6 +17,7 @@
 #include <deque>
 
 #include "xwp/thread.h"
+#include "xwp/trace.h"
 
 
 /***************************************************************************
@@ -36,6 +37,8 @@ struct WorkerInputQueue : public ProhibitCopy
     std::mutex                  mutex;
     std::condition_variable     cond;
     std::deque<P>               deq;
+    // How the hand-offs through this queue are labelled in a TraceSink.
+    const char                  *pcszTraceName = "WorkerInputQueue";
 
     /**
      *  Returns the no. of items queued. This is not atomic if you use it with post()
@@ -54,6 +57,10 @@ struct WorkerInputQueue : public ProhibitCopy
      */
     void post(P p)
     {
+        if (    (TraceSink::IsEnabled())
+             && (p)
+           )
+            TraceSink::FlowOut(pcszTraceName, TraceSink::MakeFlowID(this, &*p));
         {
             std::unique_lock<std::mutex> lock(mutex);
             deq.push_back(p);
@@ -78,6 +85,12 @@ struct WorkerInputQueue : public ProhibitCopy
 
         P p = deq.at(0);
         deq.pop_front();
+        lock.unlock();
+
+        if (    (TraceSink::IsEnabled())
+             && (p)
+           )
+            TraceSink::FlowIn(pcszTraceName, TraceSink::MakeFlowID(this, &*p));
         return p;
     }
 
@@ -143,8 +156,20 @@ public:
         return _dispatcher.connect(fn);
     }
 
+    /**
+     *  Sets how the hand-offs through this queue are labelled in a TraceSink.
+     */
+    void setTraceName(const char *pcsz)
+    {
+        _pcszTraceName = pcsz;
+    }
+
     void postResultToGui(P pResult)
     {
+        if (    (TraceSink::IsEnabled())
+             && (pResult)
+           )
+            TraceSink::FlowOut(_pcszTraceName, TraceSink::MakeFlowID(this, &*pResult));
         // Do not hold the mutex while messing with the dispatcher -> that could deadlock.
         {
             Lock lock(_mutex);
@@ -153,6 +178,15 @@ public:
         _dispatcher.emit();
     }
 
+    /**
+     *  Returns the no. of results that have been posted but not fetched yet.
+     */
+    size_t size()
+    {
+        Lock lock(_mutex);
+        return _deque.size();
+    }
+
     P fetchResult()
     {
         Lock lock(_mutex);
@@ -162,6 +196,11 @@ public:
             p = _deque.at(0);
             _deque.pop_front();
         }
+
+        if (    (TraceSink::IsEnabled())
+             && (p)
+           )
+            TraceSink::FlowIn(_pcszTraceName, TraceSink::MakeFlowID(this, &*p));
         return p;
     }
 
@@ -169,6 +208,7 @@ protected:
     Mutex               _mutex;
     Glib::Dispatcher    _dispatcher;
     std::deque<P>       _deque;
+    const char          *_pcszTraceName = "WorkerResultQueue";
 };
 
 #endif // ELISSO_WORKER_H
@@ -12,6 +12,7 @@
 #define XWP_DEBUG_H
 
 #include "xwp/basetypes.h"
+#include "xwp/trace.h"
 
 namespace XWP
 {
@@ -69,20 +70,80 @@ const DebugFlag FOLDER_INSERT   = (1 << 25);
 const uint8_t NO_ECHO_NEWLINE           = 0x01;
 const uint8_t CONTINUE_FROM_PREVIOUS    = 0x02;
 
+/**
+ *  The debug flags that are compiled in at all. Release builds can define this to a subset
+ *  (e.g. "./configure --trace-flags=0"), and then the compiler removes the tracing for all
+ *  other flags, including DEBUG_LOG and DEBUG_SCOPE message arguments. DEBUG_ALWAYS
+ *  messages are never removed.
+ */
+#ifndef XWP_DEBUG_COMPILED_FLAGS
+#define XWP_DEBUG_COMPILED_FLAGS    (~0u)
+#endif
+
+/**
+ *  Tracing support. Each Debug instance is a scope that logs "Entering" and "Leaving" lines
+ *  with the time it took if its flag is set in g_flDebugSet, and Log() prints single lines.
+ *  The scopes are kept on a stack per thread, so that threads do not contend for anything
+ *  unless their tracing is enabled.
+ *
+ *  Since the message strings are built by the caller, hot code paths should use the
+ *  DEBUG_LOG and DEBUG_SCOPE macros below, which only evaluate their message arguments if
+ *  the flag is enabled; disabled tracing then costs a single test of g_flDebugSet.
+ *
+ *  While a TraceSink is enabled, all scopes whose flag is compiled in are also recorded
+ *  there, whether or not the flag is enabled for the log.
+ */
 class Debug
 {
     string _strExit;
+    bool _fActive;
+    bool _fTraced;
 public:
     Debug(DebugFlag fl,
           const string &strFuncName,
           const string &strExtra = "")
+        : _fActive(IsEnabled(fl)),
+          _fTraced(IsTraced(fl))
     {
-        Enter2(fl, strFuncName, strExtra);
+        if (_fActive)
+            Enter2(fl, strFuncName, strExtra);
+        if (_fTraced)
+            TraceSink::Begin(strFuncName);
+    }
+
+    /**
+     *  For DEBUG_SCOPE, which has already called IsEnabled() and IsTraced() to decide
+     *  whether to build the name at all. pstrFuncName may only be nullptr if both
+     *  fActive and fTraced are false.
+     */
+    Debug(DebugFlag fl,
+          bool fActive,
+          bool fTraced,
+          const string *pstrFuncName)
+        : _fActive(fActive),
+          _fTraced(fTraced)
+    {
+        if (_fActive)
+            Enter2(fl, *pstrFuncName);
+        if (_fTraced)
+            TraceSink::Begin(*pstrFuncName);
     }
 
     ~Debug()
     {
-        Leave2(_strExit);
+        if (_fTraced)
+            TraceSink::End();
+        if (_fActive)
+            Leave2(_strExit);
+    }
+
+    /**
+     *  Returns true if this scope gets logged, so that callers can skip building the
+     *  string for setExit() otherwise.
+     */
+    bool isActive() const
+    {
+        return _fActive;
     }
 
     void setExit(const string &str)
@@ -90,6 +151,35 @@ public:
         _strExit = str;
     }
 
+    static bool IsEnabled(DebugFlag fl)
+    {
+        return    (fl == DEBUG_ALWAYS)
+               || (    (fl & (XWP_DEBUG_COMPILED_FLAGS))
+                    && (g_flDebugSet & fl)
+                  );
+    }
+
+    static bool IsTraced(DebugFlag fl)
+    {
+        return    (TraceSink::IsEnabled())
+               && (    (fl == DEBUG_ALWAYS)
+                    || (fl & (XWP_DEBUG_COMPILED_FLAGS))
+                  );
+    }
+
+    /**
+     *  Returns the address of str, which DEBUG_SCOPE needs to pass a temporary name to the
+     *  constructor above. The pointer is only valid until the end of the full expression.
+     */
+    static const string* NamePtr(const string &str)
+    {
+        return &str;
+    }
+
+    /**
+     *  Enter2() and Leave2() must be called in pairs on the same thread, and only for
+     *  flags for which IsEnabled() returns true; Debug instances take care of that.
+     */
     static void Enter2(DebugFlag fl,
                       const string &strFuncName,
                       const string &strExtra = "");
@@ -108,4 +198,28 @@ public:
 
 } // namespace XWP
 
-#endif // XWP_STRINGHELP_H
+/**
+ *  Like Debug::Log(fl, ...), but the arguments are only evaluated if tracing for fl is
+ *  enabled.
+ */
+#define DEBUG_LOG(fl, ...)                                      \
+    do                                                          \
+    {                                                           \
+        if (XWP::Debug::IsEnabled(fl))                          \
+            XWP::Debug::Log(fl, __VA_ARGS__);                   \
+    } while (0)
+
+/**
+ *  Declares a Debug scope named d, like "Debug d(fl, str)", but str is only evaluated if
+ *  tracing for fl is enabled or a TraceSink is recording. Otherwise no strings are built
+ *  at all, and g_flDebugSet and the TraceSink are only tested once.
+ */
+#define DEBUG_SCOPE(d, fl, str)                                 \
+    const bool d##_fActive = XWP::Debug::IsEnabled(fl);         \
+    const bool d##_fTraced = XWP::Debug::IsTraced(fl);          \
+    XWP::Debug d(fl,                                            \
+                 d##_fActive,                                   \
+                 d##_fTraced,                                   \
+                 (d##_fActive || d##_fTraced) ? XWP::Debug::NamePtr(str) : nullptr)
+
+#endif // XWP_DEBUG_H
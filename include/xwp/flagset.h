@@ -56,6 +56,50 @@ private:
     uint value = 0;
 };
 
+/**
+ *  Like FlagSet, but the bits are kept in an atomic so that several threads can
+ *  test and modify individual flags without holding a lock. set() and clear() are
+ *  read-modify-write operations, so concurrent changes to different bits don't get
+ *  lost; test() acquires and set() and clear() release, so whatever a thread wrote
+ *  before setting a flag is visible to threads that see the flag set.
+ *
+ *  Unlike FlagSet, this cannot be copied.
+ */
+template<typename E>
+class AtomicFlagSet
+{
+public:
+    AtomicFlagSet() = default;
+    AtomicFlagSet(const AtomicFlagSet&) = delete;
+    AtomicFlagSet& operator=(const AtomicFlagSet&) = delete;
+
+    bool test(E rhs) const
+    {
+        return !!(value.load(std::memory_order_acquire) & static_cast<uint>(rhs));
+    }
+
+    void set(E rhs)
+    {
+        value.fetch_or(static_cast<uint>(rhs), std::memory_order_acq_rel);
+    }
+
+    void clear(E rhs)
+    {
+        value.fetch_and(~(static_cast<uint>(rhs)), std::memory_order_acq_rel);
+    }
+
+    /**
+     *  Sets the given flag and returns whether it was set before, in one atomic step.
+     */
+    bool testAndSet(E rhs)
+    {
+        return !!(value.fetch_or(static_cast<uint>(rhs), std::memory_order_acq_rel) & static_cast<uint>(rhs));
+    }
+
+private:
+    std::atomic<uint> value{0};
+};
+
 template<typename E>
 FlagSet<E> operator|(E lhs, E rhs)
 {
@@ -0,0 +1,111 @@
+/*
+ * libxwp -- generic helper routines for C++11. (C) 2015--2017 Baubadil GmbH.
+ *
+ * libxwp is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the libxwp main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#ifndef XWP_FSINDEX_H
+#define XWP_FSINDEX_H
+
+#include "xwp/fsmodel_base.h"
+
+
+/***************************************************************************
+ *
+ *  FsContentsIndex
+ *
+ **************************************************************************/
+
+/**
+ *  The contents index of an FsContainer, which maps basenames to the container's
+ *  child objects.
+ *
+ *  This is a flat hash table with open addressing and linear probing. Each slot
+ *  holds only the object pointer and the hash of its name; the key is the basename
+ *  that the object stores anyway, so there are no string copies and no per-entry
+ *  allocations as with a std::map<string, PFsObject>, and a lookup usually touches
+ *  only one or two adjacent slots. Removals shift the following entries back, so
+ *  there are no tombstones either.
+ *
+ *  Since the key belongs to the object, an object's basename must not change while
+ *  it is in the index; FsObject::rename() removes and re-adds it.
+ *
+ *  For ordered iteration, getSorted() returns a vector of all objects sorted by
+ *  basename, which is only rebuilt when the index has changed since the last call.
+ *
+ *  This is not thread-safe; FsContainer protects it with its ContentsLock.
+ */
+class FsContentsIndex : public ProhibitCopy
+{
+public:
+    /**
+     *  Returns the object with the given basename, or nullptr if there is none.
+     */
+    PFsObject find(const string &strBasename) const;
+
+    /**
+     *  Adds p under its basename. If an object was stored under that name before, it is
+     *  replaced and returned; otherwise this returns nullptr.
+     */
+    PFsObject insert(PFsObject p);
+
+    /**
+     *  Removes the object with the given basename from the index and returns it, or
+     *  returns nullptr if there was none.
+     */
+    PFsObject remove(const string &strBasename);
+
+    void clear();
+
+    size_t size() const
+    {
+        return _c;
+    }
+
+    /**
+     *  Calls fn for every object in the index, in no particular order. fn must not modify
+     *  the index.
+     */
+    template<class F>
+    void forEach(F fn) const
+    {
+        for (auto &slot : _vSlots)
+            if (slot.p)
+                fn(slot.p);
+    }
+
+    /**
+     *  Returns all objects in the index, sorted by basename.
+     *
+     *  The vector is not touched by insert() or remove(), so the caller may iterate over it
+     *  while modifying the index. It remains valid until the next getSorted() or clear().
+     */
+    const FsVector& getSorted();
+
+    /**
+     *  Frees the vector returned by getSorted(), which holds a second reference to every
+     *  object, so that the index holds the only one.
+     */
+    void dropSorted();
+
+private:
+    struct Slot
+    {
+        size_t      uHash = 0;
+        PFsObject   p;              // nullptr if the slot is empty.
+    };
+
+    size_t findSlot(const string &strBasename, size_t uHash) const;
+    void grow();
+
+    vector<Slot>    _vSlots;        // Power of two in size, or empty.
+    size_t          _c = 0;
+    FsVector        _vSorted;
+    bool            _fSortedValid = false;
+};
+
+#endif // XWP_FSINDEX_H
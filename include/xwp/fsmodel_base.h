@@ -11,6 +11,7 @@
 #ifndef XWP_FSMODEL_BASE_H
 #define XWP_FSMODEL_BASE_H
 
+#include <functional>
 #include <memory>
 #include <type_traits>
 
@@ -56,6 +57,12 @@ typedef std::shared_ptr<FsSymlink> PFsSymlink;
 typedef std::vector<PFsObject> FsVector;
 typedef std::shared_ptr<FsVector> PFSVector;
 
+/**
+ *  Callback type for FsContainer::getContents(), which gets called for every object that
+ *  gets added to a container while it is being populated.
+ */
+typedef std::function<void (PFsObject &pFS)> FnFsObjectAdded;
+
 class FsContainer;
 class ContentsLock;
 
@@ -70,9 +77,12 @@ namespace XWP { class Debug; }
 
 /**
  *  Global lock for the whole file-system model. This is used to protect
- *  instance data of FsObject and the derived classes. Since the
- *  file-system model is designed to be thread-safe, this lock must always
- *  be held when reading or modifying instance data.
+ *  structural data that is shared between objects, such as the list of
+ *  monitors of a container.
+ *
+ *  The FSFlag bits of an object are NOT protected by this: they are kept
+ *  in an AtomicFlagSet and can be tested and modified from any thread
+ *  without a lock.
  *
  *  This is a global lock so it must only ever be held for a very short
  *  amount of time, say, a few instructions.
@@ -84,8 +94,7 @@ namespace XWP { class Debug; }
  *  Again, do not hold this for a long time since this will block all
  *  file operations. If you have something that takes longer but needs
  *  to be atomic, use a mechanism like in FsSymlink::follow(), which
- *  introduces a per-object state flag (which is protected by FsLock)
- *  together with a condition variable.
+ *  introduces a per-object state together with a condition variable.
  */
 class FsLock : public XWP::Lock
 {
@@ -101,11 +110,32 @@ public:
  **************************************************************************/
 
 /**
- *  Empty class to be subclassed by client code that subclasses FsImplBase
+ *  What a directory listing tells about an entry besides its name, like the inode number
+ *  and type that getdents64() returns with every name. Either may be unknown (0 and
+ *  FSType::UNINITIALIZED), e.g. on file systems that report DT_UNKNOWN.
+ */
+struct FsDirEntryID
+{
+    uint64_t    uInode = 0;
+    FSType      type = FSType::UNINITIALIZED;
+};
+
+/**
+ *  Class to be subclassed by client code that subclasses FsImplBase
  *  as well. An instance of this is returned by FsImplBase::beginEnumerateChildren().
  */
 class FsDirEnumeratorBase
 {
+public:
+    virtual ~FsDirEnumeratorBase() { }
+
+    /**
+     *  Whenever FsImplBase::getNextChild() returns only a name, the backend sets this to
+     *  what the listing told it about that entry. FsContainer::getContents() compares it
+     *  with an object of that name that is already awake to find out if the name now
+     *  refers to a different file.
+     */
+    FsDirEntryID    idCurrent;
 };
 
 typedef std::shared_ptr<FsDirEnumeratorBase> PFsDirEnumeratorBase;
@@ -122,6 +152,23 @@ class FsImplBase : ProhibitCopy
 protected:
     FsImplBase();
 
+    /**
+     *  Cache of absolute paths for findPath() implementations, which should call this
+     *  before walking down the path. Returns the object that strPath has recently been
+     *  resolved to if it is still awake and in the same place, or nullptr otherwise.
+     *  This takes no contents locks and allocates no memory.
+     *
+     *  On nullptr, the caller should resolve the path itself and pass the result to
+     *  CachePath() together with the generation that this has returned in uGeneration,
+     *  so that a rename during the walk cannot put a stale result in the cache.
+     */
+    static PFsObject FindCachedPath(const string &strPath,
+                                    uint64_t &uGeneration);
+
+    static void CachePath(const string &strPath,
+                          const PFsObject &pFS,
+                          uint64_t uGeneration);
+
 public:
     virtual PFsObject findPath(const string &strPath) = 0;
 
@@ -141,17 +188,85 @@ public:
      *  The equivalent of opendir(). This returns a shared pointer to a buffer with
      *  implementation-defined data. Keep calling getNextChild() until that returns
      *  false.
+     *
+     *  If fNamesOnly is true, the caller is only interested in the names of the entries,
+     *  and getNextChild() can skip reading any metadata and return nullptr for the object.
+     *  FsContainer::getContents() uses that when it wakes up the objects on several threads
+     *  with makeAwake() instead. A backend that has the objects at hand anyway (e.g. from a
+     *  cache) may still return them, and the caller will use those.
+     *
+     *  If fDirectoriesOnly is true, the caller only needs the entries that are directories or
+     *  symlinks (which may point to directories), as for FsContainer::Get::FOLDERS_ONLY and
+     *  Get::FIRST_FOLDER_ONLY. The backend may then leave out entries that it knows to be
+     *  anything else without reading their metadata, and it may return the symlinks after
+     *  the directories so that Get::FIRST_FOLDER_ONLY can stop before following any of them.
+     *
+     *  A backend that serves the contents from a cache instead of the disk must set the
+     *  POPULATED_FROM_CACHE flag on the container here, and it must not use the cache if
+     *  the container has the REFRESH_FROM_DISK flag.
      */
-    virtual PFsDirEnumeratorBase beginEnumerateChildren(FsContainer &cnr) = 0;
+    virtual PFsDirEnumeratorBase beginEnumerateChildren(FsContainer &cnr,
+                                                        bool fNamesOnly,
+                                                        bool fDirectoriesOnly) = 0;
 
     /**
      *  To be used with the buffer returned by beginEnumerateChildren(). If this
-     *  returns true, then strBasename has been set to another directory entry;
-     *  otherwise no other items have been found. This never returns the "." or
-     *  ".." entries so it may return false even on the first call if the directory
-     *  is empty.
+     *  returns true, then strBasename has been set to another directory entry,
+     *  and pTemp has been set to a new object for it, just like makeAwake() would
+     *  return it, but without a second round-trip to the disk, since the backend
+     *  must fill it from the metadata that came with the directory entry. Like with
+     *  makeAwake(), that object has not been added to the container yet.
+     *
+     *  If this returns false, no other items have been found. This never returns
+     *  the "." or ".." entries so it may return false even on the first call if
+     *  the directory is empty.
+     */
+    virtual bool getNextChild(PFsDirEnumeratorBase pEnum,
+                              string &strBasename,
+                              PFsObject &pTemp) = 0;
+
+    /**
+     *  Returns a value that changes whenever an entry is added to, removed from or renamed
+     *  in the given container's directory (e.g. derived from the directory's modification
+     *  time), or 0 if the backend cannot tell. This must be cheap, a stat or two at most.
+     *
+     *  FsContainer::getContents() remembers this across complete populates, and if it has
+     *  not changed, a refresh after unsetPopulated() does not read the directory again.
+     *  The default implementation returns 0, which disables that.
      */
-    virtual bool getNextChild(PFsDirEnumeratorBase pEnum, string &strBasename) = 0;
+    virtual uint64_t getContentsStamp(FsContainer &cnr)
+    {
+        return 0;
+    }
+
+    /**
+     *  Gets called by FsContainer::getContents() after it has completely populated a
+     *  container with Get::ALL through the given enumerator, with the container's new
+     *  contents. This is not called if populating was stopped or failed. A backend can
+     *  use this to update a cache; the default implementation does nothing.
+     *
+     *  This runs on the populating thread without any locks held.
+     */
+    virtual void onContentsPopulated(FsContainer &cnr,
+                                     PFsDirEnumeratorBase pEnum,
+                                     const FsVector &vContents)
+    { }
+
+    /**
+     *  Gets called by FsMonitorBase::startWatching() when the first monitor gets attached
+     *  to the given container, and by stopWatching() when the last one gets detached. A
+     *  backend can use this to have the kernel report changes that other processes make
+     *  to the directory, and hand them to FsContainer::revalidateEntry(). The default
+     *  implementations do nothing.
+     *
+     *  These run on the thread that calls startWatching() or stopWatching() (normally the
+     *  GUI thread) without any locks held.
+     */
+    virtual void onMonitoringStarted(FsContainer &cnr)
+    { }
+
+    virtual void onMonitoringStopped(FsContainer &cnr)
+    { }
 
     /**
      *  The equivalent of readlink(). Returns the unprocessed contents of the given
@@ -203,7 +318,8 @@ public:
  *  Monitor interface to allow clients to be notified when the contents of
  *  a directory change. This happens both on programmatic changes (e.g.
  *  createSubdirectory()) as well as background changes from file system
- *  watches (TODO).
+ *  watches, if the backend supports them (see FsImplBase::onMonitoringStarted()).
+ *  Either way, the notifications arrive on the GUI thread.
  *
  *  To use:
  *
@@ -246,6 +362,20 @@ public:
     virtual void onItemAdded(PFsObject &pFS) = 0;
     virtual void onItemRemoved(PFsObject &pFS) = 0;
     virtual void onItemRenamed(PFsObject &pFS, const std::string &strOldName, const std::string &strNewName) = 0;
+    /**
+     *  Called when the size, timestamp or owner of a file has changed on disk. pFS is a new
+     *  object which has replaced the old one of the same name in the container.
+     */
+    virtual void onItemChanged(PFsObject &pFS) = 0;
+
+    /**
+     *  Called instead of onItemAdded() and onItemRemoved() when many items come at once,
+     *  e.g. from a file operation on a large selection. The default implementations simply
+     *  call those for each item; subclasses should override these to update their models
+     *  in one go.
+     */
+    virtual void onItemsAdded(const FsVector &vFS);
+    virtual void onItemsRemoved(const FsVector &vFS);
 
     FsContainer* isWatching()
     {
@@ -287,10 +417,12 @@ enum class FSFlag : uint16_t
     HIDDEN                     =  (1 <<  7),
     THUMBNAILING               =  (1 <<  8),
     IS_LOCAL                   =  (1 <<  9),        // path has file:/// URI
+    POPULATED_FROM_CACHE       =  (1 << 10),        // only for dirs; contents came from a backend cache and may be outdated
+    REFRESH_FROM_DISK          =  (1 << 11),        // only for dirs; set by unsetPopulated(), backends must bypass their caches
 };
 // DEFINE_FLAGSET(FSFlag)
 
-typedef FlagSet<FSFlag> FSFlagSet;
+typedef AtomicFlagSet<FSFlag> FSFlagSet;
 
 enum class CopyOrMove
 {
@@ -298,21 +430,70 @@ enum class CopyOrMove
     MOVE
 };
 
+/**
+ *  Index into the process-wide FsIdentities table. 0 is the "unknown" identity, whose
+ *  name is empty.
+ */
+typedef uint32_t FsIdentityID;
+
+/**
+ *  Process-wide table of the users and groups that own file-system objects, so that
+ *  every object only needs to store two FsIdentityID values instead of two strings,
+ *  and the same identity always has the same ID, which makes comparing owners cheap.
+ *
+ *  Identities can either be numeric (a local uid or gid), whose names are only looked up
+ *  when GetName() is first called for them, or plain names, for backends that report
+ *  owners by name (remote ids mean nothing on this machine).
+ *
+ *  All methods are thread-safe. Returned string references remain valid for the lifetime
+ *  of the process.
+ */
+class FsIdentities
+{
+public:
+    static FsIdentityID FromUid(uint32_t uid);
+    static FsIdentityID FromGid(uint32_t gid);
+    static FsIdentityID FromUserName(const string &strName);
+    static FsIdentityID FromGroupName(const string &strName);
+
+    /**
+     *  Returns the user or group name for the given identity, looking it up with
+     *  getpwuid_r() or getgrgid_r() on the first call for a numeric identity.
+     */
+    static const string& GetName(FsIdentityID id);
+
+    /**
+     *  Returns "user:group" for the given pair of identities. Each combination is only
+     *  built once.
+     */
+    static const string& GetOwnerString(FsIdentityID idUser,
+                                        FsIdentityID idGroup);
+
+    /**
+     *  If the given identity is numeric, stores the uid or gid in u and returns true.
+     */
+    static bool GetNumeric(FsIdentityID id,
+                           uint32_t &u);
+};
+
 struct FsCoreInfo
 {
     uint64_t _cbSize;
     uint64_t _uLastModified;
-    string _strOwnerUser;
-    string _strOwnerGroup;
+    FsIdentityID _idOwnerUser;
+    FsIdentityID _idOwnerGroup;
+    uint64_t _uInode;           // 0 if the backend doesn't know.
 
     FsCoreInfo(uint64_t cbSize,
                uint64_t uLastModified,
-               const string &strOwnerUser,
-               const string &strOwnerGroup)
+               FsIdentityID idOwnerUser,
+               FsIdentityID idOwnerGroup,
+               uint64_t uInode = 0)
         : _cbSize(cbSize),
           _uLastModified(uLastModified),
-          _strOwnerUser(strOwnerUser),
-          _strOwnerGroup(strOwnerGroup)
+          _idOwnerUser(idOwnerUser),
+          _idOwnerGroup(idOwnerGroup),
+          _uInode(uInode)
     { }
 };
 
@@ -360,7 +541,7 @@ protected:
     FsObject(FSType type,
              const string &strBasename,
              const FsCoreInfo &info);
-    virtual ~FsObject() { };
+    virtual ~FsObject();
 
 
     /**************************************
@@ -390,6 +571,21 @@ public:
         return _cbSize;
     }
 
+    uint64_t getLastModified() const
+    {
+        return _uLastModified;
+    }
+
+    FsIdentityID getOwnerUser() const
+    {
+        return _idOwnerUser;
+    }
+
+    FsIdentityID getOwnerGroup() const
+    {
+        return _idOwnerGroup;
+    }
+
     FSType getType() const
     {
         return _type;
@@ -430,16 +626,39 @@ public:
     bool isHidden();
 
     /**
-     *  Returns a user:owner string for this filesystem object.
+     *  Returns a user:group string for this filesystem object. The string is shared by
+     *  all objects with the same owners; see FsIdentities.
      */
-    string makeOwnerString();
+    const string& makeOwnerString() const;
 
     /**
      *  Expands the path without resorting to realpath(), which would hit the disk. This
-     *  walks up the parents chain recursively and rebuilds the string on every call.
+     *  walks up the parents chain recursively the first time and then caches the result
+     *  until a directory is renamed or moved.
      */
     std::string getPath() const;
 
+    /**
+     *  Returns the opaque handle that the backend has stored for this object with
+     *  setBackendHandle(), or nullptr if there is none. Handles are cached together
+     *  with the object's path and dropped whenever that might change, so they can be
+     *  derived from the path. Thread-safe.
+     */
+    std::shared_ptr<void> getBackendHandle() const;
+
+    void setBackendHandle(std::shared_ptr<void> pHandle) const;
+
+    /**
+     *  Stores the inode number that the backend got for this object, which operator==
+     *  and refreshes compare to notice that a name now refers to a different file (e.g.
+     *  after an editor saved it by renaming a new file over it). Only backends should
+     *  call this, right after creating the object.
+     */
+    void setInode(uint64_t uInode)
+    {
+        _uInode = uInode;
+    }
+
     /**
      *  Returns an FSFile if *this is a file or a symlink to a file; otherwise, this returns
      *  nullptr.
@@ -582,6 +801,10 @@ protected:
      */
     std::string getPathImpl() const;
 
+    struct PathCache;
+    std::shared_ptr<const PathCache> getPathCache() const;
+    void resetPathCache();
+
 
     /**************************************
      *
@@ -595,9 +818,13 @@ protected:
     string                      _strBasename;
     uint64_t                    _cbSize;
     uint64_t                    _uLastModified;
-    string                      _strOwnerUser;
-    string                      _strOwnerGroup;
-    PFsObject                   _pParent;
+    FsIdentityID                _idOwnerUser;
+    FsIdentityID                _idOwnerGroup;
+    uint64_t                    _uInode = 0;    // 0 if unknown; see setInode().
+    // Weak, since the parent owns its children through its contents index. Whatever holds
+    // on to an object keeps its ancestors from being evicted, see FsContainer::SetMemoryBudget().
+    std::weak_ptr<FsObject>     _pParent;
+    mutable std::shared_ptr<const PathCache> _pPathCache;      // Only access with atomic_load() and atomic_store().
 };
 
 
@@ -659,6 +886,22 @@ public:
  *
  **************************************************************************/
 
+/**
+ *  Statistics about the awake objects and their eviction, as returned by
+ *  FsContainer::GetCacheStats().
+ */
+struct FsCacheStats
+{
+    uint64_t    cObjectsAwake = 0;          // All FsObject instances that currently exist.
+    uint64_t    cbEstimated = 0;            // cObjectsAwake times the estimated size of an object.
+    uint64_t    cbBudget = 0;               // 0 if eviction is disabled.
+    uint64_t    cContainersTracked = 0;     // Containers on the LRU list.
+    uint64_t    cEvictionRuns = 0;
+    uint64_t    cContainersEvicted = 0;
+    uint64_t    cObjectsEvicted = 0;
+    uint64_t    cContainersSkipped = 0;     // Eviction candidates whose contents were in use.
+};
+
 /**
  *  Helper class that implements directory contents. This is inherited via
  *  multiple inheritance by both FsContainer and FsSymlink and contains
@@ -730,18 +973,57 @@ public:
      */
     bool isPopulatedWithDirectories() const;
 
+    /**
+     *  Limits the memory used by awake objects to roughly the given number of bytes, or
+     *  disables the limit with 0, which is the default. Only containers that are populated
+     *  or get new objects after this call are considered for eviction, so call this at
+     *  startup.
+     *
+     *  Objects own their children through the containers' contents indices, and parents
+     *  are only referenced weakly, so a directory tree stays in memory as long as its root
+     *  does. With a budget, containers are put on an LRU list when they get populated,
+     *  and whenever getContents() has read a directory and the awake objects exceed the
+     *  budget, the contents of the least recently used containers are dropped until they
+     *  take up 90% of the budget again. The containers then get populated again on the
+     *  next getContents().
+     *
+     *  Only the contents of a container as a whole are evicted, and only if nothing else
+     *  holds a reference to any of them (a folder view, a tree row, a symlink target, a
+     *  pending file operation) and none of them has awake children of its own. Subtrees
+     *  are therefore released from the bottom up, and whatever a view shows keeps all
+     *  of its ancestors. Containers with monitors, and containers that are being
+     *  populated, are skipped as well.
+     *
+     *  The size of an object is estimated, not measured, including its index slot and
+     *  path cache.
+     */
+    static void SetMemoryBudget(uint64_t cbBudget);
+
+    static FsCacheStats GetCacheStats();
+
     /**
      *  Returns true if the container has the "populated with all" flag set.
      *  See getContents() for what that means.
      */
     bool isCompletelyPopulated() const;
 
+    /**
+     *  Returns true if the last populate of the container was served from a backend cache
+     *  instead of the disk, so the contents may be outdated. Call unsetPopulated() and
+     *  getContents() again to revalidate them.
+     */
+    bool isPopulatedFromCache() const;
+
     /**
      *  Unsets both the "populated with all" and "populated with directories" flags for this
      *  directory, which will cause getContents() to refresh the contents list from disk on
-     *  the next call.
+     *  the next call. This also makes the next populate bypass any backend caches.
+     *
+     *  With fCompare, the next populate also compares the objects that are awake already
+     *  with the disk instead of keeping them as they are, like the first populate does,
+     *  which finds files that have been modified in place.
      */
-    void unsetPopulated();
+    void unsetPopulated(bool fCompare = false);
 
     /**
      *  Returns the container's contents by copying them into the given list.
@@ -788,13 +1070,42 @@ public:
      *  To clear all "populated" flags and force a refresh from disk, call unsetPopulated()
      *  before calling this. For that case, you can pass in two FSVectors with pvFilesAdded
      *  and pvFilesRemoved so you can call notifiers after the refresh.
+     *
+     *  Such a refresh is cheap if the container was completely populated from disk before
+     *  and the backend supports FsImplBase::getContentsStamp(): if the stamp has not changed,
+     *  no entries have been added or removed, and the contents are returned without reading
+     *  the directory. Otherwise only the names are read, together with the inode numbers and
+     *  types that the backend gets with them for free, and only entries whose names were not
+     *  awake yet, or whose inode or type differs from the awake object's, are woken up with
+     *  their metadata. Either way, the objects that are kept are not compared by size and
+     *  timestamps, so changes to a file's contents in place are not noticed.
+     *
+     *  With cWorkerThreads > 1, for Get::ALL and Get::FOLDERS_ONLY, this enumerates the names
+     *  of the directory entries first and then spreads waking them up over that many threads,
+     *  including the calling one. This is only done for large directories, and the results are
+     *  the same as with one thread, except for the order of the added and removed lists.
+     *
+     *  If fFollowSymlinks is true, and always with Get::FOLDERS_ONLY (which needs to know which
+     *  symlinks point to directories), new symlinks are not followed one by one while the
+     *  directory is enumerated, but collected and followed afterwards on a small pool of
+     *  threads, independently of cWorkerThreads, since following is mostly waiting for I/O.
+     *  Symlinks with the same target path only look up that target once. Get::FIRST_FOLDER_ONLY
+     *  still follows symlinks as it goes so that it can stop at the first one to a directory.
+     *
+     *  If fnAdded is given, it gets called for every object that gets added to the contents
+     *  (the same ones that end up in pvFilesAdded), right after it was added and its symlink,
+     *  if any, was followed. This allows for showing results before the whole container has
+     *  been enumerated. fnAdded may get called on several threads, so it must be thread-safe;
+     *  it is never called with the container's contents lock held.
      */
     size_t getContents(FsVector &vFiles,
                        Get getContents,
                        FsVector *pvFilesAdded,
                        FsVector *pvFilesRemoved,
                        StopFlag *pStopFlag,
-                       bool fFollowSymlinks = false);       //!< in: whether to call follow() on each symlink
+                       bool fFollowSymlinks = false,        //!< in: whether to follow each new symlink
+                       uint cWorkerThreads = 1,             //!< in: no. of threads for waking up objects
+                       FnFsObjectAdded fnAdded = nullptr);  //!< in: called for every object added, or nullptr
 
     /**
      *  Creates a new physical directory in this container (physical directory or symlink
@@ -842,6 +1153,52 @@ public:
      */
     void notifyFileRenamed(PFsObject pFS, const std::string &strOldName, const std::string &strNewName) const;
 
+    /**
+     *  Notifies all monitors attached to *this that a file has been modified,
+     *  after revalidateEntry() has replaced it.
+     */
+    void notifyFileChanged(PFsObject pFS) const;
+
+    /**
+     *  Like notifyFileAdded() and notifyFileRemoved() for many files at once, which lets
+     *  the monitors batch their updates (see FsMonitorBase::onItemsAdded()). These do
+     *  nothing if the vector is empty.
+     */
+    void notifyFilesAdded(const FsVector &vFiles) const;
+    void notifyFilesRemoved(const FsVector &vFiles) const;
+
+    /**
+     *  Brings the entry with the given name in line with the disk after someone else has
+     *  created, deleted or modified it, as reported by a file-system watch. This wakes up
+     *  the entry again and compares it with the awake object of that name, if any:
+     *
+     *   -- If the entry is gone, or its type has changed, the old object is removed and
+     *      appended to vRemoved.
+     *
+     *   -- If a plain file has a different size, timestamp or owner, a new object replaces
+     *      the old one and is appended to vChanged. Directories and symlinks are kept since
+     *      they may have contents and monitors of their own.
+     *
+     *   -- A new entry is added and appended to vAdded if getContents() would have added
+     *      it, i.e. plain files only if the container is completely populated.
+     *
+     *  This does nothing if the object is unchanged, so it is harmless to call it for changes
+     *  that have been applied already (e.g. because this process made them). This does not
+     *  notify the monitors; call the notify methods with the results on the GUI thread.
+     */
+    void revalidateEntry(const std::string &strBasename,
+                         FsVector &vAdded,
+                         FsVector &vRemoved,
+                         FsVector &vChanged);
+
+    /**
+     *  Gives the awake object strOldName the name strNewName without touching the disk,
+     *  after someone else has renamed the entry. Returns the object, or nullptr if there
+     *  is no awake object of the old name or there is one of the new name already.
+     */
+    PFsObject renameEntry(const std::string &strOldName,
+                          const std::string &strNewName);
+
 
     /**************************************
      *
@@ -866,6 +1223,39 @@ protected:
      */
     void removeChild(ContentsLock &lock, PFsObject p);
 
+    PFsObject wakeUpEntry(const string &strThisPath,
+                          const string &strBasename,
+                          const FsDirEntryID &id,
+                          bool fIsLocal,
+                          bool fKeepAwake);
+
+    PFsObject mergeChild(ContentsLock &cLock,
+                         const string &strBasename,
+                         PFsObject pTemp,
+                         Get getContents,
+                         FsVector *pvFilesAdded,
+                         FsVector *pvFilesRemoved);
+
+    bool populateParallel(PFsDirEnumeratorBase pEnumerator,
+                          Get getContents,
+                          FsVector *pvFilesAdded,
+                          FsVector *pvFilesRemoved,
+                          StopFlag *pStopFlag,
+                          FsVector *pvSymlinks,
+                          uint cWorkerThreads,
+                          bool fKeepAwake,
+                          const FnFsObjectAdded &fnAdded);
+
+    static bool FollowSymlinks(const FsVector &vSymlinks,
+                               StopFlag *pStopFlag,
+                               const FnFsObjectAdded &fnAdded);
+
+    void touchLRU(bool fMoveToBack);
+
+    bool evictContents(FsVector &vEvicted);
+
+    static void EvictLRU();
+
     /**
      *  Debugging helper.
      */
@@ -971,6 +1361,7 @@ public:
 class FsSymlink : public FsObject, public FsContainer
 {
     friend class FsGioImpl;
+    friend class FsContainer;
 
     /**************************************
      *
@@ -990,7 +1381,7 @@ protected:
 
     FsSymlink(const string &strBasename,
               uint64_t uLastModified)
-        : FsObject(FSType::SYMLINK, strBasename, { 0, uLastModified, "", "" }),
+        : FsObject(FSType::SYMLINK, strBasename, { 0, uLastModified, 0, 0 }),
           FsContainer((FsObject&)*this),
           _state(State::NOT_FOLLOWED_YET)
     { }
@@ -1033,11 +1424,19 @@ protected:
     PFsObject       _pTarget;
     Mutex           _mutexState;
 
+    /**
+     *  Callback type for follow() to look up the target path of a symlink.
+     */
+    typedef std::function<PFsObject (const std::string &strTarget)> FnFindTarget;
+
     /**
      *  Atomically resolves the symlink and caches the result. This may need to
      *  do blocking disk I/O and may therefore not be quick.
+     *
+     *  The target is looked up with pfnFind if given, or with FsImplBase::findPath()
+     *  otherwise.
      */
-    State follow();
+    State follow(const FnFindTarget *pfnFind = nullptr);
 };
 
 
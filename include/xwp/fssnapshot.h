@@ -0,0 +1,169 @@
+/*
+ * libxwp -- generic helper routines for C++11. (C) 2015--2017 Baubadil GmbH.
+ *
+ * libxwp is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the libxwp main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#ifndef XWP_FSSNAPSHOT_H
+#define XWP_FSSNAPSHOT_H
+
+#include "xwp/fsmodel_base.h"
+
+struct stat;
+
+
+/***************************************************************************
+ *
+ *  FsSnapshotStamp
+ *
+ **************************************************************************/
+
+/**
+ *  Identifies one state of a directory on disk. Creating, deleting or renaming an
+ *  entry changes the directory's modification time, and the change time catches
+ *  the cases where someone has reset that with utimes() afterwards.
+ */
+struct FsSnapshotStamp
+{
+    uint64_t    uDevice = 0;
+    uint64_t    uInode = 0;
+    uint64_t    uModifiedNs = 0;
+    uint64_t    uChangedNs = 0;
+
+    static FsSnapshotStamp FromStat(const struct stat &st);
+
+    /**
+     *  Returns false if the directory has been modified so recently that it could be
+     *  modified again without its timestamps changing, since those come from a coarse
+     *  clock. Such a stamp must not be used to decide that the directory is unchanged
+     *  later.
+     */
+    bool isSettled() const;
+
+    /**
+     *  Returns a 64-bit hash of the stamp, which is never 0, for
+     *  FsImplBase::getContentsStamp().
+     */
+    uint64_t getHash() const;
+
+    bool operator==(const FsSnapshotStamp &o) const
+    {
+        return    (uDevice == o.uDevice)
+               && (uInode == o.uInode)
+               && (uModifiedNs == o.uModifiedNs)
+               && (uChangedNs == o.uChangedNs);
+    }
+
+    bool operator!=(const FsSnapshotStamp &o) const
+    {
+        return !(*this == o);
+    }
+};
+
+
+/***************************************************************************
+ *
+ *  FsSnapshot
+ *
+ **************************************************************************/
+
+class FsSnapshot;
+typedef std::shared_ptr<FsSnapshot> PFsSnapshot;
+
+/**
+ *  A snapshot of the contents of a local directory (names, types, sizes, modification
+ *  times and owners) in a small file in a cache directory, so that a directory that has
+ *  not changed since it was last populated can be shown without reading and stat'ing
+ *  all of its entries again.
+ *
+ *  Each snapshot records the FsSnapshotStamp of the directory at the time it was read,
+ *  and Open() only returns it if the directory still has the same stamp. Note that this
+ *  does not notice if a file in the directory has been modified in place, since that
+ *  does not touch the directory; callers should therefore revalidate the contents from
+ *  disk in the background after showing a snapshot.
+ *
+ *  Snapshots are only a cache: all errors are logged and otherwise ignored. Directories
+ *  with only a few entries get none, and once all snapshots together take up more than
+ *  64 MB, Write() deletes the least recently used ones.
+ */
+class FsSnapshot : public ProhibitCopy
+{
+public:
+    /**
+     *  One directory entry, as returned by getNext().
+     */
+    struct Entry
+    {
+        string          strName;
+        FSType          type;
+        uint64_t        cbSize;
+        uint64_t        uLastModified;
+        uint32_t        uid;
+        uint32_t        gid;
+    };
+
+    ~FsSnapshot();
+
+    /**
+     *  Enables snapshots and stores them in the given directory, which is created if
+     *  necessary. Until this has been called, Open() always returns nullptr and Write()
+     *  does nothing.
+     */
+    static void Init(const string &strDirectory);
+
+    static bool IsEnabled();
+
+    /**
+     *  Maps the snapshot for the directory with the given absolute path and returns it
+     *  if it exists and was made when the directory had the given stamp. Otherwise this
+     *  returns nullptr.
+     */
+    static PFsSnapshot Open(const string &strPath,
+                            const FsSnapshotStamp &stamp);
+
+    /**
+     *  Writes a new snapshot for the directory with the given absolute path, which had
+     *  the given stamp when vContents was read from it. This replaces the old snapshot
+     *  atomically, so concurrent Open() calls see either the old or the new one.
+     *
+     *  The caller must make sure that the directory's file system updates its
+     *  modification time reliably, or the snapshot could be used after it has become
+     *  outdated.
+     */
+    static void Write(const string &strPath,
+                      const FsSnapshotStamp &stamp,
+                      const FsVector &vContents);
+
+    size_t size() const
+    {
+        return _cEntries;
+    }
+
+    /**
+     *  Fills e with the next entry and returns true, or returns false after the last one.
+     */
+    bool getNext(Entry &e);
+
+private:
+    FsSnapshot(const char *pMap, size_t cbMap)
+        : _pMap(pMap),
+          _cbMap(cbMap)
+    { }
+
+    bool parse(const string &strPath,
+               const FsSnapshotStamp &stamp);
+
+    static string MakeFileName(const string &strPath);
+
+    const char      *_pMap;
+    size_t          _cbMap;
+    size_t          _ofsNext = 0;
+    size_t          _cEntries = 0;
+    size_t          _iNext = 0;
+};
+
+#endif // XWP_FSSNAPSHOT_H
@@ -0,0 +1,125 @@
+/*
+ * libxwp -- generic helper routines for C++11. (C) 2015--2017 Baubadil GmbH.
+ *
+ * libxwp is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the libxwp main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#ifndef XWP_SLAB_H
+#define XWP_SLAB_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "xwp/basetypes.h"
+
+namespace XWP
+{
+
+/***************************************************************************
+ *
+ *  SlabPool
+ *
+ **************************************************************************/
+
+/**
+ *  Returned by SlabPool::GetStats().
+ */
+struct SlabStats
+{
+    uint64_t    cSlabs = 0;             // Slabs allocated so far; they are never freed.
+    uint64_t    cbReserved = 0;         // Bytes in those slabs.
+    uint64_t    cRefills = 0;           // Batches that threads have taken from the global lists.
+    uint64_t    cLarge = 0;             // Requests that were too large and went to operator new.
+};
+
+/**
+ *  A pool for the many small, same-sized objects that the file-system model creates
+ *  when directories are populated (file-system objects with their shared_ptr control
+ *  blocks, container implementations, path caches).
+ *
+ *  Requests are rounded up to a multiple of 16 bytes, and each of those size classes
+ *  carves its blocks out of 64 KB slabs. Every thread keeps a small cache of free blocks
+ *  per size class and only goes to the global list of its size class, which has its own
+ *  mutex, for a whole batch of blocks at a time. Several populate threads therefore
+ *  neither hit malloc nor contend with each other for every single object.
+ *
+ *  Freed blocks go back to the cache of the freeing thread and are reused for objects of
+ *  the same size class, but slabs are never returned to the system. Requests larger than
+ *  SLAB_MAX_BLOCK bytes are passed on to operator new.
+ *
+ *  Use SlabAllocator with std::allocate_shared(), or Allocate() and Free() in a
+ *  class-specific operator new and operator delete.
+ */
+class SlabPool
+{
+public:
+    static const size_t SLAB_MAX_BLOCK = 1024;
+
+    /**
+     *  Returns a block of at least cb bytes, aligned to 16 bytes. Throws std::bad_alloc
+     *  if the system is out of memory.
+     */
+    static void* Allocate(size_t cb);
+
+    /**
+     *  Returns a block from Allocate() to the pool. cb must be the same size that was
+     *  passed to Allocate().
+     */
+    static void Free(void *p, size_t cb);
+
+    static SlabStats GetStats();
+};
+
+
+/***************************************************************************
+ *
+ *  SlabAllocator
+ *
+ **************************************************************************/
+
+/**
+ *  Standard allocator on top of SlabPool. All instances are interchangeable.
+ */
+template<class T>
+class SlabAllocator
+{
+public:
+    typedef T value_type;
+
+    SlabAllocator() = default;
+
+    template<class U>
+    SlabAllocator(const SlabAllocator<U>&)
+    { }
+
+    T* allocate(size_t c)
+    {
+        static_assert(alignof(T) <= 16, "SlabPool blocks are only aligned to 16 bytes");
+        return (T*)SlabPool::Allocate(c * sizeof(T));
+    }
+
+    void deallocate(T *p, size_t c)
+    {
+        SlabPool::Free(p, c * sizeof(T));
+    }
+};
+
+template<class T, class U>
+bool operator==(const SlabAllocator<T>&, const SlabAllocator<U>&)
+{
+    return true;
+}
+
+template<class T, class U>
+bool operator!=(const SlabAllocator<T>&, const SlabAllocator<U>&)
+{
+    return false;
+}
+
+} // namespace XWP
+
+#endif // XWP_SLAB_H
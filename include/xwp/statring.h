@@ -0,0 +1,108 @@
+/*
+ * libxwp -- generic helper routines for C++11. (C) 2015--2017 Baubadil GmbH.
+ *
+ * libxwp is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the libxwp main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#ifndef XWP_STATRING_H
+#define XWP_STATRING_H
+
+#include <functional>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "xwp/basetypes.h"
+
+namespace XWP
+{
+
+/***************************************************************************
+ *
+ *  StatxRing
+ *
+ **************************************************************************/
+
+/**
+ *  One entry for StatxRing::statAll(). The caller fills in strName; statAll()
+ *  fills in stx and sets rc to 0 on success or to an errno value otherwise.
+ *  uInode and uDirentType are not used by statAll(); they carry what the
+ *  directory listing said about the entry for callers that need it.
+ */
+struct StatxRequest
+{
+    string          strName;
+#ifdef STATX_TYPE
+    struct statx    stx;
+#endif
+    int             rc = 0;
+    uint64_t        uInode;
+    unsigned char   uDirentType;    // DT_* from the directory entry.
+
+    StatxRequest(const string &strName_,
+                 uint64_t uInode_ = 0,
+                 unsigned char uDirentType_ = 0)
+        : strName(strName_),
+          uInode(uInode_),
+          uDirentType(uDirentType_)
+    { }
+};
+typedef vector<StatxRequest> StatxRequestsVector;
+
+/**
+ *  Batched statx() through a Linux io_uring. Instead of stat'ing one directory
+ *  entry after the other with a blocking system call each, statAll() keeps up
+ *  to "queue depth" statx requests in flight at the same time, which lets the
+ *  kernel (and, more importantly, NFS servers and disks with cold caches)
+ *  work on many of them in parallel.
+ *
+ *  This talks to the kernel with the raw io_uring system calls so there is no
+ *  dependency on liburing. It is only compiled in if USE_IO_URING is defined
+ *  (see "configure --enable-io-uring"); otherwise, and if the running kernel
+ *  refuses to set up a ring (too old, or disabled by seccomp or sysctl) or
+ *  cannot do statx through it (before Linux 5.6), Create() returns nullptr
+ *  and the caller must stat sequentially.
+ *
+ *  An instance is not thread-safe; use one per thread.
+ */
+class StatxRing : public ProhibitCopy
+{
+public:
+    /**
+     *  Returns a new ring with the given queue depth, or nullptr if io_uring is not
+     *  available.
+     */
+    static std::shared_ptr<StatxRing> Create(uint uQueueDepth);
+
+    ~StatxRing();
+
+    /**
+     *  Stats all the names in v relative to the directory file descriptor fdDir
+     *  without following symlinks, and calls fnDone for each request as its
+     *  completion arrives, which is generally not in the order of v.
+     *
+     *  Throws FSException if the ring itself fails, after waiting for the requests
+     *  that the kernel has already taken; the ring is then shut down and every later
+     *  call throws as well. Errors for individual entries are reported in
+     *  StatxRequest::rc instead.
+     */
+    void statAll(int fdDir,
+                 StatxRequestsVector &v,
+                 std::function<void (StatxRequest&)> fnDone);
+
+private:
+    StatxRing();
+
+    struct Impl;
+    Impl    *_pImpl;
+};
+typedef std::shared_ptr<StatxRing> PStatxRing;
+
+} // namespace XWP
+
+#endif // XWP_STATRING_H
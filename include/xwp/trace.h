@@ -0,0 +1,126 @@
+/*
+ * libxwp -- generic helper routines for C++11. (C) 2015--2017 Baubadil GmbH.
+ *
+ * libxwp is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the libxwp main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#ifndef XWP_TRACE_H
+#define XWP_TRACE_H
+
+#include <cstdint>
+
+#include "xwp/basetypes.h"
+
+namespace XWP
+{
+
+extern bool g_fTraceEnabled;
+
+/***************************************************************************
+ *
+ *  TraceSink
+ *
+ **************************************************************************/
+
+/**
+ *  Records timed scopes and queue hand-offs of all threads and writes them as a Chrome
+ *  trace-event JSON file, which can be loaded into Perfetto (ui.perfetto.dev) or
+ *  chrome://tracing.
+ *
+ *  Every thread appends its events to its own buffer, which only that thread writes to,
+ *  so recording takes no locks. Write() collects the buffers of all threads, including
+ *  those of threads that are still running.
+ *
+ *  Debug scopes are recorded automatically while the sink is enabled, for every debug flag
+ *  that is compiled in, whether or not it is set in g_flDebugSet. TraceScope adds scopes
+ *  that only go to the trace. The WorkerInputQueue and WorkerResultQueue templates record
+ *  a flow from every post to the matching fetch, which Perfetto draws as an arrow between
+ *  the threads.
+ */
+class TraceSink
+{
+public:
+    /**
+     *  Enables tracing. The trace gets written to strFile when Write() is called. This must
+     *  be called before any other threads are started.
+     */
+    static void Init(const string &strFile);
+
+    static bool IsEnabled()
+    {
+        return g_fTraceEnabled;
+    }
+
+    /**
+     *  Writes all events that have been recorded so far to the file given to Init(). Does
+     *  nothing if tracing is not enabled.
+     */
+    static void Write();
+
+    /**
+     *  Names the calling thread in the trace.
+     */
+    static void SetThreadName(const string &strName);
+
+    static void Begin(const string &strName);
+    static void End();
+
+    /**
+     *  Records that the item with the given ID has been posted to (FlowOut) or fetched from
+     *  (FlowIn) the given queue on the calling thread. The ID must be the same for both;
+     *  see MakeFlowID().
+     */
+    static void FlowOut(const char *pcszQueue,
+                        uint64_t id);
+    static void FlowIn(const char *pcszQueue,
+                       uint64_t id);
+
+    static uint64_t MakeFlowID(const void *pQueue,
+                               const void *pItem)
+    {
+        return ((uint64_t)(uintptr_t)pQueue * 0x9E3779B97F4A7C15ull) ^ (uint64_t)(uintptr_t)pItem;
+    }
+};
+
+
+/***************************************************************************
+ *
+ *  TraceScope
+ *
+ **************************************************************************/
+
+/**
+ *  A scope that only gets recorded in the trace, for code whose timing matters but which
+ *  should not add "Entering" and "Leaving" lines to the debug log. Use the TRACE_SCOPE
+ *  macro so that the name only gets built when tracing is enabled.
+ */
+class TraceScope : public ProhibitCopy
+{
+public:
+    TraceScope(const string &strName)
+        : _fActive(TraceSink::IsEnabled())
+    {
+        if (_fActive)
+            TraceSink::Begin(strName);
+    }
+
+    ~TraceScope()
+    {
+        if (_fActive)
+            TraceSink::End();
+    }
+
+private:
+    bool _fActive;
+};
+
+} // namespace XWP
+
+#define TRACE_SCOPE(t, str)                                     \
+    XWP::TraceScope t(XWP::TraceSink::IsEnabled() ? string(str) : string())
+
+#endif // XWP_TRACE_H
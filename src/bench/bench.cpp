@@ -0,0 +1,737 @@
+/*
+ * elisso -- fast and friendly gtkmm file manager. (C) 2016--2017 Baubadil GmbH.
+ *
+ * elisso is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the elisso main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+/*
+ *  elisso-bench: times the file-system model and the thumbnailer without any windows, and
+ *  prints the results as JSON so that they can be compared between builds. Run
+ *  "elisso-bench --help" for the options.
+ *
+ *  The "model" suite, which is the default, generates synthetic trees in a temporary directory
+ *  and runs FsObject::FindPath(), FsContainer::getContents() in all three Get modes, refreshes
+ *  and symlink following over them. With io_uring support, getContents() is also timed
+ *  with and without the batched statx calls. Every tree is created right before it is
+ *  measured and removed right after, so that only one of them takes up disk space and memory
+ *  at a time, and no measurement profits from objects that an earlier one has woken up. All times are wall-clock times with whatever
+ *  the page cache holds after creating the tree, i.e. warm from the kernel's perspective.
+ */
+
+#define DEF_STRING_IMPLEMENTATION
+
+#include "bench.h"
+
+#include "elisso/fsmodel_posix.h"
+
+#include "xwp/debug.h"
+#include "xwp/except.h"
+#include "xwp/slab.h"
+#include "xwp/stringhelp.h"
+#include "xwp/thread.h"
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/***************************************************************************
+ *
+ *  Globals
+ *
+ **************************************************************************/
+
+BenchOptions g_opts;
+
+string g_strTemp;                           // The temporary directory with all the trees.
+
+vector<string> g_vResults;                  // One JSON object per measurement.
+
+string g_strSections;                       // From AddSection(), with leading commas.
+
+
+/***************************************************************************
+ *
+ *  Helpers
+ *
+ **************************************************************************/
+
+string
+MakeJSONString(const string &str)
+{
+    string strJSON = "\"";
+    for (unsigned char c : str)
+    {
+        if (c == '"')
+            strJSON += "\\\"";
+        else if (c == '\\')
+            strJSON += "\\\\";
+        else if (c < 0x20)
+        {
+            char sz[8];
+            snprintf(sz, sizeof(sz), "\\u%04x", c);
+            strJSON += sz;
+        }
+        else
+            strJSON += (char)c;
+    }
+    return strJSON + "\"";
+}
+
+/**
+ *  Records one measurement. strTest is what was timed, strTree which kind of tree it ran on,
+ *  cFiles the size parameter of that tree, strVariant distinguishes runs of the same test
+ *  (Get mode, cold or cached, thread count), and cItems is how many objects or calls the
+ *  time covers.
+ */
+void
+AddResult(const string &strTest,
+          const string &strTree,
+          uint64_t cFiles,
+          const string &strVariant,
+          double dMs,
+          uint64_t cItems)
+{
+    char szTime[80];
+    snprintf(szTime, sizeof(szTime), "\"ms\":%.3f,\"ns_per_item\":%.1f",
+             dMs,
+             (cItems) ? dMs * 1000000 / cItems : 0.0);
+    g_vResults.push_back(  "{\"test\":" + MakeJSONString(strTest)
+                         + ",\"tree\":" + MakeJSONString(strTree)
+                         + ",\"files\":" + to_string(cFiles)
+                         + ",\"variant\":" + MakeJSONString(strVariant)
+                         + "," + szTime
+                         + ",\"items\":" + to_string(cItems)
+                         + "}");
+    fprintf(stderr, "%s/%s/%llu/%s: %.3f ms\n",
+            strTest.c_str(),
+            strTree.c_str(),
+            (unsigned long long)cFiles,
+            strVariant.c_str(),
+            dMs);
+}
+
+void
+AddSection(const string &strKey,
+           const string &strJSON)
+{
+    g_strSections += ",\n" + MakeJSONString(strKey) + ":" + strJSON;
+}
+
+static string
+MakeName(const char *pcszPrefix,
+         uint u,
+         uint cDigits = 7)
+{
+    char sz[40];
+    snprintf(sz, sizeof(sz), "%s%0*u", pcszPrefix, (int)cDigits, u);
+    return sz;
+}
+
+void
+MakeDir(const string &strPath)
+{
+    if (mkdir(strPath.c_str(), 0755))
+        throw FSException("Cannot create directory " + quote(strPath) + ": " + strerror(errno));
+}
+
+static void
+MakeFile(const string &strPath)
+{
+    int fd = open(strPath.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+    if (fd == -1)
+        throw FSException("Cannot create file " + quote(strPath) + ": " + strerror(errno));
+    close(fd);
+}
+
+static void
+MakeSymlink(const string &strTarget,
+            const string &strPath)
+{
+    if (symlink(strTarget.c_str(), strPath.c_str()))
+        throw FSException("Cannot create symlink " + quote(strPath) + ": " + strerror(errno));
+}
+
+static int
+RemoveOne(const char *pcszPath,
+          const struct stat *,
+          int,
+          struct FTW *)
+{
+    return remove(pcszPath) ? errno : 0;
+}
+
+bool
+RemoveTree(const string &strPath)
+{
+    // The casts keep the FlagSet operator| out of this.
+    return !nftw(strPath.c_str(), RemoveOne, 64, (int)FTW_DEPTH | (int)FTW_PHYS);
+}
+
+/**
+ *  Removes a tree from disk and then refreshes the temporary directory so that the objects
+ *  of the tree are released as well.
+ */
+static void
+DropTree(const string &strPath)
+{
+    if (!RemoveTree(strPath))
+        throw FSException("Cannot remove " + quote(strPath) + ": " + strerror(errno));
+
+    auto pTemp = FsObject::FindDirectory(g_strTemp);
+    if (!pTemp)
+        throw FSException("Cannot find " + quote(g_strTemp));
+    FsVector vFiles, vAdded, vRemoved;
+    pTemp->unsetPopulated();
+    pTemp->getContents(vFiles, FsDirectory::Get::ALL, &vAdded, &vRemoved, nullptr);
+}
+
+static PFsDirectory
+FindDirectoryOrThrow(const string &strPath)
+{
+    auto pDir = FsObject::FindDirectory(strPath);
+    if (!pDir)
+        throw FSException("Cannot find directory " + quote(strPath));
+    return pDir;
+}
+
+/**
+ *  Creates a directory with cFiles empty files and one subdirectory per 100 files, which
+ *  gives FOLDERS_ONLY and FIRST_FOLDER_ONLY something to find.
+ */
+static void
+MakeFlatTree(const string &strPath,
+             uint cFiles)
+{
+    MakeDir(strPath);
+    for (uint u = 0; u < cFiles; ++u)
+        MakeFile(strPath + "/" + MakeName("file", u) + ".txt");
+    for (uint u = 0; u < cFiles / 100; ++u)
+        MakeDir(strPath + "/" + MakeName("zdir", u));
+}
+
+/**
+ *  Creates strPath/targets with cLinks / 2 files and cLinks / 4 directories and strPath/links
+ *  with cLinks relative symlinks. With fBroken, all symlinks point to targets that do not
+ *  exist; otherwise half of them point to the files, a quarter to the directories and the
+ *  rest nowhere.
+ */
+static void
+MakeSymlinkTree(const string &strPath,
+                uint cLinks,
+                bool fBroken)
+{
+    MakeDir(strPath);
+    string strTargets = strPath + "/targets";
+    string strLinks = strPath + "/links";
+    MakeDir(strTargets);
+    MakeDir(strLinks);
+    for (uint u = 0; u < cLinks; ++u)
+    {
+        string strTarget;
+        if (fBroken || (u % 4 == 3))
+            strTarget = MakeName("missing", u);
+        else if (u % 2 == 0)
+        {
+            strTarget = MakeName("file", u);
+            MakeFile(strTargets + "/" + strTarget);
+        }
+        else
+        {
+            strTarget = MakeName("dir", u);
+            MakeDir(strTargets + "/" + strTarget);
+        }
+        MakeSymlink("../targets/" + strTarget, strLinks + "/" + MakeName("link", u));
+    }
+}
+
+
+/***************************************************************************
+ *
+ *  Benchmarks
+ *
+ **************************************************************************/
+
+static const char* GetModeName(FsDirectory::Get mode)
+{
+    switch (mode)
+    {
+        case FsDirectory::Get::ALL:                 return "all";
+        case FsDirectory::Get::FOLDERS_ONLY:        return "folders_only";
+        case FsDirectory::Get::FIRST_FOLDER_ONLY:   return "first_folder_only";
+    }
+    return "";
+}
+
+/**
+ *  Populates a fresh flat tree in the given mode. For Get::ALL, this then times a second
+ *  getContents() from memory, refreshes with and without changes on disk, cached FindPath()
+ *  lookups and the flag tests. For the other modes, whose files are still asleep afterwards,
+ *  it times cold FindPath() lookups, which have to find every file on disk.
+ */
+static void
+BenchFlat(uint cFiles,
+          FsDirectory::Get mode)
+{
+    string strTree = g_strTemp + "/flat-" + GetModeName(mode);
+    MakeFlatTree(strTree, cFiles);
+    uint cDirs = cFiles / 100;
+
+    {
+        auto pDir = FindDirectoryOrThrow(strTree);
+        FsVector vFiles;
+        {
+            Stopwatch sw;
+            pDir->getContents(vFiles, mode, nullptr, nullptr, nullptr, false, g_opts.cWorkers);
+            AddResult("getContents", "flat", cFiles, GetModeName(mode), sw.getMs(), vFiles.size());
+        }
+
+        if (mode != FsDirectory::Get::ALL)
+        {
+            // Every 10th file so that 1M-file trees take seconds, not minutes.
+            uint c = 0;
+            Stopwatch sw;
+            for (uint u = 0; u < cFiles; u += 10, ++c)
+                if (!FsObject::FindPath(strTree + "/" + MakeName("file", u) + ".txt"))
+                    throw FSException("FindPath failed");
+            AddResult("FindPath", "flat", cFiles, string("cold_after_") + GetModeName(mode), sw.getMs(), c);
+        }
+        else
+        {
+            {
+                FsVector vFiles2;
+                Stopwatch sw;
+                pDir->getContents(vFiles2, mode, nullptr, nullptr, nullptr, false, g_opts.cWorkers);
+                AddResult("getContents", "flat", cFiles, "all_cached", sw.getMs(), vFiles2.size());
+            }
+
+            {
+                FsVector vFiles2, vAdded, vRemoved;
+                Stopwatch sw;
+                pDir->unsetPopulated();
+                pDir->getContents(vFiles2, mode, &vAdded, &vRemoved, nullptr, false, g_opts.cWorkers);
+                AddResult("refresh", "flat", cFiles, "unchanged", sw.getMs(), vFiles2.size());
+            }
+
+            {
+                FsVector vFiles2, vAdded, vRemoved;
+                Stopwatch sw;
+                pDir->unsetPopulated(true);
+                pDir->getContents(vFiles2, mode, &vAdded, &vRemoved, nullptr, false, g_opts.cWorkers);
+                AddResult("refresh", "flat", cFiles, "compare", sw.getMs(), vFiles2.size());
+            }
+
+            {
+                // Replace 1% of the files; the old objects are in vFiles, so removing them
+                // only takes them out of the container.
+                for (uint u = 0; u < cFiles; u += 100)
+                {
+                    string strFile = strTree + "/" + MakeName("file", u) + ".txt";
+                    if (unlink(strFile.c_str()))
+                        throw FSException("Cannot remove " + quote(strFile) + ": " + strerror(errno));
+                    MakeFile(strTree + "/" + MakeName("new", u) + ".txt");
+                }
+
+                FsVector vFiles2, vAdded, vRemoved;
+                Stopwatch sw;
+                pDir->unsetPopulated();
+                pDir->getContents(vFiles2, mode, &vAdded, &vRemoved, nullptr, false, g_opts.cWorkers);
+                AddResult("refresh", "flat", cFiles, "one_percent_changed", sw.getMs(), vAdded.size() + vRemoved.size());
+            }
+
+            {
+                uint c = 0;
+                Stopwatch sw;
+                for (uint u = 1; u < cFiles; u += 10, ++c)
+                    if (!FsObject::FindPath(strTree + "/" + MakeName("file", u) + ".txt"))
+                        throw FSException("FindPath failed");
+                AddResult("FindPath", "flat", cFiles, "awake", sw.getMs(), c);
+            }
+
+            // isHidden() and getResolvedType() on all objects from several threads, which
+            // used to serialize on FsLock.
+            for (uint cThreads : g_opts.vThreads)
+            {
+                const uint cRounds = 10;
+                std::atomic<uint64_t> cDirsFound(0);
+                Stopwatch sw;
+                vector<std::thread> vThreads;
+                for (uint t = 0; t < cThreads; ++t)
+                    vThreads.push_back(std::thread([&vFiles, &cDirsFound, cRounds]()
+                    {
+                        uint64_t c = 0;
+                        for (uint r = 0; r < cRounds; ++r)
+                            for (auto &pFS : vFiles)
+                                if (    (!pFS->isHidden())
+                                     && (pFS->getResolvedType() == FSTypeResolved::DIRECTORY)
+                                   )
+                                    ++c;
+                        cDirsFound += c;
+                    }));
+                for (auto &th : vThreads)
+                    th.join();
+                if (cDirsFound != (uint64_t)cThreads * cRounds * cDirs)
+                    throw FSException("flag test found " + to_string(cDirsFound) + " directories");
+                AddResult("flags", "flat", cFiles, "threads_" + to_string(cThreads), sw.getMs(), (uint64_t)cThreads * cRounds * vFiles.size());
+            }
+        }
+
+        if (    (mode == FsDirectory::Get::FOLDERS_ONLY)
+             && (vFiles.size() != cDirs)
+           )
+            throw FSException("FOLDERS_ONLY returned " + to_string(vFiles.size()) + " objects instead of " + to_string(cDirs));
+    }
+
+    DropTree(strTree);
+}
+
+/**
+ *  Populates two fresh flat trees with Get::ALL, once with the statx calls batched through
+ *  io_uring at the queue depth from FsPosixImpl::Init() and once stat'ing one entry after
+ *  the other, so that the two can be compared on the file system under --dir (tmpfs, ext4,
+ *  NFS...). Both run without worker threads regardless of --workers, since the workers
+ *  stat the entries themselves and never use the ring. Does nothing with --gio or if elisso was built without io_uring support or
+ *  ELISSO_STATX_QUEUE_DEPTH=0.
+ */
+static void
+BenchStatx(uint cFiles)
+{
+    uint uDepth = FsPosixImpl::GetStatxQueueDepth();
+    if (    (g_opts.fGio)
+         || (!uDepth)
+       )
+        return;
+
+    struct Variant
+    {
+        const char  *pcszName;
+        uint        uDepth;
+    };
+    const Variant aVariants[] =
+    {
+        { "all_statx_ring", uDepth },
+        { "all_sequential", 0 },
+    };
+
+    for (auto &v : aVariants)
+    {
+        string strTree = g_strTemp + "/flat-" + v.pcszName;
+        MakeFlatTree(strTree, cFiles);
+
+        FsPosixImpl::SetStatxQueueDepth(v.uDepth);
+        try
+        {
+            auto pDir = FindDirectoryOrThrow(strTree);
+            FsVector vFiles;
+            Stopwatch sw;
+            pDir->getContents(vFiles, FsDirectory::Get::ALL, nullptr, nullptr, nullptr, false, 1);
+            AddResult("getContents", "flat", cFiles, v.pcszName, sw.getMs(), vFiles.size());
+        }
+        catch (...)
+        {
+            FsPosixImpl::SetStatxQueueDepth(uDepth);
+            throw;
+        }
+        FsPosixImpl::SetStatxQueueDepth(uDepth);
+
+        DropTree(strTree);
+    }
+}
+
+/**
+ *  Looks up the file at the bottom of a chain of cDepth directories, first cold, which wakes
+ *  up every directory on the way, and then repeatedly from the path cache.
+ */
+static void
+BenchDeep(uint cDepth)
+{
+    string strTree = g_strTemp + "/deep";
+    MakeDir(strTree);
+    string strPath = strTree;
+    for (uint u = 0; u < cDepth; ++u)
+    {
+        strPath += "/" + MakeName("level", u, 3);
+        MakeDir(strPath);
+    }
+    strPath += "/file.txt";
+    MakeFile(strPath);
+
+    {
+        Stopwatch sw;
+        if (!FsObject::FindPath(strPath))
+            throw FSException("FindPath failed");
+        AddResult("FindPath", "deep", cDepth, "cold", sw.getMs(), 1);
+    }
+
+    {
+        Stopwatch sw;
+        for (uint u = 0; u < g_opts.cLookups; ++u)
+            if (!FsObject::FindPath(strPath))
+                throw FSException("FindPath failed");
+        AddResult("FindPath", "deep", cDepth, "cached", sw.getMs(), g_opts.cLookups);
+    }
+
+    {
+        // Wake up every level's contents from the top, like expanding the folder tree.
+        uint c = 0;
+        Stopwatch sw;
+        auto pDir = FindDirectoryOrThrow(strTree);
+        while (pDir)
+        {
+            FsVector vFiles;
+            pDir->getContents(vFiles, FsDirectory::Get::FOLDERS_ONLY, nullptr, nullptr, nullptr);
+            ++c;
+            pDir = (vFiles.size() == 1) ? dynamic_pointer_cast<FsDirectory>(vFiles[0]) : nullptr;
+        }
+        AddResult("getContents", "deep", cDepth, "folders_only_per_level", sw.getMs(), c);
+    }
+
+    DropTree(strTree);
+}
+
+/**
+ *  Times following the symlinks of a fresh tree after a populate without following, and
+ *  a populate of another fresh tree that follows them in its batch.
+ */
+static void
+BenchSymlinks(uint cLinks,
+              bool fBroken)
+{
+    const char *pcszTree = (fBroken) ? "broken_links" : "symlinks";
+    string strTree = g_strTemp + "/" + pcszTree;
+
+    MakeSymlinkTree(strTree, cLinks, fBroken);
+    {
+        auto pDir = FindDirectoryOrThrow(strTree + "/links");
+        FsVector vFiles;
+        {
+            Stopwatch sw;
+            pDir->getContents(vFiles, FsDirectory::Get::ALL, nullptr, nullptr, nullptr, false, g_opts.cWorkers);
+            AddResult("getContents", pcszTree, cLinks, "all", sw.getMs(), vFiles.size());
+        }
+
+        uint cBroken = 0;
+        Stopwatch sw;
+        // getResolvedType() follows a symlink the first time it is called.
+        for (auto &pFS : vFiles)
+            if (pFS->getResolvedType() == FSTypeResolved::BROKEN_SYMLINK)
+                ++cBroken;
+        AddResult("follow", pcszTree, cLinks, "one_by_one", sw.getMs(), vFiles.size());
+
+        if (cBroken != ((fBroken) ? cLinks : cLinks / 4))
+            throw FSException(to_string(cBroken) + " broken symlinks found in " + quote(strTree));
+    }
+    DropTree(strTree);
+
+    MakeSymlinkTree(strTree, cLinks, fBroken);
+    {
+        auto pDir = FindDirectoryOrThrow(strTree + "/links");
+        FsVector vFiles;
+        Stopwatch sw;
+        pDir->getContents(vFiles, FsDirectory::Get::ALL, nullptr, nullptr, nullptr, true, g_opts.cWorkers);
+        AddResult("getContents", pcszTree, cLinks, "all_follow", sw.getMs(), vFiles.size());
+    }
+    DropTree(strTree);
+}
+
+static void
+WriteResults()
+{
+    FsCacheStats cache = FsContainer::GetCacheStats();
+    SlabStats slab = SlabPool::GetStats();
+
+    string strJSON =   "{\"benchmark\":\"elisso-bench\""
+                     ",\"backend\":" + MakeJSONString((g_opts.fGio) ? "gio" : "posix")
+                     + ",\"workers\":" + to_string(g_opts.cWorkers)
+                     + ",\"results\":[\n"
+                     + implode(",\n", g_vResults)
+                     + "\n],\"slab\":{\"slabs\":" + to_string(slab.cSlabs)
+                     + ",\"bytes_reserved\":" + to_string(slab.cbReserved)
+                     + ",\"refills\":" + to_string(slab.cRefills)
+                     + ",\"large\":" + to_string(slab.cLarge)
+                     + "},\"cache\":{\"objects_awake\":" + to_string(cache.cObjectsAwake)
+                     + ",\"eviction_runs\":" + to_string(cache.cEvictionRuns)
+                     + ",\"objects_evicted\":" + to_string(cache.cObjectsEvicted)
+                     + "}"
+                     + g_strSections
+                     + "}\n";
+
+    FILE *pFile = stdout;
+    if (    (!g_opts.strOutput.empty())
+         && (!(pFile = fopen(g_opts.strOutput.c_str(), "w")))
+       )
+        throw FSException("Cannot write to " + quote(g_opts.strOutput) + ": " + strerror(errno));
+    fputs(strJSON.c_str(), pFile);
+    if (pFile != stdout)
+        fclose(pFile);
+}
+
+
+/***************************************************************************
+ *
+ *  Entry point
+ *
+ **************************************************************************/
+
+static vector<uint>
+ParseList(const string &str)
+{
+    vector<uint> v;
+    for (auto &strItem : explodeVector(str, ","))
+        v.push_back(stoul(strItem));
+    return v;
+}
+
+static void
+Usage()
+{
+    fprintf(stderr,
+            "elisso-bench: times the file-system model and the thumbnailer and prints JSON.\n"
+            "Options:\n"
+            "  --suite=S,...     run the \"model\" and/or \"thumbnailer\" suites (default: model)\n"
+            "  --dir=PATH        create the temporary files under PATH (default: $TMPDIR or /tmp)\n"
+            "  --output=FILE     write the JSON to FILE instead of stdout\n"
+            "Model suite:\n"
+            "  --sizes=N,...     files in the flat trees (default: 10000,100000,1000000)\n"
+            "  --depth=N         directories in the deep tree (default: 256)\n"
+            "  --links=N         symlinks in the symlink trees (default: 10000)\n"
+            "  --lookups=N       repetitions of cached lookups (default: 100000)\n"
+            "  --threads=N,...   thread counts for the flag tests (default: 1,2,4,8,16)\n"
+            "  --workers=N       worker threads for getContents() (default: all cores)\n"
+            "  --gio             use the Gio backend for local files instead of the POSIX one\n"
+            "Thumbnailer suite:\n"
+            "  --images=N        images per format and resolution (default: 10)\n"
+            "  --resolutions=W,...  image widths, heights are 3/4 of them (default: 640,1920,4000)\n"
+            "  --loaders=N,...   pixbuf loader thread counts (default: 1, 2, 4... up to the number\n"
+            "                    of hardware threads, and the thumbnailer's own default)\n"
+            "Snapshots, inotify watches and eviction are off unless ELISSO_SNAPSHOTS,\n"
+            "ELISSO_WATCH or ELISSO_CACHE_MB say otherwise. With io_uring support, the\n"
+            "\"all_statx_ring\" and \"all_sequential\" results compare batched statx calls\n"
+            "(ELISSO_STATX_QUEUE_DEPTH, default 64) with sequential ones on the --dir file system.\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_flDebugSet = 0;
+
+    const char *pcsz;
+    g_opts.strBase = ((pcsz = getenv("TMPDIR")) && (*pcsz)) ? pcsz : "/tmp";
+    uint cCores = XWP::Thread::getHardwareConcurrency();
+    g_opts.cWorkers = (cCores) ? cCores : 1;
+
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            string strArg(argv[i]);
+            if (startsWith(strArg, "--suite="))
+            {
+                StringSet setSuites = explodeSet(strArg.substr(8), ",");
+                g_opts.fModel = STL_EXISTS(setSuites, "model");
+                g_opts.fThumbnailer = STL_EXISTS(setSuites, "thumbnailer");
+                if (setSuites.size() != (size_t)g_opts.fModel + g_opts.fThumbnailer)
+                    throw std::invalid_argument("unknown suite");
+            }
+            else if (startsWith(strArg, "--dir="))
+                g_opts.strBase = strArg.substr(6);
+            else if (startsWith(strArg, "--sizes="))
+                g_opts.vSizes = ParseList(strArg.substr(8));
+            else if (startsWith(strArg, "--depth="))
+                g_opts.cDepth = stoul(strArg.substr(8));
+            else if (startsWith(strArg, "--links="))
+                g_opts.cLinks = stoul(strArg.substr(8));
+            else if (startsWith(strArg, "--lookups="))
+                g_opts.cLookups = stoul(strArg.substr(10));
+            else if (startsWith(strArg, "--threads="))
+                g_opts.vThreads = ParseList(strArg.substr(10));
+            else if (startsWith(strArg, "--workers="))
+                g_opts.cWorkers = stoul(strArg.substr(10));
+            else if (strArg == "--gio")
+                g_opts.fGio = true;
+            else if (startsWith(strArg, "--images="))
+                g_opts.cImages = stoul(strArg.substr(9));
+            else if (startsWith(strArg, "--resolutions="))
+                g_opts.vResolutions = ParseList(strArg.substr(14));
+            else if (startsWith(strArg, "--loaders="))
+                g_opts.vLoaders = ParseList(strArg.substr(10));
+            else if (startsWith(strArg, "--output="))
+                g_opts.strOutput = strArg.substr(9);
+            else
+            {
+                Usage();
+                return (strArg == "--help" || strArg == "-h") ? 0 : 2;
+            }
+        }
+    }
+    catch (std::logic_error &)
+    {
+        Usage();
+        return 2;
+    }
+
+    // Measure the model and the disk, not the caches above it, unless asked to.
+    setenv("ELISSO_SNAPSHOTS", "0", 0);
+    setenv("ELISSO_WATCH", "0", 0);
+    setenv("ELISSO_CACHE_MB", "0", 0);
+
+    Gio::init();
+    if (g_opts.fGio)
+        FsGioImpl::Init();
+    else
+        FsPosixImpl::Init();
+
+    int rc = 0;
+    char szTemp[PATH_MAX];
+    snprintf(szTemp, sizeof(szTemp), "%s/elisso-bench.XXXXXX", g_opts.strBase.c_str());
+    if (!mkdtemp(szTemp))
+    {
+        fprintf(stderr, "elisso-bench: cannot create temporary directory under %s: %s\n",
+                g_opts.strBase.c_str(),
+                strerror(errno));
+        return 1;
+    }
+    g_strTemp = szTemp;
+
+    try
+    {
+        if (g_opts.fModel)
+        {
+            for (uint cFiles : g_opts.vSizes)
+            {
+                BenchFlat(cFiles, FsDirectory::Get::ALL);
+                BenchFlat(cFiles, FsDirectory::Get::FOLDERS_ONLY);
+                BenchFlat(cFiles, FsDirectory::Get::FIRST_FOLDER_ONLY);
+                BenchStatx(cFiles);
+            }
+            BenchDeep(g_opts.cDepth);
+            BenchSymlinks(g_opts.cLinks, false);
+            BenchSymlinks(g_opts.cLinks, true);
+        }
+
+        if (g_opts.fThumbnailer)
+            BenchThumbnailer();
+
+        WriteResults();
+    }
+    catch (std::exception &e)
+    {
+        fprintf(stderr, "elisso-bench: %s\n", e.what());
+        rc = 1;
+    }
+
+    RemoveTree(g_strTemp);
+
+    return rc;
+}
@@ -0,0 +1,88 @@
+/*
+ * elisso -- fast and friendly gtkmm file manager. (C) 2016--2017 Baubadil GmbH.
+ *
+ * elisso is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the elisso main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#ifndef ELISSO_BENCH_H
+#define ELISSO_BENCH_H
+
+#include "xwp/basetypes.h"
+
+#include <chrono>
+#include <vector>
+
+/*
+ *  Shared between the suites of elisso-bench; see bench.cpp.
+ */
+
+struct BenchOptions
+{
+    string          strBase;                // Parent of the temporary directory.
+    bool            fModel = true;          // Run the file-system model suite.
+    bool            fThumbnailer = false;   // Run the thumbnailer suite.
+
+    // File-system model suite.
+    vector<uint>    vSizes = { 10000, 100000, 1000000 };
+    uint            cDepth = 256;
+    uint            cLinks = 10000;
+    uint            cLookups = 100000;      // Repetitions for the cached FindPath() timings.
+    vector<uint>    vThreads = { 1, 2, 4, 8, 16 };
+    uint            cWorkers = 1;           // Passed to getContents().
+    bool            fGio = false;
+
+    // Thumbnailer suite.
+    uint            cImages = 10;           // Per format and resolution.
+    vector<uint>    vResolutions = { 640, 1920, 4000 };     // Widths; heights are 3/4 of them.
+    vector<uint>    vLoaders;               // Pixbuf loader thread counts; empty means a default sweep.
+
+    string          strOutput;
+};
+
+extern BenchOptions g_opts;
+
+extern string g_strTemp;
+
+class Stopwatch
+{
+public:
+    Stopwatch()
+        : _t(std::chrono::steady_clock::now())
+    { }
+
+    double getMs() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _t).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point _t;
+};
+
+string MakeJSONString(const string &str);
+
+void AddResult(const string &strTest,
+               const string &strTree,
+               uint64_t cFiles,
+               const string &strVariant,
+               double dMs,
+               uint64_t cItems);
+
+/**
+ *  Adds a top-level member to the JSON output, for results that do not fit AddResult().
+ *  strJSON must be a complete JSON value.
+ */
+void AddSection(const string &strKey,
+                const string &strJSON);
+
+void MakeDir(const string &strPath);
+
+bool RemoveTree(const string &strPath);
+
+void BenchThumbnailer();
+
+#endif // ELISSO_BENCH_H
@@ -0,0 +1,432 @@
+/*
+ * elisso -- fast and friendly gtkmm file manager. (C) 2016--2017 Baubadil GmbH.
+ *
+ * elisso is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the elisso main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+/*
+ *  The "thumbnailer" suite of elisso-bench. This writes a set of JPEG, PNG and WebP images
+ *  at several resolutions, then runs a Thumbnailer over all of them once for every pixbuf
+ *  loader thread count, with a Glib main loop standing in for the GUI thread. For every
+ *  run, it reports images per second, the latencies of the stages from the ThumbnailTimes
+ *  of every thumbnail, the queue depths sampled every 10 ms, and the peak RSS.
+ */
+
+#include "bench.h"
+
+#include "elisso/thumbnailer.h"
+
+#include "xwp/except.h"
+#include "xwp/stringhelp.h"
+#include "xwp/thread.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <set>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/***************************************************************************
+ *
+ *  Globals
+ *
+ **************************************************************************/
+
+#define SAMPLE_INTERVAL_MS      10
+#define STALL_TIMEOUT_S         60
+
+struct ImageFormat
+{
+    const char  *pcszName;          // For gdk-pixbuf.
+    const char  *pcszExtension;     // For ContentType::IsImageFile().
+};
+
+const ImageFormat g_aFormats[] =
+{
+    { "jpeg", "jpg" },
+    { "png",  "png" },
+    { "webp", "webp" },
+};
+
+/**
+ *  One sample of Thumbnailer::getQueueDepths().
+ */
+struct DepthSample
+{
+    double                  dMs;
+    ThumbnailerQueueDepths  depths;
+};
+
+
+/***************************************************************************
+ *
+ *  Helpers
+ *
+ **************************************************************************/
+
+/**
+ *  Fills the pixbuf with gradients and some noise so that the encoders have about as much
+ *  work as with a photo, and the decoders too.
+ */
+static void
+Paint(PPixbuf ppb,
+      uint32_t uSeed)
+{
+    uint cx = ppb->get_width(),
+         cy = ppb->get_height(),
+         cbRow = ppb->get_rowstride();
+    guint8 *pbPixels = ppb->get_pixels();
+    uint32_t u = uSeed | 1;
+    for (uint y = 0; y < cy; ++y)
+    {
+        guint8 *pb = pbPixels + y * cbRow;
+        for (uint x = 0; x < cx; ++x)
+        {
+            // xorshift32
+            u ^= u << 13;
+            u ^= u >> 17;
+            u ^= u << 5;
+            *pb++ = (guint8)(x * 255 / cx + (u & 0x0f));
+            *pb++ = (guint8)(y * 255 / cy + ((u >> 4) & 0x0f));
+            *pb++ = (guint8)((x + y + uSeed * 37) + ((u >> 8) & 0x0f));
+        }
+    }
+}
+
+/**
+ *  Writes g_opts.cImages images for every resolution and every format that gdk-pixbuf can
+ *  write here into strDir and returns them as file-system objects. vFormats receives the
+ *  names of the formats that were used.
+ */
+static vector<PFsGioFile>
+MakeCorpus(const string &strDir,
+           StringVector &vFormats,
+           uint64_t &cbTotal)
+{
+    StringSet setWritable;
+    for (auto &fmt : Gdk::Pixbuf::get_formats())
+        if (fmt.is_writable())
+            setWritable.insert(fmt.get_name());
+
+    vector<const ImageFormat*> vUse;
+    for (auto &fmt : g_aFormats)
+        if (STL_EXISTS(setWritable, fmt.pcszName))
+        {
+            vUse.push_back(&fmt);
+            vFormats.push_back(fmt.pcszName);
+        }
+        else
+            // WebP needs the webp-pixbuf-loader.
+            fprintf(stderr, "elisso-bench: gdk-pixbuf cannot write %s images, leaving them out\n", fmt.pcszName);
+
+    MakeDir(strDir);
+    vector<PFsGioFile> vFiles;
+    cbTotal = 0;
+    for (uint cx : g_opts.vResolutions)
+    {
+        uint cy = cx * 3 / 4;
+        auto ppb = Gdk::Pixbuf::create(Gdk::COLORSPACE_RGB, false, 8, cx, cy);
+        for (auto pFormat : vUse)
+            for (uint u = 0; u < g_opts.cImages; ++u)
+            {
+                Paint(ppb, u);
+                string strPath = strDir + "/" + to_string(cx) + "x" + to_string(cy) + "-" + to_string(u) + "." + pFormat->pcszExtension;
+                ppb->save(strPath, pFormat->pcszName);
+
+                auto pFile = dynamic_pointer_cast<FsGioFile>(FsObject::FindPath(strPath));
+                if (!pFile)
+                    throw FSException("Cannot find " + quote(strPath));
+                cbTotal += pFile->getFileSize();
+                vFiles.push_back(pFile);
+            }
+    }
+
+    return vFiles;
+}
+
+/**
+ *  Resets the peak RSS of the process if the kernel supports that (Linux 4.0 and later).
+ */
+static bool
+ResetPeakRSS()
+{
+    int fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    bool fOK = (write(fd, "5", 1) == 1);
+    close(fd);
+    return fOK;
+}
+
+/**
+ *  Returns the peak RSS of the process in KB, or 0 if it cannot be determined.
+ */
+static uint64_t
+GetPeakRSS()
+{
+    uint64_t cKB = 0;
+    FILE *pFile;
+    if ((pFile = fopen("/proc/self/status", "r")))
+    {
+        char szLine[256];
+        while (fgets(szLine, sizeof(szLine), pFile))
+            if (!strncmp(szLine, "VmHWM:", 6))
+            {
+                cKB = strtoull(szLine + 6, nullptr, 10);
+                break;
+            }
+        fclose(pFile);
+    }
+    return cKB;
+}
+
+static double
+GetMs(const ThumbnailTimes::TimePoint &t1,
+      const ThumbnailTimes::TimePoint &t2)
+{
+    return std::chrono::duration<double, std::milli>(t2 - t1).count();
+}
+
+static string
+FormatMs(double d)
+{
+    char sz[40];
+    snprintf(sz, sizeof(sz), "%.3f", d);
+    return sz;
+}
+
+/**
+ *  Returns count, mean, percentiles and a histogram of the given latencies as a JSON object.
+ *  The histogram buckets double in size from 1/16 ms; each is given as its upper bound and
+ *  its count, and empty ones are left out.
+ */
+static string
+MakeLatencyJSON(vector<double> &v)
+{
+    if (v.empty())
+        return "{\"count\":0}";
+
+    std::sort(v.begin(), v.end());
+    double dSum = 0;
+    for (double d : v)
+        dSum += d;
+    auto Percentile = [&v](double dFraction) -> double
+    {
+        return v[std::min(v.size() - 1, (size_t)(dFraction * v.size()))];
+    };
+
+    string strBuckets;
+    double dBound = 1.0 / 16;
+    size_t i = 0;
+    while (i < v.size())
+    {
+        size_t c = 0;
+        while (    (i < v.size())
+                && (v[i] <= dBound)
+              )
+        {
+            ++c;
+            ++i;
+        }
+        if (c)
+            strBuckets += string((strBuckets.empty()) ? "" : ",") + "[" + FormatMs(dBound) + "," + to_string(c) + "]";
+        dBound *= 2;
+    }
+
+    return   "{\"count\":" + to_string(v.size())
+           + ",\"mean_ms\":" + FormatMs(dSum / v.size())
+           + ",\"p50_ms\":" + FormatMs(Percentile(0.5))
+           + ",\"p90_ms\":" + FormatMs(Percentile(0.9))
+           + ",\"p99_ms\":" + FormatMs(Percentile(0.99))
+           + ",\"max_ms\":" + FormatMs(v.back())
+           + ",\"buckets\":[" + strBuckets + "]}";
+}
+
+
+/***************************************************************************
+ *
+ *  Benchmark
+ *
+ **************************************************************************/
+
+/**
+ *  Thumbnails all files with a new Thumbnailer with the given number of loader threads and
+ *  returns the results of the run as a JSON object.
+ */
+static string
+RunThumbnailer(const vector<PFsGioFile> &vFiles,
+               uint cLoaders)
+{
+    bool fPeakReset = ResetPeakRSS();
+
+    // All files are images, so the icon callback never gets called.
+    Thumbnailer thumbnailer([](FsObject&, int) { return PPixbuf(); },
+                            cLoaders);
+
+    auto pLoop = Glib::MainLoop::create();
+    vector<PThumbnail> vDone;
+    vector<ThumbnailTimes::TimePoint> vFetched;
+    thumbnailer.connect([&]()
+    {
+        PThumbnail pThumb = thumbnailer.fetchResult();
+        if (pThumb)
+        {
+            vFetched.push_back(std::chrono::steady_clock::now());
+            vDone.push_back(pThumb);
+            if (vDone.size() == vFiles.size())
+                pLoop->quit();
+        }
+    });
+
+    // Give up if nothing comes back for a minute, e.g. because an image failed to load.
+    size_t cDoneBefore = 0;
+    uint cIdleSeconds = 0;
+    bool fStalled = false;
+    sigc::connection connTimer = Glib::signal_timeout().connect([&]() -> bool
+    {
+        if (vDone.size() != cDoneBefore)
+        {
+            cDoneBefore = vDone.size();
+            cIdleSeconds = 0;
+        }
+        else if (++cIdleSeconds == STALL_TIMEOUT_S)
+        {
+            fStalled = true;
+            pLoop->quit();
+            return false;
+        }
+        return true;
+    }, 1000);
+
+    Stopwatch sw;
+    std::atomic<bool> fStopSampling(false);
+    vector<DepthSample> vSamples;
+    std::thread threadSampler([&]()
+    {
+        while (!fStopSampling)
+        {
+            vSamples.push_back({ sw.getMs(), thumbnailer.getQueueDepths() });
+            std::this_thread::sleep_for(std::chrono::milliseconds(SAMPLE_INTERVAL_MS));
+        }
+    });
+
+    for (auto &pFile : vFiles)
+        thumbnailer.enqueue(pFile);
+    pLoop->run();
+    double dMs = sw.getMs();
+    connTimer.disconnect();
+
+    fStopSampling = true;
+    threadSampler.join();
+
+    if (fStalled)
+        throw FSException("Thumbnailer with " + to_string(cLoaders) + " loader threads stalled after " + to_string(vDone.size()) + " of " + to_string(vFiles.size()) + " images");
+
+    uint64_t cKBPeak = GetPeakRSS();
+
+    vector<double> vReaderWait, vReader, vLoaderWait, vLoader, vScaleSmall, vScaleBig, vDelivery, vTotal;
+    for (size_t i = 0; i < vDone.size(); ++i)
+    {
+        const ThumbnailTimes &t = vDone[i]->times;
+        vReaderWait.push_back(GetMs(t.tEnqueued, t.tReadBegin));
+        vReader.push_back(GetMs(t.tReadBegin, t.tReadEnd));
+        vLoaderWait.push_back(GetMs(t.tReadEnd, t.tLoadBegin));
+        vLoader.push_back(GetMs(t.tLoadBegin, t.tLoadEnd));
+        vScaleSmall.push_back(GetMs(t.tScaleSmallBegin, t.tScaleSmallEnd));
+        vScaleBig.push_back(GetMs(t.tScaleBigBegin, t.tScaleBigEnd));
+        vDelivery.push_back(GetMs(t.tPosted, vFetched[i]));
+        vTotal.push_back(GetMs(t.tEnqueued, vFetched[i]));
+    }
+
+    string strSamples;
+    for (auto &s : vSamples)
+        strSamples += string((strSamples.empty()) ? "" : ",") + "["
+                      + FormatMs(s.dMs) + ","
+                      + to_string(s.depths.cFileReader) + ","
+                      + to_string(s.depths.cPixbufLoaders) + ","
+                      + to_string(s.depths.cScalerSmall) + ","
+                      + to_string(s.depths.cScalerBig) + ","
+                      + to_string(s.depths.cResults) + "]";
+
+    // Don't let the thumbnails of this run count towards the memory of the next.
+    for (auto &pFile : vFiles)
+    {
+        pFile->setThumbnail(ICON_SIZE_SMALL, PPixbuf());
+        pFile->setThumbnail(ICON_SIZE_BIG, PPixbuf());
+    }
+
+    AddResult("thumbnails", "corpus", vFiles.size(), "loaders_" + to_string(thumbnailer.getLoaderThreadCount()), dMs, vDone.size());
+
+    return   "{\"loaders\":" + to_string(thumbnailer.getLoaderThreadCount())
+           + ",\"images\":" + to_string(vDone.size())
+           + ",\"ms\":" + FormatMs(dMs)
+           + ",\"images_per_sec\":" + FormatMs(vDone.size() * 1000 / dMs)
+           + ",\"peak_rss_kb\":" + to_string(cKBPeak)
+           + ",\"peak_rss_per_run\":" + ((fPeakReset) ? "true" : "false")
+           + ",\"stages\":{\"reader_wait\":" + MakeLatencyJSON(vReaderWait)
+           + ",\n\"reader\":" + MakeLatencyJSON(vReader)
+           + ",\n\"loader_wait\":" + MakeLatencyJSON(vLoaderWait)
+           + ",\n\"loader\":" + MakeLatencyJSON(vLoader)
+           + ",\n\"scale_small\":" + MakeLatencyJSON(vScaleSmall)
+           + ",\n\"scale_big\":" + MakeLatencyJSON(vScaleBig)
+           + ",\n\"delivery\":" + MakeLatencyJSON(vDelivery)
+           + ",\n\"total\":" + MakeLatencyJSON(vTotal)
+           + "},\n\"queue_depths\":{\"interval_ms\":" + to_string(SAMPLE_INTERVAL_MS)
+           + ",\"columns\":[\"ms\",\"file_reader\",\"pixbuf_loaders\",\"scaler_small\",\"scaler_big\",\"results\"]"
+           + ",\"samples\":[" + strSamples + "]}}";
+}
+
+void
+BenchThumbnailer()
+{
+    // Registers the gdkmm wrappers for Gdk::Pixbuf without opening a display.
+    Gtk::Main::init_gtkmm_internals();
+
+    string strDir = g_strTemp + "/images";
+    StringVector vFormats;
+    uint64_t cbTotal;
+    vector<PFsGioFile> vFiles = MakeCorpus(strDir, vFormats, cbTotal);
+    if (vFiles.empty())
+        throw FSException("No images to thumbnail");
+
+    // By default, 1, 2, 4... up to the number of hardware threads, and what the
+    // thumbnailer would start by itself.
+    std::set<uint> setLoaders(g_opts.vLoaders.begin(), g_opts.vLoaders.end());
+    if (setLoaders.empty())
+    {
+        uint cCores = MAX(1, XWP::Thread::getHardwareConcurrency());
+        for (uint c = 1; c < cCores; c *= 2)
+            setLoaders.insert(c);
+        setLoaders.insert(cCores);
+        setLoaders.insert(MAX(1, (cCores / 2 - 1)));
+    }
+
+    string strRuns;
+    for (uint cLoaders : setLoaders)
+        strRuns += string((strRuns.empty()) ? "" : ",\n") + RunThumbnailer(vFiles, cLoaders);
+
+    StringVector vQuoted;
+    for (auto &str : vFormats)
+        vQuoted.push_back(MakeJSONString(str));
+    StringVector vWidths;
+    for (uint cx : g_opts.vResolutions)
+        vWidths.push_back(MakeJSONString(to_string(cx) + "x" + to_string(cx * 3 / 4)));
+
+    AddSection("thumbnailer",
+                 "{\"formats\":[" + implode(",", vQuoted) + "]"
+               + ",\"resolutions\":[" + implode(",", vWidths) + "]"
+               + ",\"images\":" + to_string(vFiles.size())
+               + ",\"bytes\":" + to_string(cbTotal)
+               + ",\"runs\":[\n" + strRuns + "\n]}");
+
+    vFiles.clear();
+    RemoveTree(strDir);
+}
@@ -16,6 +16,8 @@
 #include "xwp/debug.h"
 #include "xwp/except.h"
 
+#include <chrono>
+
 
 /***************************************************************************
  *
@@ -107,8 +109,8 @@ FileOperation::Create(FileOperationType t,
     // Connect the dispatcher from the parent WorkerResult.
     pOp->_pImpl->connDispatch = pOp->connect([pOp]()
     {
-        auto pFS = pOp->fetchResult();
-        pOp->onProcessingNextItem(pFS);
+        auto pvFiles = pOp->fetchResult();
+        pOp->onProcessingNextItems(pvFiles);
     });
 
     // Instantiate a timer for progress reporting.
@@ -174,6 +176,7 @@ FileOperation::FileOperation(FileOperationType t,
       _refQueue(refQueue),
       _pImpl(new Impl)
 {
+    setTraceName("file operation progress");
 }
 
 FileOperation::~FileOperation()
@@ -190,7 +193,7 @@ void FileOperation::cancel()
     {
         // This is from the "close" button after an error was reported.
         _strError.clear();
-        onProcessingNextItem(nullptr);
+        onProcessingNextItems(nullptr);
     }
 }
 
@@ -206,6 +209,14 @@ void FileOperation::done(PFileOperation pThis)
 void
 FileOperation::threadFunc()
 {
+    TraceSink::SetThreadName("file operation " + to_string(_id));
+
+    typedef chrono::steady_clock Clock;
+
+    // The files processed since the last post to the GUI thread.
+    PFSVector pvBatch;
+    Clock::time_point tLastPost = Clock::now();
+
     try
     {
         size_t cFiles = _vFiles.size();
@@ -219,6 +230,8 @@ FileOperation::threadFunc()
                 _pImpl->dProgress = (double)cCurrent / (double)cFiles;
             }
 
+            TRACE_SCOPE(t, "file operation on " + pFS->getPath());
+
             // This is what gets posted to the GUI callback. This is in
             // a separate variable because it will be changed by COPY.
             PFsObject pFSForGUI(pFS);
@@ -245,7 +258,17 @@ FileOperation::threadFunc()
             if (_stopFlag)
                 throw FSCancelledException();
 
-            postResultToGui(pFSForGUI);     // Temporarily requests the lock.
+            if (!pvBatch)
+                pvBatch = make_shared<FsVector>();
+            pvBatch->push_back(pFSForGUI);
+
+            Clock::time_point tNow = Clock::now();
+            if (tNow - tLastPost >= chrono::milliseconds(UPDATE_PROGRESS_MILLIS))
+            {
+                postResultToGui(pvBatch);       // Temporarily requests the lock.
+                pvBatch = nullptr;
+                tLastPost = tNow;
+            }
 
             ++cCurrent;
         }
@@ -255,6 +278,10 @@ FileOperation::threadFunc()
         _strError = e.what();
     }
 
+    // The files that were processed before an error must still be removed from the views.
+    if (pvBatch)
+        postResultToGui(pvBatch);
+
     // Report "finished" by pushing a nullptr.
     postResultToGui(nullptr);
 }
@@ -276,18 +303,18 @@ FileOperation::onProgress()
 }
 
 /**
- *  GUI callback invoked by the dispatcher for every item that is about to be processed
+ *  GUI callback invoked by the dispatcher for every batch of items that has been processed
  *  (when the thread calls postResultToGUI()). This should update the folder contents model.
  *
- *  pFS is the source file EXCEPT in the case of "copy", where it is the new copy of
- *  the file, since that's what's needed in the GUI.
+ *  pvFiles has the source files EXCEPT in the case of "copy", where it has the new copies
+ *  of the files, since that's what's needed in the GUI.
  */
 void
-FileOperation::onProcessingNextItem(PFsObject pFS)
+FileOperation::onProcessingNextItems(PFSVector pvFiles)
 {
-    if (pFS)
+    if (pvFiles)
     {
-        Debug::Log(FILE_HIGH, "File ops item processed: " + pFS->getPath());
+        Debug::Log(FILE_HIGH, "File ops items processed: " + to_string(pvFiles->size()));
 
         switch (_t)
         {
@@ -295,17 +322,17 @@ FileOperation::onProcessingNextItem(PFsObject pFS)
             break;
 
             case FileOperationType::TRASH:
-                _pImpl->pSourceContainer->notifyFileRemoved(pFS);
+                _pImpl->pSourceContainer->notifyFilesRemoved(*pvFiles);
             break;
 
             case FileOperationType::MOVE:
-                _pImpl->pSourceContainer->notifyFileRemoved(pFS);
-                _pImpl->pTargetContainer->notifyFileAdded(pFS);
+                _pImpl->pSourceContainer->notifyFilesRemoved(*pvFiles);
+                _pImpl->pTargetContainer->notifyFilesAdded(*pvFiles);
             break;
 
             case FileOperationType::COPY:
-                // pFS has the newly copied file, not the source file.
-                _pImpl->pTargetContainer->notifyFileAdded(pFS);
+                // pvFiles has the newly copied files, not the source files.
+                _pImpl->pTargetContainer->notifyFilesAdded(*pvFiles);
             break;
         }
     }
@@ -98,7 +98,11 @@ struct ElissoFolderTreeMgr::Impl : public ProhibitCopy
 
     Impl()
         : cThreadsRunning(0)
-    { }
+    {
+        workerAddMounts.setTraceName("tree mountables");
+        workerSubtreePopulated.setTraceName("tree subtree populated");
+        workerAddOneFirst.setTraceName("tree first subfolders");
+    }
 };
 
 
@@ -392,6 +396,7 @@ ElissoFolderTreeMgr::spawnGetMountables()
      */
     XWP::Thread::Create([this]()
     {
+        TraceSink::SetThreadName("tree mountables");
         ++_pImpl->cThreadsRunning;
         // Create an FSList on the thread's stack and have it filled by the back-end.
         auto pllMountables = make_shared<FsGioMountablesVector>();
@@ -510,6 +515,8 @@ ElissoFolderTreeMgr::spawnPopulate(PFolderTreeModelRow pRow)
              */
             XWP::Thread::Create([this, pDir2, pRow]()
             {
+                TraceSink::SetThreadName("tree populate");
+                TRACE_SCOPE(t, "populate subtree " + pRow->pDir->getPath());
                 ++_pImpl->cThreadsRunning;
                 // Create an FSList on the thread's stack and have it filled by the back-end.
                 PSubtreePopulated pResult = std::make_shared<SubtreePopulated>(pRow);
@@ -618,6 +625,8 @@ ElissoFolderTreeMgr::spawnAddFirstSubfolders(PAddOneFirstsList pllToAddFirst)
      */
     XWP::Thread::Create([this, pllToAddFirst]()
     {
+        TraceSink::SetThreadName("tree first subfolders");
+        TRACE_SCOPE(t, "add first subfolders of " + to_string(pllToAddFirst->size()) + " folder(s)");
         ++_pImpl->cThreadsRunning;
         for (PAddOneFirst pAddOneFirst : *pllToAddFirst)
         {
@@ -706,6 +715,45 @@ ElissoFolderTreeMgr::updateCursor()
 void
 FolderTreeMonitor::onItemAdded(PFsObject &pFS) /* override */
 {
+    this->onItemsAdded(FsVector { pFS });
+}
+
+/**
+ *  Appends rows for all new subfolders and then sorts the parent once, which would
+ *  otherwise be re-sorted for every single one.
+ */
+/* virtual */
+void
+FolderTreeMonitor::onItemsAdded(const FsVector &vFS) /* override */
+{
+    // Rows that only show their first subfolder (the expander) get no more; that is
+    // taken care of when they are expanded.
+    if (_pRowWatching->state != TreeNodeState::POPULATED_WITH_FOLDERS)
+        return;
+
+    auto &pModel = _tree._pImpl->pModel;
+    PAddOneFirstsList pllToAddFirst = std::make_shared<AddOneFirstsList>();
+    for (auto &pFS : vFS)
+    {
+        FSTypeResolved tr;
+        if (    (!pFS->isHidden())
+             && (pFS->isDirectoryOrSymlinkToDirectory(tr))
+             && (!pModel->findRow(_pRowWatching, pFS->getBasename()))
+           )
+        {
+            auto pChildRow = pModel->append(_pRowWatching,
+                                            0,       // overrideSort
+                                            pFS,
+                                            pFS->getBasename());
+            pllToAddFirst->push_back(std::make_shared<AddOneFirst>(pChildRow));
+        }
+    }
+
+    if (pllToAddFirst->size())
+    {
+        pModel->sort(_pRowWatching);
+        _tree.spawnAddFirstSubfolders(pllToAddFirst);
+    }
 }
 
 /* virtual */
@@ -717,6 +765,23 @@ FolderTreeMonitor::onItemRemoved(PFsObject &pFS) /* override */
         _tree._pImpl->pModel->remove(_pRowWatching, pRow);
 }
 
+/**
+ *  Removing rows does not affect the order of the others, so there is nothing to
+ *  batch here; this only saves the virtual calls.
+ */
+/* virtual */
+void
+FolderTreeMonitor::onItemsRemoved(const FsVector &vFS) /* override */
+{
+    auto &pModel = _tree._pImpl->pModel;
+    for (auto &pFS : vFS)
+    {
+        auto pRow = pModel->findRow(_pRowWatching, pFS->getBasename());
+        if (pRow)
+            pModel->remove(_pRowWatching, pRow);
+    }
+}
+
 /* virtual */
 void
 FolderTreeMonitor::onItemRenamed(PFsObject &pFS,
@@ -727,3 +792,10 @@ FolderTreeMonitor::onItemRenamed(PFsObject &pFS,
     if (pRow)
         _tree._pImpl->pModel->rename(pRow, strNewName);
 }
+
+/* virtual */
+void
+FolderTreeMonitor::onItemChanged(PFsObject &pFS) /* override */
+{
+    // Nothing in the tree shows file sizes or owners.
+}
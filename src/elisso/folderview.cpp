@@ -30,6 +30,12 @@
 
 std::atomic<std::uint64_t>  g_uViewID(1);
 
+/**
+ *  ElissoFolderView::addFiles() only switches sorting off for at least this many files,
+ *  since sorting the whole list afterwards costs more than a few inserts.
+ */
+#define MIN_FILES_UNSORTED      16
+
 
 /***************************************************************************
  *
@@ -119,6 +125,7 @@ struct ElissoFolderView::Impl : public ProhibitCopy
 
     PPopulateThread                 pPopulateThread;      // only set while state == POPULATING or REFRESHING
     uint                            idCurrentPopulateThread = 0;
+    bool                            fShowingBatches = false;    // true once partial populate results are showing, see onPopulateBatch()
 
     // GUI thread dispatcher for when a folder populate is done.
     PViewPopulatedWorker            pWorkerPopulated;
@@ -154,8 +161,13 @@ struct ElissoFolderView::Impl : public ProhibitCopy
         : // scrolledWindow(folderView),
           pWorkerPopulated(make_shared<ViewPopulatedWorker>()),
           pMonitor(make_shared<FolderViewMonitor>(folderView)),
-          thumbnailer(folderView.getApplication())
-    { }
+          thumbnailer([&folderView](FsObject &fs, int size)
+                      {
+                          return folderView.getApplication().getFileTypeIcon(fs, size);
+                      })
+    {
+        pWorkerPopulated->setTraceName("populate results");
+    }
 
     ~Impl()
     {
@@ -376,6 +388,15 @@ ElissoFolderView::setDirectory(PFsObject pDirOrSymlinkToDir,
         else
             Debug::Log(FOLDER_STACK, string(__func__) + "(): SetDirectoryFlag::PUSH_TO_HISTORY is NOT set");
 
+        if (_pImpl->fShowingBatches)
+        {
+            if (_pImpl->state == ViewState::POPULATING)
+                // Still showing batches from the populate we just stopped: make setState()
+                // below disconnect the model and show the "Loading" overlay again.
+                _pImpl->state = ViewState::UNDEFINED;
+            _pImpl->fShowingBatches = false;
+        }
+
         // Change view state early to avoid "selection changed" signals overflowing us.
         if (fl.test(SetDirectoryFlag::IS_REFRESH))
             this->setState(ViewState::REFRESHING);
@@ -386,11 +407,18 @@ ElissoFolderView::setDirectory(PFsObject pDirOrSymlinkToDir,
         if (_pImpl->mode == FolderViewMode::ERROR)
             setViewMode(_pImpl->modeBeforeError);
 
-        // Remove all old data, if any.
+        // Remove all old data, if any. A refresh keeps the rows, and with them the thumbnails
+        // that are still queued for them, so only reset those for a new folder.
         if (!(fl.test(SetDirectoryFlag::IS_REFRESH)))
+        {
             _pImpl->clearModel();
 
-        _pImpl->thumbnailer.clearQueues();
+            _pImpl->thumbnailer.clearQueues();
+
+            // Reset the thumbnailer count for the progress bar. insertFile() increments it for each image file.
+            _pImpl->cToThumbnail = 0;
+            _pImpl->cThumbnailed = 0;
+        }
 
         auto pWatching = _pImpl->pMonitor->isWatching();
         if (pWatching)
@@ -435,12 +463,12 @@ ElissoFolderView::onPopulateDone(PViewPopulatedResult pResult)
         // with a populate result for the previous folder, which we should simply
         // discard.
         ;
+    else if (pResult->fPartial)
+        this->onPopulateBatch(pResult);
     else
     {
         Debug d(FOLDER_POPULATE_LOW, "ElissoFolderView::onPopulateDone(" + quote(_pDir->getPath()) + ", id=" + to_string(pResult->idPopulateThread) + ")");
 
-        Gtk::ListStore::iterator itSelect;
-
         _pImpl->pllFolderContents = pResult->pvContents;
 
         bool fRefreshing = _pImpl->state == ViewState::REFRESHING;
@@ -453,10 +481,6 @@ ElissoFolderView::onPopulateDone(PViewPopulatedResult pResult)
         if (pOther)
             _pImpl->pMonitor->stopWatching(*pOther);
 
-        // Reset the thumbnailer count for the progress bar. insertFile() increments it for each image file.
-        _pImpl->cToThumbnail = 0;
-        _pImpl->cThumbnailed = 0;
-
         // If we're refreshing, we only insert newly added files to avoid duplicates.
         FsVector &vFiles = (fRefreshing) ? pResult->vAdded : *_pImpl->pllFolderContents;
 
@@ -466,41 +490,21 @@ ElissoFolderView::onPopulateDone(PViewPopulatedResult pResult)
 
             Debug d2(FOLDER_POPULATE_LOW, "Inserting files");
 
-            /*
-             *  Insert all the files and collect some statistics.
-             */
-            for (auto pFS : vFiles)
-            {
-                auto it = this->insertFile(pFS);
-                if (it)
-                {
-                    ++_pImpl->cTotal;
-
-                    if (pFS == pResult->pDirSelectPrevious)
-                        itSelect = it;
-
-                    auto t = pFS->getResolvedType();
-                    switch (t)
-                    {
-                        case FSTypeResolved::DIRECTORY:
-                        case FSTypeResolved::SYMLINK_TO_DIRECTORY:
-                            ++_pImpl->cFolders;
-                        break;
-
-                        case FSTypeResolved::FILE:
-                        case FSTypeResolved::SYMLINK_TO_FILE:
-                            ++_pImpl->cFiles;
-                            if (ContentType::IsImageFile(g_pFsGioImpl->getFile(pFS, t)))
-                                ++_pImpl->cImageFiles;
-                        break;
-
-                        default:
+            // Files from earlier batches are in the model already.
+            this->insertFiles(vFiles, _pImpl->fShowingBatches);
+        }
 
-                        break;
-                    }
-                }
+        // Look up the row to select by name, since it may have come with an earlier batch.
+        Gtk::ListStore::iterator itSelect;
+        if (pResult->pDirSelectPrevious)
+        {
+            auto itRef = _pImpl->mapRowReferences.find(pResult->pDirSelectPrevious->getBasename());
+            if (itRef != _pImpl->mapRowReferences.end())
+            {
+                Gtk::TreePath path = itRef->second.get_path();
+                if (path)
+                    itSelect = _pImpl->pListStore->get_iter(path);
             }
-
         }
 
         if (!fRefreshing)
@@ -566,8 +570,7 @@ ElissoFolderView::onPopulateDone(PViewPopulatedResult pResult)
 
             // Notify this and other monitors (tree view) of the items that have been removed
             // if this was a refresh.
-            for (auto &pRemoved : pResult->vRemoved)
-                pCnr->notifyFileRemoved(pRemoved);
+            pCnr->notifyFilesRemoved(pResult->vRemoved);
 
         }
 
@@ -577,6 +580,8 @@ ElissoFolderView::onPopulateDone(PViewPopulatedResult pResult)
         if (_pImpl->cToThumbnail)
         {
             _mainWindow.setThumbnailerProgress(0, _pImpl->cToThumbnail, ShowHideOrNothing::SHOW);
+            // A refresh may come in while the timer from the first populate is still running.
+            _pImpl->connThumbnailProgressTimer.disconnect();
             _pImpl->connThumbnailProgressTimer = Glib::signal_timeout().connect([this]() -> bool
             {
                 Debug::Log(THUMBNAILER, "cThumbnailed: " + to_string(_pImpl->cThumbnailed));
@@ -594,9 +599,109 @@ ElissoFolderView::onPopulateDone(PViewPopulatedResult pResult)
                 return true; // keep going
             }, 100);
         }
+
+        // If the contents came from a snapshot, they are showing now but may be outdated,
+        // since files can change without their folder changing. Refresh from disk in the
+        // background; that only inserts and removes the differences.
+        if (    (!fRefreshing)
+             && (pCnr)
+             && (pCnr->isPopulatedFromCache())
+           )
+        {
+            Debug::Log(FOLDER_POPULATE_HIGH, quote(_pDir->getPath()) + " was populated from a snapshot, revalidating");
+            this->refresh();
+        }
+    }
+}
+
+/**
+ *  Gets called by onPopulateDone() for every partial result that the populate thread posts
+ *  while it is still busy with a large folder.
+ *
+ *  The first batch makes the view usable: it picks the view mode from what has arrived so
+ *  far, connects the model and removes the "Loading" overlay, so that rows show up while
+ *  the rest is still being populated. The state remains POPULATING until the final result
+ *  arrives, which then only inserts the files that didn't come with a batch.
+ *
+ *  Refreshes ignore the batches since the old contents are still showing until then.
+ */
+void
+ElissoFolderView::onPopulateBatch(PViewPopulatedResult pResult)
+{
+    if (_pImpl->state != ViewState::POPULATING)
+        return;
+
+    Debug d(FOLDER_POPULATE_LOW, string(__func__) + "(" + quote(_pDir->getPath()) + ", " + to_string(pResult->vAdded.size()) + " files)");
+
+    this->insertFiles(pResult->vAdded, false);
+
+    if (!_pImpl->fShowingBatches)
+    {
+        // onPopulateDone() will still switch to icons if image files turn up later.
+        this->setViewMode((_pImpl->cImageFiles) ? FolderViewMode::ICONS : FolderViewMode::LIST);
+        this->connectModel(true);
+        _pImpl->fShowingBatches = true;
+
+        delete _pImpl->pLoading;
+        _pImpl->pLoading = nullptr;
     }
 }
 
+/**
+ *  Inserts all the given files into the model and collects some statistics. If fSkipInserted
+ *  is true, files that have a row already are skipped.
+ *
+ *  Once the first batch has connected the model, it is sorted, so like addFiles() this
+ *  switches sorting off while inserting and sorts the list once afterwards.
+ */
+void
+ElissoFolderView::insertFiles(FsVector &vFiles,
+                              bool fSkipInserted)
+{
+    int idSortColumn;
+    Gtk::SortType sortType;
+    bool fSorted =    (vFiles.size() >= MIN_FILES_UNSORTED)
+                   && (_pImpl->pListStore->get_sort_column_id(idSortColumn, sortType));
+    if (fSorted)
+        _pImpl->pListStore->set_sort_column(Gtk::TreeSortable::DEFAULT_UNSORTED_COLUMN_ID, sortType);
+
+    for (auto pFS : vFiles)
+    {
+        if (fSkipInserted)
+            if (_pImpl->mapRowReferences.count(pFS->getBasename()))
+                continue;
+
+        auto it = this->insertFile(pFS);
+        if (it)
+        {
+            ++_pImpl->cTotal;
+
+            auto t = pFS->getResolvedType();
+            switch (t)
+            {
+                case FSTypeResolved::DIRECTORY:
+                case FSTypeResolved::SYMLINK_TO_DIRECTORY:
+                    ++_pImpl->cFolders;
+                break;
+
+                case FSTypeResolved::FILE:
+                case FSTypeResolved::SYMLINK_TO_FILE:
+                    ++_pImpl->cFiles;
+                    if (ContentType::IsImageFile(g_pFsGioImpl->getFile(pFS, t)))
+                        ++_pImpl->cImageFiles;
+                break;
+
+                default:
+
+                break;
+            }
+        }
+    }
+
+    if (fSorted)
+        _pImpl->pListStore->set_sort_column(idSortColumn, sortType);
+}
+
 PFsObject
 ElissoFolderView::getFsObjFromRow(Gtk::TreeModel::Row &row)
 {
@@ -709,6 +814,75 @@ ElissoFolderView::removeFile(PFsObject pFS)
             if (itModel)
                 _pImpl->pListStore->erase(itModel);
         }
+
+        // Otherwise insertFiles() would skip the file if it came back.
+        _pImpl->mapRowReferences.erase(itSTL);
+    }
+}
+
+/**
+ *  Inserts many files for a monitor at once. Files that have a row already are skipped.
+ *
+ *  With a sort column set, every row that gets inserted is moved to its sorted position
+ *  right away, and each such move emits a "rows-reordered" signal with a new order for
+ *  the whole list, which makes inserting thousands of rows into a large folder quadratic.
+ *  So sorting is switched off until all rows are in and then the list is sorted once.
+ */
+void
+ElissoFolderView::addFiles(const FsVector &vFiles)
+{
+    Debug d(FILEMONITORS, string(__func__) + "(" + to_string(vFiles.size()) + " files)");
+
+    int idSortColumn;
+    Gtk::SortType sortType;
+    bool fSorted =    (vFiles.size() >= MIN_FILES_UNSORTED)
+                   && (_pImpl->pListStore->get_sort_column_id(idSortColumn, sortType));
+    if (fSorted)
+        _pImpl->pListStore->set_sort_column(Gtk::TreeSortable::DEFAULT_UNSORTED_COLUMN_ID, sortType);
+
+    for (auto &pFS : vFiles)
+        if (!_pImpl->mapRowReferences.count(pFS->getBasename()))
+            this->insertFile(pFS);
+
+    if (fSorted)
+        _pImpl->pListStore->set_sort_column(idSortColumn, sortType);
+}
+
+/**
+ *  Removes many files for a monitor at once. Removing rows never changes the order
+ *  of the others, so this is simply removeFile() for each.
+ */
+void
+ElissoFolderView::removeFiles(const FsVector &vFiles)
+{
+    Debug d(FILEMONITORS, string(__func__) + "(" + to_string(vFiles.size()) + " files)");
+
+    for (auto &pFS : vFiles)
+        this->removeFile(pFS);
+}
+
+/**
+ *  Updates the size and owner columns of the row for the given file after the file has
+ *  been modified in place.
+ */
+void
+ElissoFolderView::updateFile(PFsObject pFS)
+{
+    auto itSTL = _pImpl->mapRowReferences.find(pFS->getBasename());
+    if (itSTL != _pImpl->mapRowReferences.end())
+    {
+        Gtk::TreePath path = itSTL->second.get_path();
+        if (path)
+        {
+            auto itModel = _pImpl->pListStore->get_iter(path);
+            if (itModel)
+            {
+                auto row = *itModel;
+                FolderContentsModelColumns &cols = FolderContentsModelColumns::Get();
+                row[cols._colSize] = pFS->getFileSize();
+                row[cols._colOwnerString] = pFS->makeOwnerString();
+            }
+        }
     }
 }
 
@@ -874,8 +1048,9 @@ ElissoFolderView::setState(ViewState s)
 
             case ViewState::POPULATED:
             {
-                // Connect model again, set sort.
-                this->connectModel(true);
+                // Connect model again, set sort, unless onPopulateBatch() has done that already.
+                if (!_pImpl->fShowingBatches)
+                    this->connectModel(true);
 
                 this->setWaitCursor(Cursor::DEFAULT);
 
@@ -1015,7 +1190,8 @@ ElissoFolderView::setViewMode(FolderViewMode m)
 
         _pImpl->mode = m;
 
-        this->connectModel(_pImpl->state == ViewState::POPULATED);
+        this->connectModel(    (_pImpl->state == ViewState::POPULATED)
+                            || (_pImpl->fShowingBatches));
     }
 }
 
@@ -2163,3 +2339,25 @@ FolderViewMonitor::onItemRenamed(PFsObject &pFS, const std::string &strOldName,
     _view.renameFile(pFS, strOldName, strNewName);
 }
 
+/* virtual */
+void
+FolderViewMonitor::onItemsAdded(const FsVector &vFS) /* override */
+{
+    _view.addFiles(vFS);
+}
+
+/* virtual */
+void
+FolderViewMonitor::onItemsRemoved(const FsVector &vFS) /* override */
+{
+    _view.removeFiles(vFS);
+}
+
+/* virtual */
+void
+FolderViewMonitor::onItemChanged(PFsObject &pFS) /* override */
+{
+    Debug d(FILEMONITORS, string(__func__) + "(" + pFS->getPath() + ")");
+    _view.updateFile(pFS);
+}
+
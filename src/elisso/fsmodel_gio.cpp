@@ -15,9 +15,13 @@
 
 #include "xwp/debug.h"
 // #include "xwp/stringhelp.h"
-#include "xwp/regex.h"
+#include "xwp/slab.h"
 #include "xwp/except.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 FsGioImpl *g_pFsGioImpl = nullptr;
 
 
@@ -27,118 +31,179 @@ FsGioImpl *g_pFsGioImpl = nullptr;
  *
  **************************************************************************/
 
-/* virtual */
-PFsObject
-FsGioImpl::findPath(const string &strPath0) /* override */
+/**
+ *  Returns the length of the URI scheme at the start of strPath, if it starts with
+ *  one followed by "://", or 0 otherwise.
+ */
+static size_t
+GetSchemeLength(const string &strPath)
 {
-    Debug d(FILE_LOW, __func__ + string("(" + quote(strPath0) + ")"));
+    size_t c = 0;
+    while (    (c < strPath.length())
+            && (    ((strPath[c] >= 'a') && (strPath[c] <= 'z'))
+                 || (strPath[c] == '-')
+                 || (strPath[c] == '+')
+               )
+          )
+        ++c;
+
+    if (    (c)
+         && (strPath.compare(c, 3, "://") == 0)
+       )
+        return c;
+    return 0;
+}
 
-    string strPath;
-    static Regex s_reScheme(R"i____(^([-+a-z]+)://(.*))i____");
-    RegexMatches aMatches;
-    string strScheme;
-    if (s_reScheme.matches(strPath0, aMatches))
-    {
-        strScheme = aMatches.get(1);
-        strPath = aMatches.get(2);
-        Debug::Log(FILE_LOW, "explicit scheme=" + quote(strScheme) + ", path=" + quote(strPath));
-    }
-    else
+/**
+ *  Calls fn for every non-empty particle between slashes in strPath, starting at ofs,
+ *  with the offset and length of the particle. Stops and returns false if fn returns
+ *  false.
+ */
+template<class F>
+static bool
+ForEachParticle(const string &strPath,
+                size_t ofs,
+                F fn)
+{
+    while (ofs < strPath.length())
     {
-        strScheme = "file";
-        strPath = strPath0;
-        Debug::Log(FILE_LOW, "implicit scheme=" + quote(strScheme) + ", path=" + quote(strPath));
+        size_t ofsEnd = strPath.find('/', ofs);
+        if (ofsEnd == string::npos)
+            ofsEnd = strPath.length();
+        if (ofsEnd > ofs)
+            if (!fn(ofs, ofsEnd - ofs))
+                return false;
+        ofs = ofsEnd + 1;
     }
 
-    string strPathSplit;
-    bool fAbsolute;
-    PFsObject pCurrent;
-    if ((fAbsolute = (strPath[0] == '/')))
-    {
-        strPathSplit = strPath.substr(1);
-        if (strPathSplit.empty())       // path == "/" case
-            pCurrent = RootDirectory::Get(strScheme);       // And this will be returned, as aParticles will be empty.
+    return true;
+}
 
-    }
-    else
-        strPathSplit = strPath;
+/* virtual */
+PFsObject
+FsGioImpl::findPath(const string &strPath0) /* override */
+{
+    size_t cchScheme = GetSchemeLength(strPath0);
+    // Offset of the path after the scheme.
+    size_t ofsPath = (cchScheme) ? cchScheme + 3 : 0;
+    bool fAbsolute = (strPath0.length() > ofsPath) && (strPath0[ofsPath] == '/');
+
+    // Absolute paths that have been resolved before need no more than a hash lookup.
+    // Relative ones depend on the current directory.
+    uint64_t uGeneration = 0;
+    if (fAbsolute)
+        if (auto pFS = FindCachedPath(strPath0, uGeneration))
+            return pFS;
+
+    DEBUG_SCOPE(d, FILE_LOW, __func__ + string("(" + quote(strPath0) + ")"));
+
+    string strScheme = (cchScheme) ? strPath0.substr(0, cchScheme) : "file";
+    DEBUG_LOG(FILE_LOW, string(cchScheme ? "explicit" : "implicit") + " scheme=" + quote(strScheme) + ", path=" + quote(strPath0.substr(ofsPath)));
+
+    size_t cParticles = 0;
+    bool fCacheable = fAbsolute;
+    ForEachParticle(strPath0, ofsPath, [&](size_t ofs, size_t cch) -> bool
+    {
+        ++cParticles;
+        // The cache can't tell if "." or ".." still lead to the same place.
+        if (strPath0[ofs] == '.')
+            if (    (cch == 1)
+                 || ((cch == 2) && (strPath0[ofs + 1] == '.'))
+               )
+                fCacheable = false;
+        return true;
+    });
+    DEBUG_LOG(FILE_LOW, to_string(cParticles) + " particle(s) given");
 
-    StringVector aParticles = explodeVector(strPathSplit, "/");
-    Debug::Log(FILE_LOW, to_string(aParticles.size()) + " particle(s) given");
+    PFsObject pCurrent;
+    if (    (fAbsolute)
+         && (!cParticles)       // path == "/" case
+       )
+        pCurrent = RootDirectory::Get(strScheme);
 
     // Do not hold any locks in this method. We iterate over the path on the stack
     // and call into FsContainer::find(), which has proper locking.
 
     uint c = 0;
-    for (auto const &strParticle : aParticles)
+    string strParticle;
+    bool fComplete = ForEachParticle(strPath0, ofsPath, [&](size_t ofs, size_t cch) -> bool
     {
-        Debug::Log(FILE_LOW, "Particle: " + quote(strParticle));
+        strParticle.assign(strPath0, ofs, cch);
+        DEBUG_LOG(FILE_LOW, "Particle: " + quote(strParticle));
         if (strParticle == ".")
         {
-            if (aParticles.size() > 1)
-                Debug::Log(FILE_LOW, "Ignoring particle . in list");
-            else
+            if (cParticles > 1)
             {
-                pCurrent = FsDirectory::GetCwdOrThrow();
-                break;
+                DEBUG_LOG(FILE_LOW, "Ignoring particle . in list");
+                return true;
             }
+
+            pCurrent = FsDirectory::GetCwdOrThrow();
+            return false;
         }
-        else
+
+        FsContainer *pDir = nullptr;
+        bool fCollapsing = false;
+        if (!pCurrent)
         {
-            FsContainer *pDir = nullptr;
-            bool fCollapsing = false;
-            if (!pCurrent)
+            if (fAbsolute)
             {
-                if (fAbsolute)
-                {
-                    // First item on an absolute path must be a child of the root directory.
-                    auto pRoot = RootDirectory::Get(strScheme);     // This throws on errors.
-                    pDir = pRoot->getContainer();
-                    Debug::Log(FILE_LOW, "got root dir " + quote(pRoot->getBasename()));
-                }
-                else
-                    // First item on a relative path must be a child of the curdir.
-                    pDir = FsDirectory::GetCwdOrThrow()->getContainer();
+                // First item on an absolute path must be a child of the root directory.
+                auto pRoot = RootDirectory::Get(strScheme);     // This throws on errors.
+                pDir = pRoot->getContainer();
+                DEBUG_LOG(FILE_LOW, "got root dir " + quote(pRoot->getBasename()));
             }
             else
-            {
-                // Later particles:
+                // First item on a relative path must be a child of the curdir.
+                pDir = FsDirectory::GetCwdOrThrow()->getContainer();
+        }
+        else
+        {
+            // Later particles:
 
-                if (strParticle == "..")
-                {
-                    // Avoid things like ./../subdir1/../subdir2/
-                    //                                ^ we would create pChild here
-                    //                        ^ this is pCurrent at this time
-                    //           =>      ./../subdir2/
-                    fCollapsing = true;
+            if (strParticle == "..")
+            {
+                // Avoid things like ./../subdir1/../subdir2/
+                //                                ^ we would create pChild here
+                //                        ^ this is pCurrent at this time
+                //           =>      ./../subdir2/
+                fCollapsing = true;
 
-                    auto pPrev = pCurrent;
+                auto pPrev = pCurrent;
 
-                    // Go back to the parent and skip over the rest of this step.
-                    pCurrent = pCurrent->getParent();
+                // Go back to the parent and skip over the rest of this step.
+                pCurrent = pCurrent->getParent();
 
-                    Debug::Log(FILE_LOW, "Loop " + to_string(c) + ": collapsed " + quote(pPrev->getPath() + "/" + strParticle) + " to " + quote(pCurrent->getPath()));
-                }
-                else if (!(pDir = pCurrent->getContainer()))
-                    // Particle is a broken symlink.
-                    break;
-//                     throw FSException("path particle \"" + pCurrent->getPath() + "\" cannot have contents");
+                DEBUG_LOG(FILE_LOW, "Loop " + to_string(c) + ": collapsed " + quote(pPrev->getPath() + "/" + strParticle) + " to " + quote(pCurrent->getPath()));
             }
+            else if (!(pDir = pCurrent->getContainer()))
+                // Particle is a broken symlink.
+                return false;
+//                 throw FSException("path particle \"" + pCurrent->getPath() + "\" cannot have contents");
+        }
 
-            if (!fCollapsing)
+        if (!fCollapsing)
+        {
+            // The following can throw.
+            if (!(pCurrent = pDir->find(strParticle)))
             {
-                // The following can throw.
-                if (!(pCurrent = pDir->find(strParticle)))
-                {
-                    Debug::Log(FILE_LOW, "Directory::find() returned nullptr");
-                    break;
-                }
+                DEBUG_LOG(FILE_LOW, "Directory::find() returned nullptr");
+                return false;
             }
-            ++c;
         }
-    }
+        ++c;
+        return true;
+    });
+
+    // Not if the walk stopped at a broken symlink, which may get a target later.
+    if (    (fCacheable)
+         && (fComplete)
+         && (pCurrent)
+       )
+        CachePath(strPath0, pCurrent, uGeneration);
 
-    d.setExit("Result: " + (pCurrent ? pCurrent->describe(true) : "NULL"));
+    if (d.isActive())
+        d.setExit("Result: " + (pCurrent ? pCurrent->describe(true) : "NULL"));
 
     return pCurrent;
 }
@@ -152,7 +217,7 @@ FsGioImpl::makeAwake(const string &strParentPath,
     PFsObject pReturn;
 
     string strFullPath2 = strParentPath + "/" + strBasename;
-    Debug d(FILE_LOW, "FsGioImpl::makeAwake(" + quote(strFullPath2) + ")");
+    DEBUG_SCOPE(d, FILE_LOW, "FsGioImpl::makeAwake(" + quote(strFullPath2) + ")");
 
     PGioFile pGioFile;
     if (fIsLocal)
@@ -160,58 +225,14 @@ FsGioImpl::makeAwake(const string &strParentPath,
     else
         pGioFile = Gio::File::create_for_uri(strFullPath2);
 
-    static string star("*");
-
     try
     {
         auto pInfo = this->getFileInfo(pGioFile);
-
-        switch (pInfo->get_file_type())
-        {
-            case Gio::FileType::FILE_TYPE_REGULAR:         // File handle represents a regular file.
-            {
-                FsCoreInfo info(pInfo->get_size(),
-                                pInfo->get_attribute_uint64(G_FILE_ATTRIBUTE_TIME_MODIFIED),
-                                pInfo->get_attribute_string(G_FILE_ATTRIBUTE_OWNER_USER),
-                                pInfo->get_attribute_string(G_FILE_ATTRIBUTE_OWNER_GROUP));
-                pReturn = FsGioFile::Create(strBasename, info);
-            }
-            break;
-
-            case Gio::FileType::FILE_TYPE_DIRECTORY:       // File handle represents a directory.
-            {
-                FsCoreInfo info(0,
-                                0, // time modified
-                                pInfo->get_attribute_string(G_FILE_ATTRIBUTE_OWNER_USER),
-                                pInfo->get_attribute_string(G_FILE_ATTRIBUTE_OWNER_GROUP));
-                Debug::Log(FILE_LOW, "  creating FsGioDirectory for " + quote(strBasename));
-                pReturn = FsGioDirectory::Create(strBasename, info);
-            }
-            break;
-
-            case Gio::FileType::FILE_TYPE_SYMBOLIC_LINK:   // File handle represents a symbolic link (Unix systems).
-            case Gio::FileType::FILE_TYPE_SHORTCUT:        // File is a shortcut (Windows systems).
-                pReturn = FsSymlink::Create(strBasename,
-                                            pInfo->get_attribute_uint64(G_FILE_ATTRIBUTE_TIME_MODIFIED));
-            break;
-
-            case Gio::FileType::FILE_TYPE_SPECIAL:         // File is a "special" file, such as a socket, fifo, block device, or character device.
-                pReturn = FsGioSpecial::Create(strBasename);
-            break;
-
-            case Gio::FileType::FILE_TYPE_MOUNTABLE:       // File is a mountable location.
-                Debug::Log(MOUNTS, "  creating FsGioMountable");
-//                 pReturn = FsGioMountable::Create(strBasename);
-            break;
-
-            case Gio::FileType::FILE_TYPE_NOT_KNOWN:       // File's type is unknown. This is what we get if the file does not exist.
-                Debug::Log(FILE_HIGH, "file type not known");
-            break;      // return nullptr
-        }
+        pReturn = makeAwakeFromInfo(strBasename, pInfo);
     }
     catch (Gio::Error &e)
     {
-        Debug::Log(CMD_TOP, "FsGioImpl::makeAwake(): got Gio::Error: " + e.what());
+        DEBUG_LOG(CMD_TOP, "FsGioImpl::makeAwake(): got Gio::Error: " + e.what());
         throw FSException(e.what());
     }
 
@@ -221,15 +242,143 @@ FsGioImpl::makeAwake(const string &strParentPath,
     return pReturn;
 }
 
+/**
+ *  Returns an FsCoreInfo with the given size and time and the owners from pInfo, which
+ *  has numeric ids for local files and names for all others; see GetInfoAttributes().
+ */
+static FsCoreInfo
+MakeCoreInfo(Glib::RefPtr<Gio::FileInfo> pInfo,
+             uint64_t cbSize,
+             uint64_t uLastModified)
+{
+    uint64_t uInode = pInfo->get_attribute_uint64(G_FILE_ATTRIBUTE_UNIX_INODE);     // 0 if not set
+    if (pInfo->has_attribute(G_FILE_ATTRIBUTE_UNIX_UID))
+        return FsCoreInfo(cbSize,
+                          uLastModified,
+                          FsIdentities::FromUid(pInfo->get_attribute_uint32(G_FILE_ATTRIBUTE_UNIX_UID)),
+                          FsIdentities::FromGid(pInfo->get_attribute_uint32(G_FILE_ATTRIBUTE_UNIX_GID)),
+                          uInode);
+
+    return FsCoreInfo(cbSize,
+                      uLastModified,
+                      FsIdentities::FromUserName(pInfo->get_attribute_string(G_FILE_ATTRIBUTE_OWNER_USER)),
+                      FsIdentities::FromGroupName(pInfo->get_attribute_string(G_FILE_ATTRIBUTE_OWNER_GROUP)),
+                      uInode);
+}
+
+/**
+ *  Creates the FsObject subclass instance for the given Gio::FileInfo, which must have
+ *  been queried with at least the attributes from GetInfoAttributes(). This does no
+ *  I/O, and it gets called both from makeAwake() and for every directory entry from
+ *  getNextChild(), so that populating a folder only needs the one round-trip that the
+ *  enumerator made for each entry anyway.
+ *
+ *  Returns nullptr if the file type is not supported.
+ */
+PFsObject
+FsGioImpl::makeAwakeFromInfo(const string &strBasename,
+                             Glib::RefPtr<Gio::FileInfo> pInfo)
+{
+    FSType t = FSType::UNINITIALIZED;
+
+    switch (pInfo->get_file_type())
+    {
+        case Gio::FileType::FILE_TYPE_REGULAR:         // File handle represents a regular file.
+            t = FSType::FILE;
+        break;
+
+        case Gio::FileType::FILE_TYPE_DIRECTORY:       // File handle represents a directory.
+            t = FSType::DIRECTORY;
+        break;
+
+        case Gio::FileType::FILE_TYPE_SYMBOLIC_LINK:   // File handle represents a symbolic link (Unix systems).
+        case Gio::FileType::FILE_TYPE_SHORTCUT:        // File is a shortcut (Windows systems).
+            t = FSType::SYMLINK;
+        break;
+
+        case Gio::FileType::FILE_TYPE_SPECIAL:         // File is a "special" file, such as a socket, fifo, block device, or character device.
+            t = FSType::SPECIAL;
+        break;
+
+        case Gio::FileType::FILE_TYPE_MOUNTABLE:       // File is a mountable location.
+            DEBUG_LOG(MOUNTS, "  creating FsGioMountable");
+//             pReturn = FsGioMountable::Create(strBasename);
+            return nullptr;
+
+        case Gio::FileType::FILE_TYPE_NOT_KNOWN:       // File's type is unknown. This is what we get if the file does not exist.
+            DEBUG_LOG(FILE_HIGH, "file type not known");
+            return nullptr;
+    }
+
+    return createObject(t,
+                        strBasename,
+                        MakeCoreInfo(pInfo,
+                                     pInfo->get_size(),
+                                     pInfo->get_attribute_uint64(G_FILE_ATTRIBUTE_TIME_MODIFIED)));
+}
+
+/**
+ *  Creates the FsObject subclass instance for the given type, which must be one
+ *  of FILE, DIRECTORY, SYMLINK or SPECIAL. This is the one place that decides which
+ *  fields of FsCoreInfo each subclass keeps, so that all backends produce objects
+ *  that compare equal with operator== for the same file.
+ */
+PFsObject
+FsGioImpl::createObject(FSType t,
+                        const string &strBasename,
+                        const FsCoreInfo &info)
+{
+    PFsObject pReturn;
+
+    switch (t)
+    {
+        case FSType::FILE:
+            pReturn = FsGioFile::Create(strBasename, info);
+        break;
+
+        case FSType::DIRECTORY:
+        {
+            FsCoreInfo info2(0,
+                             0, // time modified
+                             info._idOwnerUser,
+                             info._idOwnerGroup);
+            DEBUG_LOG(FILE_LOW, "  creating FsGioDirectory for " + quote(strBasename));
+            pReturn = FsGioDirectory::Create(strBasename, info2);
+        }
+        break;
+
+        case FSType::SYMLINK:
+            pReturn = FsSymlink::Create(strBasename,
+                                        info._uLastModified);
+        break;
+
+        case FSType::SPECIAL:
+            pReturn = FsGioSpecial::Create(strBasename);
+        break;
+
+        case FSType::UNINITIALIZED:
+        case FSType::MOUNTABLE:
+        break;      // return nullptr
+    }
+
+    if (pReturn)
+        pReturn->setInode(info._uInode);
+
+    return pReturn;
+}
+
 class FsDirEnumeratorGio : public FsDirEnumeratorBase
 {
 public:
     Glib::RefPtr<Gio::FileEnumerator> en;
+    bool fNamesOnly = false;
 };
 
 /* virtual */
 PFsDirEnumeratorBase
-FsGioImpl::beginEnumerateChildren(FsContainer &cnr)
+FsGioImpl::beginEnumerateChildren(FsContainer &cnr,
+                                  bool fNamesOnly,
+                                  bool fDirectoriesOnly)
 {
     shared_ptr<FsDirEnumeratorGio> pEnum;
 
@@ -238,8 +387,16 @@ FsGioImpl::beginEnumerateChildren(FsContainer &cnr)
         auto pgioContainer = g_pFsGioImpl->getGioFile(cnr._refBase);
 
         pEnum = make_shared<FsDirEnumeratorGio>();
-
-        if (!(pEnum->en = pgioContainer->enumerate_children("*",
+        pEnum->fNamesOnly = fNamesOnly;
+
+        // Only ask for the attributes that makeAwakeFromInfo() needs instead of "*", which
+        // would have Gio compute content types, thumbnail paths and whatnot for every entry.
+        // With fNamesOnly, the type and inode still come with most listings for free; see
+        // FsDirEnumeratorBase::idCurrent.
+        static const string s_strNameOnly = string(G_FILE_ATTRIBUTE_STANDARD_NAME)
+                                          + "," + string(G_FILE_ATTRIBUTE_STANDARD_TYPE)
+                                          + "," + string(G_FILE_ATTRIBUTE_UNIX_INODE);
+        if (!(pEnum->en = pgioContainer->enumerate_children((fNamesOnly) ? s_strNameOnly : GetInfoAttributes(cnr._refBase.hasFlag(FSFlag::IS_LOCAL)),
                                                             Gio::FileQueryInfoFlags::FILE_QUERY_INFO_NOFOLLOW_SYMLINKS)))
             throw FSException("Error populating!");
     }
@@ -253,7 +410,9 @@ FsGioImpl::beginEnumerateChildren(FsContainer &cnr)
 
 /* virtual */
 bool
-FsGioImpl::getNextChild(PFsDirEnumeratorBase pEnum, string &strBasename) /* override */
+FsGioImpl::getNextChild(PFsDirEnumeratorBase pEnum,
+                        string &strBasename,
+                        PFsObject &pTemp) /* override */
 {
     FsDirEnumeratorGio *pEnum2 = static_cast<FsDirEnumeratorGio*>(&*pEnum);
     try
@@ -262,13 +421,45 @@ FsGioImpl::getNextChild(PFsDirEnumeratorBase pEnum, string &strBasename) /* over
 
         while ((pInfo = pEnum2->en->next_file()))
         {
-            auto pGioFileThis = pEnum2->en->get_child(pInfo);
-
-            strBasename = pGioFileThis->get_basename();
+            // The name attribute is the on-disk basename; no need to create a Gio::File for it.
+            strBasename = pInfo->get_name();
             if (    (strBasename != ".")
                  && (strBasename != "..")
                )
+            {
+                if (pEnum2->fNamesOnly)
+                {
+                    pTemp = nullptr;
+                    pEnum2->idCurrent.uInode = pInfo->get_attribute_uint64(G_FILE_ATTRIBUTE_UNIX_INODE);    // 0 if not set
+                    switch (pInfo->get_file_type())
+                    {
+                        case Gio::FileType::FILE_TYPE_REGULAR:
+                            pEnum2->idCurrent.type = FSType::FILE;
+                        break;
+
+                        case Gio::FileType::FILE_TYPE_DIRECTORY:
+                            pEnum2->idCurrent.type = FSType::DIRECTORY;
+                        break;
+
+                        case Gio::FileType::FILE_TYPE_SYMBOLIC_LINK:
+                        case Gio::FileType::FILE_TYPE_SHORTCUT:
+                            pEnum2->idCurrent.type = FSType::SYMLINK;
+                        break;
+
+                        case Gio::FileType::FILE_TYPE_SPECIAL:
+                            pEnum2->idCurrent.type = FSType::SPECIAL;
+                        break;
+
+                        default:
+                            pEnum2->idCurrent.type = FSType::UNINITIALIZED;
+                        break;
+                    }
+                }
+                // Reuse the info we just got instead of having makeAwake() query it again.
+                else if (!(pTemp = makeAwakeFromInfo(strBasename, pInfo)))
+                    throw FSException("Unknown error waking up file-system object " + quote(strBasename));
                 return true;
+            }
         }
     }
     catch (Gio::Error &e)
@@ -340,7 +531,7 @@ FsGioImpl::copy(Debug &d,
         auto pGioFile = getGioFile(fs);
         auto pTargetGioFile = Gio::File::create_for_uri(strTargetPath);
 
-        Debug::Log(FILE_HIGH, "pGioFile->copy(" + quote(pGioFile->get_path()) + " to " + quote(pTargetGioFile->get_path()) + ")");
+        DEBUG_LOG(FILE_HIGH, "pGioFile->copy(" + quote(pGioFile->get_path()) + " to " + quote(pTargetGioFile->get_path()) + ")");
 
         pGioFile->copy(pTargetGioFile,
                        Gio::FileCopyFlags::FILE_COPY_NOFOLLOW_SYMLINKS      // copy symlinks as symlinks
@@ -364,7 +555,7 @@ FsGioImpl::move(Debug &d,
         auto pGioFile = getGioFile(fs);
         auto pTargetGioFile = Gio::File::create_for_uri(strTargetPath);
 
-        Debug::Log(FILE_HIGH, "pGioFile->move(" + quote(pGioFile->get_path()) + " to " + quote(pTargetGioFile->get_path()) + ")");
+        DEBUG_LOG(FILE_HIGH, "pGioFile->move(" + quote(pGioFile->get_path()) + " to " + quote(pTargetGioFile->get_path()) + ")");
         pGioFile->move(pTargetGioFile,
                        Gio::FileCopyFlags::FILE_COPY_NOFOLLOW_SYMLINKS      // copy symlinks as symlinks
                         /*| Gio::FileCopyFlags::FILE_COPY_NO_FALLBACK_FOR_MOVE */);
@@ -388,7 +579,7 @@ FsGioImpl::createSubdirectory(const string &strParentPath,
         // To create a new subdirectory via Gio::File, create an empty Gio::File first
         // and then invoke make_directory on it.
         string strPath = strParentPath + "/" + strBasename;
-        Debug::Log(FILE_HIGH, string(__func__) + ": creating directory \"" + strPath + "\"");
+        DEBUG_LOG(FILE_HIGH, string(__func__) + ": creating directory \"" + strPath + "\"");
 
         // The follwing cannot fail.
         Glib::RefPtr<Gio::File> pGioFileNew = Gio::File::create_for_uri(strPath);
@@ -396,11 +587,7 @@ FsGioImpl::createSubdirectory(const string &strParentPath,
         pGioFileNew->make_directory();
         // If we got here, we have a directory.
         auto pGioInfo = this->getFileInfo(pGioFileNew);
-        FsCoreInfo info(0,
-                        0,
-                        pGioInfo->get_attribute_string(G_FILE_ATTRIBUTE_OWNER_USER),
-                        pGioInfo->get_attribute_string(G_FILE_ATTRIBUTE_OWNER_GROUP));
-        pReturn = FsGioDirectory::Create(strBasename, info);
+        pReturn = FsGioDirectory::Create(strBasename, MakeCoreInfo(pGioInfo, 0, 0));
     }
     catch (Gio::Error &e)
     {
@@ -421,7 +608,7 @@ FsGioImpl::createEmptyDocument(const string &strParentPath,
         // To create a new subdirectory via Gio::File, create an empty Gio::File first
         // and then invoke make_directory on it.
         string strPath = strParentPath + "/" + strBasename;
-        Debug::Log(FILE_HIGH, string(__func__) + ": creating directory \"" + strPath + "\"");
+        DEBUG_LOG(FILE_HIGH, string(__func__) + ": creating directory \"" + strPath + "\"");
 
         // The follwing cannot fail.
         Glib::RefPtr<Gio::File> pGioFileNew = Gio::File::create_for_uri(strPath);
@@ -431,11 +618,10 @@ FsGioImpl::createEmptyDocument(const string &strParentPath,
 
         // If we got here, we have a directory.
         auto pGioInfo = this->getFileInfo(pGioFileNew);
-        FsCoreInfo info(0,
-                        pGioInfo->get_attribute_uint64(G_FILE_ATTRIBUTE_TIME_MODIFIED),
-                        pGioInfo->get_attribute_string(G_FILE_ATTRIBUTE_OWNER_USER),
-                        pGioInfo->get_attribute_string(G_FILE_ATTRIBUTE_OWNER_GROUP));
-        pReturn = FsGioFile::Create(strBasename, info);
+        pReturn = FsGioFile::Create(strBasename,
+                                    MakeCoreInfo(pGioInfo,
+                                                 0,
+                                                 pGioInfo->get_attribute_uint64(G_FILE_ATTRIBUTE_TIME_MODIFIED)));
     }
     catch (Gio::Error &e)
     {
@@ -449,14 +635,25 @@ FsGioImpl::createEmptyDocument(const string &strParentPath,
 PGioFile
 FsGioImpl::getGioFile(FsObject &fs)
 {
+    // Gio::File instances only wrap a path and are immutable, so we can keep the one we
+    // created with the object until its path changes.
+    auto pHandle = fs.getBackendHandle();
+    if (pHandle)
+        return *static_pointer_cast<PGioFile>(pHandle);
+
     auto strPath = fs.getPath();
 
-    Debug::Log(FILE_MID, "getting GioFile for path " + quote(strPath));
+    DEBUG_LOG(FILE_MID, "getting GioFile for path " + quote(strPath));
 
+    PGioFile pGioFile;
     if (fs.hasFlag(FSFlag::IS_LOCAL))
-        return Gio::File::create_for_path(strPath.substr(7));
+        pGioFile = Gio::File::create_for_path(strPath.substr(7));
+    else
+        pGioFile = Gio::File::create_for_uri(strPath);
 
-    return Gio::File::create_for_uri(strPath);
+    fs.setBackendHandle(make_shared<PGioFile>(pGioFile));
+
+    return pGioFile;
 }
 
 PFsGioFile
@@ -476,18 +673,31 @@ FsGioImpl::getFile(PFsObject pFS, FSTypeResolved t)
 Glib::RefPtr<Gio::FileInfo>
 FsGioImpl::getFileInfo(PGioFile pGioFile)
 {
-    static string s_comma = string(",");
-    static string s_attrs = string(G_FILE_ATTRIBUTE_STANDARD_TYPE)
-                          + s_comma + string(G_FILE_ATTRIBUTE_STANDARD_SIZE)
-                          + s_comma + string(G_FILE_ATTRIBUTE_OWNER_USER)
-                          + s_comma + string(G_FILE_ATTRIBUTE_OWNER_GROUP)
-                          + s_comma + string(G_FILE_ATTRIBUTE_TIME_MODIFIED);
     // The following can throw Gio::Error.
-    auto pInfo = pGioFile->query_info(s_attrs,
+    auto pInfo = pGioFile->query_info(GetInfoAttributes(pGioFile->has_uri_scheme("file")),
                                       Gio::FileQueryInfoFlags::FILE_QUERY_INFO_NOFOLLOW_SYMLINKS);
     return pInfo;
 }
 
+/* static */
+const string&
+FsGioImpl::GetInfoAttributes(bool fIsLocal)
+{
+    static string s_comma = string(",");
+    static string s_attrs = string(G_FILE_ATTRIBUTE_STANDARD_NAME)
+                          + s_comma + string(G_FILE_ATTRIBUTE_STANDARD_TYPE)
+                          + s_comma + string(G_FILE_ATTRIBUTE_STANDARD_SIZE)
+                          + s_comma + string(G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    static string s_attrsLocal = s_attrs
+                               + s_comma + string(G_FILE_ATTRIBUTE_UNIX_UID)
+                               + s_comma + string(G_FILE_ATTRIBUTE_UNIX_GID)
+                               + s_comma + string(G_FILE_ATTRIBUTE_UNIX_INODE);
+    static string s_attrsRemote = s_attrs
+                                + s_comma + string(G_FILE_ATTRIBUTE_OWNER_USER)
+                                + s_comma + string(G_FILE_ATTRIBUTE_OWNER_GROUP);
+    return (fIsLocal) ? s_attrsLocal : s_attrsRemote;
+}
+
 /* static */
 void
 FsGioImpl::Init()
@@ -502,8 +712,21 @@ FsGioImpl::Init()
  *
  **************************************************************************/
 
-uint64_t g_cbTotalPixbufs = 0;
-Mutex    g_mutexPixbufsSize;
+atomic<uint64_t> g_cbTotalPixbufs(0);
+
+/**
+ *  The thumbnail data of a file is protected by one of these mutexes, picked by the
+ *  file's address, instead of FsLock, so that thumbnailer threads and the GUI only
+ *  contend when they happen to work on files which share a stripe.
+ */
+#define THUMB_MUTEX_STRIPES     64
+std::mutex g_amutexThumbData[THUMB_MUTEX_STRIPES];
+
+static std::mutex&
+GetThumbDataMutex(const FsGioFile *pFile)
+{
+    return g_amutexThumbData[((uintptr_t)pFile / sizeof(void*)) % THUMB_MUTEX_STRIPES];
+}
 
 struct PixbufWithStats
 {
@@ -511,13 +734,11 @@ public:
     PixbufWithStats(PPixbuf p)
         : _pPixbuf(p)
     {
-        Lock l(g_mutexPixbufsSize);
         g_cbTotalPixbufs += _pPixbuf->get_byte_length();
     }
 
     ~PixbufWithStats()
     {
-        Lock l(g_mutexPixbufsSize);
         g_cbTotalPixbufs -= _pPixbuf->get_byte_length();
     }
 
@@ -541,20 +762,21 @@ struct FsGioFile::ThumbData
 PFsGioFile
 FsGioFile::Create(const string &strBasename, const FsCoreInfo &info)
 {
-    /* This nasty trickery is necessary to make make_shared work with a protected constructor. */
+    /* This nasty trickery is necessary to make allocate_shared work with a protected constructor. */
     class Derived : public FsGioFile
     {
     public:
         Derived(const string &strBasename, const FsCoreInfo &info) : FsGioFile(strBasename, info) { }
     };
 
-    return make_shared<Derived>(strBasename, info);
+    // Populating creates these by the thousands, so take them and their control blocks from the slab pool.
+    return allocate_shared<Derived>(SlabAllocator<Derived>(), strBasename, info);
 }
 
 /* virtual */
 FsGioFile::~FsGioFile()
 {
-    FsLock lock;
+    // No lock needed: nobody else can have a reference to us any more.
     if (_pThumbData)
         delete _pThumbData;
     if (_psvIcons)
@@ -565,7 +787,7 @@ FsGioFile::~FsGioFile()
 void
 FsGioFile::setThumbnail(uint32_t thumbsize, PPixbuf ppb)
 {
-    FsLock lock;
+    std::lock_guard<std::mutex> lock(GetThumbDataMutex(this));
     if (ppb)
     {
         if (!_pThumbData)
@@ -588,7 +810,7 @@ FsGioFile::getThumbnail(uint32_t thumbsize) const
 {
     PPixbuf ppb;
 
-    FsLock lock;
+    std::lock_guard<std::mutex> lock(GetThumbDataMutex(this));
     if (_pThumbData)
     {
         auto it = _pThumbData->mapThumbnails.find(thumbsize);
@@ -603,7 +825,6 @@ FsGioFile::getThumbnail(uint32_t thumbsize) const
 uint64_t
 FsGioFile::GetThumbnailCacheSize()
 {
-    Lock l(g_mutexPixbufsSize);
     return g_cbTotalPixbufs;
 }
 
@@ -618,14 +839,14 @@ FsGioFile::GetThumbnailCacheSize()
 PFsGioDirectory
 FsGioDirectory::Create(const string &strBasename, const FsCoreInfo &info)
 {
-    /* This nasty trickery is necessary to make make_shared work with a protected constructor. */
+    /* This nasty trickery is necessary to make allocate_shared work with a protected constructor. */
     class Derived : public FsGioDirectory
     {
     public:
         Derived(const string &strBasename, const FsCoreInfo &info) : FsGioDirectory(strBasename, info) { }
     };
 
-    return make_shared<Derived>(strBasename, info);
+    return allocate_shared<Derived>(SlabAllocator<Derived>(), strBasename, info);
 }
 
 
@@ -641,7 +862,7 @@ RootDirectory::RootDirectory(const string &strScheme, const FsCoreInfo &info)
                   info),
       _strScheme(strScheme)
 {
-    _fl = FSFlag::IS_ROOT_DIRECTORY;
+    _fl.set(FSFlag::IS_ROOT_DIRECTORY);
 }
 
 /*static */
@@ -675,7 +896,7 @@ RootDirectory::Get(const string &strScheme)        //<! in: URI scheme (e.g. "fi
             Derived(const string &strScheme, const FsCoreInfo &info) : RootDirectory(strScheme, info) { }
         };
 
-        FsCoreInfo info(0, 0, "", "");
+        FsCoreInfo info(0, 0, 0, 0);
         pReturn = make_shared<Derived>(strScheme, info);
         s_mapRootDirectories[strScheme] = pReturn;
 
@@ -723,7 +944,7 @@ FsGioSpecial::Create(const string &strBasename)
 void
 FsGioMountable::GetMountables(FsGioMountablesVector &llMountables)
 {
-    Debug d(MOUNTS, "FsGioMountable::GetMountables()");
+    DEBUG_SCOPE(d, MOUNTS, "FsGioMountable::GetMountables()");
     Glib::RefPtr<Gio::VolumeMonitor> pVolm = Gio::VolumeMonitor::get();
     if (pVolm)
     {
@@ -740,12 +961,12 @@ FsGioMountable::GetMountables(FsGioMountablesVector &llMountables)
         std::list<Glib::RefPtr<Gio::Drive>> llDrives = pVolm->get_connected_drives();
         for (auto pDrive : llDrives)
         {
-            Debug::Log(MOUNTS, "Drive: " + quote(pDrive->get_name()) + ", has volumes: " + string(pDrive->has_volumes() ? "yes" : "no"));
+            DEBUG_LOG(MOUNTS, "Drive: " + quote(pDrive->get_name()) + ", has volumes: " + string(pDrive->has_volumes() ? "yes" : "no"));
 
             for (auto strKind : pDrive->enumerate_identifiers())
             {
                 string strId = pDrive->get_identifier(strKind);
-                Debug::Log(MOUNTS, "  Identifier " + quote(strKind) + ": " + quote(strId));
+                DEBUG_LOG(MOUNTS, "  Identifier " + quote(strKind) + ": " + quote(strId));
             }
         }
 
@@ -767,7 +988,7 @@ FsGioMountable::GetMountables(FsGioMountablesVector &llMountables)
             if (pDrive)
                 strDrive = pDrive->get_name();
 
-            Debug::Log(MOUNTS, "Volume: " + pVolume->get_name() + ", drive name: " + quote(strDrive));
+            DEBUG_LOG(MOUNTS, "Volume: " + pVolume->get_name() + ", drive name: " + quote(strDrive));
 
             // This returns nullptr if the volume is not mounted.
             auto pMount = pVolume->get_mount();
@@ -783,7 +1004,7 @@ FsGioMountable::GetMountables(FsGioMountablesVector &llMountables)
                     {
                         llMountables.push_back(Create(pMount->get_name(),
                                                       static_pointer_cast<FsGioDirectory>(pDir)));
-                        Debug::Log(MOUNTS, "  Mount: " + quote(pMount->get_name()) + " mounted at: " + quote(strMountedAt));
+                        DEBUG_LOG(MOUNTS, "  Mount: " + quote(pMount->get_name()) + " mounted at: " + quote(strMountedAt));
                     }
                 }
             }
@@ -822,13 +1043,22 @@ FileContents::FileContents(FsGioFile &file,
         auto pGioFile = g_pFsGioImpl->getGioFile(file);
         auto pStream = pGioFile->read();
         Glib::RefPtr<Gio::FileInfo> pInfo = pStream->query_info(G_FILE_ATTRIBUTE_STANDARD_SIZE);
-        if (!(_size = cbMax))
-            _size = pInfo->get_attribute_uint64(G_FILE_ATTRIBUTE_STANDARD_SIZE);
+        size_t cb = pInfo->get_attribute_uint64(G_FILE_ATTRIBUTE_STANDARD_SIZE);
+        if (    (cbMax)
+             && (cbMax < cb)
+           )
+            cb = cbMax;
 
-        if (!(_pData = (char*)malloc(_size)))
-            throw FSException("Not enough memory");
-        gsize zRead;
-        pStream->read_all(_pData, _size, zRead);
+        if (cb)
+        {
+            char *pData;
+            if (!(pData = (char*)malloc(cb)))
+                throw FSException("Not enough memory");
+            _pData = pData;
+            gsize zRead;
+            pStream->read_all(pData, cb, zRead);
+            _size = zRead;
+        }
         pStream->close();
     }
     catch (Gio::Error &e)
@@ -840,6 +1070,116 @@ FileContents::FileContents(FsGioFile &file,
 FileContents::~FileContents()
 {
     if (_pData)
-        free(_pData);
+        free((void*)_pData);
+}
+
+
+/***************************************************************************
+ *
+ *  FileStream
+ *
+ **************************************************************************/
+
+FileStream::FileStream(FsGioFile &file)
+{
+    try
+    {
+        auto pGioFile = g_pFsGioImpl->getGioFile(file);
+        if (pGioFile->is_native())
+        {
+            string strPath = pGioFile->get_path();
+            if (!strPath.empty())
+            {
+                if ((_fd = open(strPath.c_str(), O_RDONLY | O_CLOEXEC)) == -1)
+                    throw ErrnoException("Cannot open " + quote(strPath));
+
+                struct stat st;
+                if (    (fstat(_fd, &st) == 0)
+                     && (S_ISREG(st.st_mode))
+                   )
+                {
+                    // Doubles the readahead window, so the next chunks are on their way
+                    // while the caller is busy with the current one.
+                    posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                    _strPath = strPath;
+                    return;
+                }
+
+                // Leave anything else to Gio.
+                close(_fd);
+                _fd = -1;
+            }
+        }
+
+        _pStream = pGioFile->read();
+    }
+    catch (Gio::Error &e)
+    {
+        throw FSException(e.what());
+    }
 }
 
+FileStream::~FileStream()
+{
+    if (_fd != -1)
+        close(_fd);
+    if (_pStream)
+    {
+        try
+        {
+            _pStream->close();
+        }
+        catch (Gio::Error &e)
+        {
+            // Nothing we can do about it, and we must not throw from here.
+        }
+    }
+}
+
+bool
+FileStream::next(const char *&pData,
+                 size_t &cb)
+{
+    if (_buf.empty())
+        _buf.resize(CB_CHUNK);
+
+    size_t cbRead = 0;
+    if (_fd != -1)
+    {
+        // Fill the whole chunk unless the file ends, like read_all() below. A file that
+        // someone truncates meanwhile simply ends early.
+        while (cbRead < CB_CHUNK)
+        {
+            ssize_t cb2 = read(_fd, _buf.data() + cbRead, CB_CHUNK - cbRead);
+            if (cb2 < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw ErrnoException("Cannot read " + quote(_strPath));
+            }
+            if (!cb2)
+                break;
+            cbRead += cb2;
+        }
+    }
+    else
+    {
+        try
+        {
+            gsize zRead;
+            _pStream->read_all(_buf.data(), CB_CHUNK, zRead);
+            cbRead = zRead;
+        }
+        catch (Gio::Error &e)
+        {
+            throw FSException(e.what());
+        }
+    }
+
+    if (!cbRead)
+        return false;
+
+    pData = _buf.data();
+    cb = cbRead;
+    return true;
+}
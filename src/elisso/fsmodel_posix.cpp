@@ -0,0 +1,728 @@
+/*
+ * elisso -- fast and friendly gtkmm file manager. (C) 2016--2017 Baubadil GmbH.
+ *
+ * elisso is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the elisso main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#include "elisso/fsmodel_posix.h"
+#include "elisso/fswatcher.h"
+
+#include "xwp/debug.h"
+#include "xwp/except.h"
+#include "xwp/fssnapshot.h"
+#include "xwp/stringhelp.h"
+#include "xwp/statring.h"
+
+#include <deque>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/magic.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+/***************************************************************************
+ *
+ *  Helpers
+ *
+ **************************************************************************/
+
+/**
+ *  Strips the "file://" prefix from an IS_LOCAL path so it can be given to the kernel.
+ */
+static string MakeLocalPath(const string &strPath)
+{
+    return strPath.substr(7);
+}
+
+/**
+ *  Returns true if directories on the file system described by sfs reliably get a new
+ *  modification time whenever an entry is added, removed or renamed, so that
+ *  FsSnapshotStamp can tell whether they have changed. Pseudo file systems like /proc,
+ *  /sys or cgroupfs never update it, and NFS and FUSE mounts may report a cached one, so
+ *  this only trusts the common local disk file systems and tmpfs.
+ */
+static bool HasReliableDirectoryTimes(const struct statfs &sfs)
+{
+    switch ((uint32_t)sfs.f_type)
+    {
+        case EXT4_SUPER_MAGIC:          // also ext2 and ext3
+        case XFS_SUPER_MAGIC:
+        case BTRFS_SUPER_MAGIC:
+        case F2FS_SUPER_MAGIC:
+        case TMPFS_MAGIC:
+            return true;
+    }
+    return false;
+}
+
+/**
+ *  What we need from a stat for FsCoreInfo, filled by StatAt() with either statx()
+ *  or fstatat(), depending on what the C library has.
+ */
+struct PosixStat
+{
+    mode_t      mode;
+    uint64_t    cbSize;
+    uint64_t    uLastModified;
+    uint32_t    uid;
+    uint32_t    gid;
+    uint64_t    uInode;
+};
+
+/**
+ *  Queue depth for the io_uring statx batches in getNextChild(), or 0 to always stat
+ *  sequentially. See FsPosixImpl::Init().
+ */
+uint g_uStatxQueueDepth = 0;
+
+/**
+ *  Whether monitored local directories are watched through FsWatcher. See FsPosixImpl::Init().
+ */
+bool g_fWatchDirectories = false;
+
+/**
+ *  Default memory budget for awake objects in megabytes, see FsPosixImpl::Init().
+ */
+#define DEFAULT_CACHE_MB        256
+
+/**
+ *  Directory buffers with fewer entries than this are stat'ed sequentially even if
+ *  io_uring is enabled since setting up the ring costs more than it saves.
+ */
+#define MIN_STATX_BATCH     32
+
+/**
+ *  Stats strBasename relative to the directory file descriptor fdDir without following
+ *  symlinks. Returns 0 on success or the errno value otherwise.
+ */
+static int StatAt(int fdDir,
+                  const string &strBasename,
+                  PosixStat &st)
+{
+#ifdef STATX_TYPE
+    // statx() allows us to only ask for the fields we actually use, which can
+    // save the file system some work (e.g. on network file systems).
+    struct statx stx;
+    if (0 == statx(fdDir,
+                   strBasename.c_str(),
+                   AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+                   STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_UID | STATX_GID | STATX_INO,
+                   &stx))
+    {
+        st.mode = stx.stx_mode;
+        st.cbSize = stx.stx_size;
+        st.uLastModified = stx.stx_mtime.tv_sec;
+        st.uid = stx.stx_uid;
+        st.gid = stx.stx_gid;
+        st.uInode = stx.stx_ino;
+        return 0;
+    }
+    if (errno != ENOSYS)
+        return errno;
+    // Kernel too old: fall through to fstatat().
+#endif
+
+    struct stat s;
+    if (0 != fstatat(fdDir,
+                     strBasename.c_str(),
+                     &s,
+                     AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT))
+        return errno;
+
+    st.mode = s.st_mode;
+    st.cbSize = s.st_size;
+    st.uLastModified = s.st_mtim.tv_sec;
+    st.uid = s.st_uid;
+    st.gid = s.st_gid;
+    st.uInode = s.st_ino;
+    return 0;
+}
+
+/**
+ *  Returns the FSType for the given DT_* value from a directory entry, or
+ *  FSType::UNINITIALIZED for DT_UNKNOWN.
+ */
+static FSType TypeFromDirent(unsigned char uDirentType)
+{
+    switch (uDirentType)
+    {
+        case DT_UNKNOWN:
+            return FSType::UNINITIALIZED;
+        case DT_REG:
+            return FSType::FILE;
+        case DT_DIR:
+            return FSType::DIRECTORY;
+        case DT_LNK:
+            return FSType::SYMLINK;
+    }
+
+    return FSType::SPECIAL;
+}
+
+
+/***************************************************************************
+ *
+ *  FsDirEnumeratorPosix
+ *
+ **************************************************************************/
+
+#define DIRENTS_BUF_SIZE  (32 * 1024)
+
+class FsDirEnumeratorPosix : public FsDirEnumeratorBase
+{
+public:
+    FsDirEnumeratorPosix(int fd_, const string &strPath_, bool fNamesOnly_, bool fDirectoriesOnly_)
+        : fd(fd_),
+          strPath(strPath_),
+          fNamesOnly(fNamesOnly_),
+          fDirectoriesOnly(fDirectoriesOnly_)
+    { }
+
+    virtual ~FsDirEnumeratorPosix()
+    {
+        if (fd != -1)
+            close(fd);
+    }
+
+    int         fd;
+    string      strPath;        // For error messages only.
+    bool        fNamesOnly;
+    bool        fDirectoriesOnly;
+    // getdents64() fills this with struct dirent64 records, which must be 8-byte aligned.
+    uint64_t    aBuf[DIRENTS_BUF_SIZE / sizeof(uint64_t)];
+
+    // Objects for the current getdents64() buffer, which getNextChild() hands out one by one.
+    // With fNamesOnly, pTemp is nullptr and id has what getdents64() said about the entry.
+    struct ReadyEntry
+    {
+        string          strName;
+        PFsObject       pTemp;
+        FsDirEntryID    id;
+    };
+    deque<ReadyEntry> dqReady;
+
+    // With fDirectoriesOnly, the symlinks, which are only handed out after all directories.
+    StatxRequestsVector vSymlinks;
+    bool        fEnd = false;
+
+    PStatxRing  pRing;          // Created on the first buffer that is worth it.
+    bool        fRingFailed = false;
+
+    // The directory's stamp from before reading it, for writing a snapshot afterwards.
+    bool            fHaveStamp = false;
+    FsSnapshotStamp stamp;
+};
+
+
+/***************************************************************************
+ *
+ *  FsDirEnumeratorSnapshot
+ *
+ **************************************************************************/
+
+/**
+ *  Enumerator that hands out the entries of a valid FsSnapshot instead of reading
+ *  the directory.
+ */
+class FsDirEnumeratorSnapshot : public FsDirEnumeratorBase
+{
+public:
+    FsDirEnumeratorSnapshot(PFsSnapshot pSnapshot_)
+        : pSnapshot(pSnapshot_)
+    { }
+
+    PFsSnapshot         pSnapshot;
+    FsSnapshot::Entry   entry;
+};
+
+
+/***************************************************************************
+ *
+ *  FsPosixImpl
+ *
+ **************************************************************************/
+
+/* virtual */
+PFsObject
+FsPosixImpl::makeAwake(const string &strParentPath,
+                       const string &strBasename,
+                       bool fIsLocal) /* override */
+{
+    if (!fIsLocal)
+        return FsGioImpl::makeAwake(strParentPath, strBasename, fIsLocal);
+
+    string strFullPath2 = strParentPath + "/" + strBasename;
+    DEBUG_SCOPE(d, FILE_LOW, "FsPosixImpl::makeAwake(" + quote(strFullPath2) + ")");
+
+    return makeAwakeAt(AT_FDCWD,
+                       MakeLocalPath(strFullPath2),
+                       strFullPath2);
+}
+
+/* virtual */
+PFsDirEnumeratorBase
+FsPosixImpl::beginEnumerateChildren(FsContainer &cnr,
+                                    bool fNamesOnly,
+                                    bool fDirectoriesOnly) /* override */
+{
+    if (!cnr._refBase.hasFlag(FSFlag::IS_LOCAL))
+        return FsGioImpl::beginEnumerateChildren(cnr, fNamesOnly, fDirectoriesOnly);
+
+    string strPath = MakeLocalPath(cnr._refBase.getPath());
+    int fd = open(strPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        throw ErrnoException("Cannot open directory " + quote(strPath));
+
+    // Take the stamp before reading the directory, so that a change while we read it
+    // makes onContentsPopulated() skip the snapshot. Without a stamp that can be trusted,
+    // there are no snapshots for the directory at all.
+    struct statfs sfs;
+    struct stat st;
+    FsSnapshotStamp stamp;
+    bool fHaveStamp = false;
+    if (    (FsSnapshot::IsEnabled())
+         && (fstatfs(fd, &sfs) == 0)
+         && (HasReliableDirectoryTimes(sfs))
+         && (fstat(fd, &st) == 0)
+       )
+    {
+        stamp = FsSnapshotStamp::FromStat(st);
+        fHaveStamp = true;
+
+        PFsSnapshot pSnapshot;
+        if (    (!cnr._refBase.hasFlag(FSFlag::REFRESH_FROM_DISK))
+             && ((pSnapshot = FsSnapshot::Open(strPath, stamp)))
+           )
+        {
+            close(fd);
+            cnr._refBase.setFlag(FSFlag::POPULATED_FROM_CACHE);
+            return make_shared<FsDirEnumeratorSnapshot>(pSnapshot);
+        }
+    }
+
+    auto pEnum = make_shared<FsDirEnumeratorPosix>(fd, strPath, fNamesOnly, fDirectoriesOnly);
+    pEnum->fHaveStamp = fHaveStamp;
+    pEnum->stamp = stamp;
+    return pEnum;
+}
+
+/* virtual */
+bool
+FsPosixImpl::getNextChild(PFsDirEnumeratorBase pEnum,
+                          string &strBasename,
+                          PFsObject &pTemp) /* override */
+{
+    FsDirEnumeratorPosix *pEnum2 = dynamic_cast<FsDirEnumeratorPosix*>(&*pEnum);
+    if (!pEnum2)
+    {
+        FsDirEnumeratorSnapshot *pSnap = dynamic_cast<FsDirEnumeratorSnapshot*>(&*pEnum);
+        if (!pSnap)
+            return FsGioImpl::getNextChild(pEnum, strBasename, pTemp);
+
+        // We have all the metadata, so create the objects even if only the names were
+        // asked for; this is cheaper than having makeAwake() stat them.
+        auto &e = pSnap->entry;
+        if (!pSnap->pSnapshot->getNext(e))
+            return false;
+        strBasename = e.strName;
+        pTemp = createObject(e.type,
+                             e.strName,
+                             FsCoreInfo(e.cbSize,
+                                        e.uLastModified,
+                                        FsIdentities::FromUid(e.uid),
+                                        FsIdentities::FromGid(e.gid)));
+        return true;
+    }
+
+    while (pEnum2->dqReady.empty())
+    {
+        if (pEnum2->fEnd)
+            return false;
+
+        long cbBuf = syscall(SYS_getdents64,
+                             pEnum2->fd,
+                             pEnum2->aBuf,
+                             sizeof(pEnum2->aBuf));
+        if (cbBuf < 0)
+            throw ErrnoException("Cannot read directory " + quote(pEnum2->strPath));
+        if (cbBuf == 0)
+        {
+            // End of directory: hand out the symlinks that were held back, if any.
+            pEnum2->fEnd = true;
+            queueEntries(*pEnum2, pEnum2->vSymlinks);
+            continue;
+        }
+
+        StatxRequestsVector vRequests;
+        for (long ofs = 0; ofs < cbBuf; )
+        {
+            auto pDirent = reinterpret_cast<struct dirent64*>((char*)pEnum2->aBuf + ofs);
+            ofs += pDirent->d_reclen;
+
+            const char *pcszName = pDirent->d_name;
+            if (    (pcszName[0] == '.')
+                 && (    (pcszName[1] == '\0')
+                      || ((pcszName[1] == '.') && (pcszName[2] == '\0'))
+                    )
+               )
+                continue;
+
+            if (pEnum2->fDirectoriesOnly)
+            {
+                // Most file systems tell us the type of each entry, so the entries that cannot
+                // be folders need not be stat'ed at all. Symlinks are held back until the end
+                // so that Get::FIRST_FOLDER_ONLY usually finds a real directory before it
+                // has to follow any of them. Some file systems (and older XFS) always report
+                // DT_UNKNOWN, and those entries must be stat'ed to find out.
+                if (pDirent->d_type == DT_LNK)
+                {
+                    pEnum2->vSymlinks.emplace_back(pcszName, pDirent->d_ino, pDirent->d_type);
+                    continue;
+                }
+                if (    (pDirent->d_type != DT_DIR)
+                     && (pDirent->d_type != DT_UNKNOWN)
+                   )
+                    continue;
+            }
+
+            vRequests.emplace_back(pcszName, pDirent->d_ino, pDirent->d_type);
+        }
+
+        queueEntries(*pEnum2, vRequests);
+    }
+
+    auto &e = pEnum2->dqReady.front();
+    strBasename = e.strName;
+    pTemp = e.pTemp;
+    pEnum2->idCurrent = e.id;
+    pEnum2->dqReady.pop_front();
+    return true;
+}
+
+/**
+ *  Queues the given entries in the enumerator, only by name if it was created with
+ *  fNamesOnly, or as objects with statBatch() otherwise.
+ */
+void
+FsPosixImpl::queueEntries(FsDirEnumeratorPosix &en,
+                          StatxRequestsVector &vRequests)
+{
+    if (en.fNamesOnly)
+        for (auto &req : vRequests)
+        {
+            FsDirEntryID id;
+            id.uInode = req.uInode;
+            id.type = TypeFromDirent(req.uDirentType);
+            en.dqReady.push_back({ req.strName, nullptr, id });
+        }
+    else
+        statBatch(en, vRequests);
+}
+
+/**
+ *  Stats all entries of one getdents64() buffer and queues the resulting objects in the
+ *  enumerator. With an io_uring queue depth configured, this submits the statx calls for
+ *  the whole buffer at once and creates the objects as the completions arrive; otherwise
+ *  it stats one entry after the other.
+ *
+ *  Entries that have been deleted between getdents64() and the stat are not an error;
+ *  they are simply gone.
+ */
+void
+FsPosixImpl::statBatch(FsDirEnumeratorPosix &en,
+                       StatxRequestsVector &vRequests)
+{
+#ifdef STATX_TYPE
+    if (    (g_uStatxQueueDepth)
+         && (vRequests.size() >= MIN_STATX_BATCH)
+         && (!en.fRingFailed)
+       )
+    {
+        if (!en.pRing)
+            if (!(en.pRing = StatxRing::Create(g_uStatxQueueDepth)))
+                en.fRingFailed = true;
+
+        if (en.pRing)
+        {
+            en.pRing->statAll(en.fd,
+                              vRequests,
+                              [this, &en](StatxRequest &req)
+            {
+                if (req.rc)
+                {
+                    if (req.rc == ENOENT)
+                        return;
+                    if (req.rc == EINVAL)
+                    {
+                        // The ring cannot do statx after all, although StatxRing::Create()
+                        // probes for it. Stat this entry without it, and the next buffers too.
+                        en.fRingFailed = true;
+                        PFsObject p;
+                        if ((p = makeAwakeAt(en.fd, req.strName, "")))
+                            en.dqReady.push_back({ req.strName, p, FsDirEntryID() });
+                        return;
+                    }
+                    errno = req.rc;
+                    throw ErrnoException("Cannot stat " + quote(en.strPath + "/" + req.strName));
+                }
+
+                PosixStat st;
+                st.mode = req.stx.stx_mode;
+                st.cbSize = req.stx.stx_size;
+                st.uLastModified = req.stx.stx_mtime.tv_sec;
+                st.uid = req.stx.stx_uid;
+                st.gid = req.stx.stx_gid;
+                st.uInode = req.stx.stx_ino;
+                en.dqReady.push_back({ req.strName,
+                                       makeAwakeFromStat(req.strName, st),
+                                       FsDirEntryID() });
+            });
+            return;
+        }
+    }
+#endif
+
+    for (auto &req : vRequests)
+    {
+        PFsObject p;
+        if ((p = makeAwakeAt(en.fd, req.strName, "")))
+            en.dqReady.push_back({ req.strName, p, FsDirEntryID() });
+    }
+}
+
+/**
+ *  Returns a hash of the directory's FsSnapshotStamp, which takes a statfs() and a stat(),
+ *  or 0 if it has been modified too recently to tell or is on a file system whose
+ *  directory times cannot be trusted (see HasReliableDirectoryTimes()).
+ */
+/* virtual */
+uint64_t
+FsPosixImpl::getContentsStamp(FsContainer &cnr) /* override */
+{
+    if (!cnr._refBase.hasFlag(FSFlag::IS_LOCAL))
+        return FsGioImpl::getContentsStamp(cnr);
+
+    string strPath = MakeLocalPath(cnr._refBase.getPath());
+    struct statfs sfs;
+    if (    (statfs(strPath.c_str(), &sfs) != 0)
+         || (!HasReliableDirectoryTimes(sfs))
+       )
+        return 0;
+
+    struct stat st;
+    if (stat(strPath.c_str(), &st) != 0)
+        return 0;
+
+    FsSnapshotStamp stamp = FsSnapshotStamp::FromStat(st);
+    if (!stamp.isSettled())
+        return 0;
+
+    return stamp.getHash();
+}
+
+/**
+ *  Writes a snapshot of the directory that was just read through pEnum, unless it has
+ *  changed in the meantime or was served from a snapshot in the first place.
+ */
+/* virtual */
+void
+FsPosixImpl::onContentsPopulated(FsContainer &cnr,
+                                 PFsDirEnumeratorBase pEnum,
+                                 const FsVector &vContents) /* override */
+{
+    FsDirEnumeratorPosix *pEnum2 = dynamic_cast<FsDirEnumeratorPosix*>(&*pEnum);
+    if (    (!pEnum2)
+         || (!pEnum2->fHaveStamp)
+       )
+        return;
+
+    struct stat st;
+    if (fstat(pEnum2->fd, &st) != 0)
+        return;
+    FsSnapshotStamp stamp = FsSnapshotStamp::FromStat(st);
+    if (stamp != pEnum2->stamp)
+    {
+        DEBUG_LOG(FOLDER_POPULATE_HIGH, quote(pEnum2->strPath) + " changed while populating, not writing snapshot");
+        return;
+    }
+
+    // Otherwise the snapshot could look valid after the directory has changed.
+    if (!stamp.isSettled())
+        return;
+
+    FsSnapshot::Write(pEnum2->strPath, stamp, vContents);
+}
+
+/* virtual */
+string
+FsPosixImpl::getSymlinkContents(FsSymlink &ln) /* override */
+{
+    if (!ln.hasFlag(FSFlag::IS_LOCAL))
+        return FsGioImpl::getSymlinkContents(ln);
+
+    string strPath = MakeLocalPath(ln.getPath());
+    vector<char> buf(FS_BUF_LEN);
+    while (true)
+    {
+        ssize_t cb = readlinkat(AT_FDCWD, strPath.c_str(), buf.data(), buf.size());
+        if (cb < 0)
+            throw ErrnoException("Cannot read symlink " + quote(strPath));
+        // readlink() silently truncates, so retry with a bigger buffer if it's full.
+        if ((size_t)cb < buf.size())
+            return string(buf.data(), cb);
+        buf.resize(buf.size() * 2);
+    }
+}
+
+/**
+ *  Starts watching the directory with inotify when it gets its first monitor.
+ */
+/* virtual */
+void
+FsPosixImpl::onMonitoringStarted(FsContainer &cnr) /* override */
+{
+    FsWatcher *pWatcher;
+    if (    (g_fWatchDirectories)
+         && (cnr._refBase.hasFlag(FSFlag::IS_LOCAL))
+         && ((pWatcher = FsWatcher::Get()))
+       )
+        pWatcher->addWatch(cnr, MakeLocalPath(cnr._refBase.getPath()));
+}
+
+/* virtual */
+void
+FsPosixImpl::onMonitoringStopped(FsContainer &cnr) /* override */
+{
+    FsWatcher *pWatcher;
+    if (    (g_fWatchDirectories)
+         && ((pWatcher = FsWatcher::Get()))
+       )
+        pWatcher->removeWatch(cnr);
+}
+
+/* static */
+void
+FsPosixImpl::Init()
+{
+    const char *pcsz;
+
+    // Snapshots of directory listings under $XDG_CACHE_HOME, unless ELISSO_SNAPSHOTS=0.
+    if (    (!(pcsz = getenv("ELISSO_SNAPSHOTS")))
+         || (atoi(pcsz))
+       )
+    {
+        string strCache;
+        if (    ((pcsz = getenv("XDG_CACHE_HOME")))
+             && (*pcsz)
+           )
+            strCache = pcsz;
+        else if ((pcsz = getenv("HOME")))
+            strCache = string(pcsz) + "/.cache";
+        if (!strCache.empty())
+            FsSnapshot::Init(strCache + "/elisso/snapshots");
+    }
+
+    // Evict unused objects beyond an estimated 256 MB, or ELISSO_CACHE_MB (0 means never).
+    uint64_t cMB = DEFAULT_CACHE_MB;
+    if ((pcsz = getenv("ELISSO_CACHE_MB")))
+        cMB = strtoull(pcsz, nullptr, 10);
+    FsContainer::SetMemoryBudget(cMB * 1024 * 1024);
+
+    // inotify watches for monitored directories, unless ELISSO_WATCH=0.
+    g_fWatchDirectories =    (!(pcsz = getenv("ELISSO_WATCH")))
+                          || (atoi(pcsz));
+
+#ifdef USE_IO_URING
+    // Batched statx through io_uring mostly pays off with high latencies (NFS, cold caches,
+    // spinning disks); with everything in the page cache, the io_uring worker threads are
+    // slower than plain statx() calls. The queue depth can be tuned or set to 0 to disable
+    // it through the environment.
+    g_uStatxQueueDepth = 64;
+    if ((pcsz = getenv("ELISSO_STATX_QUEUE_DEPTH")))
+        g_uStatxQueueDepth = atoi(pcsz);
+#endif
+
+    g_pFsGioImpl = new FsPosixImpl();
+}
+
+/* static */
+void
+FsPosixImpl::SetStatxQueueDepth(uint uDepth)
+{
+#ifdef USE_IO_URING
+    g_uStatxQueueDepth = uDepth;
+#else
+    (void)uDepth;
+#endif
+}
+
+/* static */
+uint
+FsPosixImpl::GetStatxQueueDepth()
+{
+    return g_uStatxQueueDepth;
+}
+
+/**
+ *  Stats the given entry relative to fdDir (which can be AT_FDCWD if strBasename is
+ *  a full path) and creates an FsObject from it via FsGioImpl::createObject().
+ *
+ *  If strPathForErrors is empty, this returns nullptr if the file does not exist;
+ *  otherwise it throws, like FsGioImpl::makeAwake() does.
+ */
+PFsObject
+FsPosixImpl::makeAwakeAt(int fdDir,
+                         const string &strBasename,
+                         const string &strPathForErrors)
+{
+    PosixStat st;
+    int rc;
+    if ((rc = StatAt(fdDir, strBasename, st)))
+    {
+        if ((rc == ENOENT) && strPathForErrors.empty())
+            return nullptr;
+        errno = rc;
+        throw ErrnoException("Cannot stat " + quote(strPathForErrors.empty() ? strBasename : strPathForErrors));
+    }
+
+    // For makeAwake() with a full path, strBasename is the full path, but the object needs the last particle.
+    size_t p = strBasename.rfind('/');
+    if (p != string::npos)
+        return makeAwakeFromStat(strBasename.substr(p + 1), st);
+
+    return makeAwakeFromStat(strBasename, st);
+}
+
+/**
+ *  Creates the FsObject for the given stat data via FsGioImpl::createObject(). This
+ *  does no I/O; owner names are only looked up by FsIdentities when they are displayed.
+ */
+PFsObject
+FsPosixImpl::makeAwakeFromStat(const string &strName,
+                               const PosixStat &st)
+{
+    FSType t;
+    if (S_ISREG(st.mode))
+        t = FSType::FILE;
+    else if (S_ISDIR(st.mode))
+        t = FSType::DIRECTORY;
+    else if (S_ISLNK(st.mode))
+        t = FSType::SYMLINK;
+    else
+        t = FSType::SPECIAL;
+
+    FsCoreInfo info(st.cbSize,
+                    st.uLastModified,
+                    FsIdentities::FromUid(st.uid),
+                    FsIdentities::FromGid(st.gid),
+                    st.uInode);
+    return createObject(t, strName, info);
+}
@@ -0,0 +1,467 @@
+/*
+ * elisso -- fast and friendly gtkmm file manager. (C) 2016--2017 Baubadil GmbH.
+ *
+ * elisso is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the elisso main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#include "elisso/fswatcher.h"
+
+#include "elisso/worker.h"
+
+#include "xwp/debug.h"
+#include "xwp/except.h"
+#include "xwp/stringhelp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <set>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+
+/***************************************************************************
+ *
+ *  Globals
+ *
+ **************************************************************************/
+
+/**
+ *  The events we want for each watched directory. IN_MODIFY comes for every write(), but
+ *  the bursts are merged anyway, and without it, files that are kept open (logs) would
+ *  not be updated until they are closed.
+ */
+#define WATCH_EVENTS        (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_ONLYDIR | IN_EXCL_UNLINK)
+
+/**
+ *  Changes are processed once no new event has arrived for this many milliseconds...
+ */
+#define DEBOUNCE_MS             100
+
+/**
+ *  ...but at least this often while events keep coming in.
+ */
+#define MAX_DELAY_MS            1000
+
+/**
+ *  Directories with more changed names than this in one batch are revalidated as a whole,
+ *  which is cheaper than waking up every name separately.
+ */
+#define MAX_NAMES_PER_DIR       1000
+
+/**
+ *  The changes to one container, which the watcher thread has applied to the contents and
+ *  hands to the GUI thread for notifying the monitors.
+ */
+struct FsWatchResult
+{
+    struct Renamed
+    {
+        PFsObject   pFS;
+        string      strOldName;
+        string      strNewName;
+    };
+
+    PFsObject           pObject;        // Keeps the container alive until the GUI thread is done.
+    FsContainer         *pCnr;
+    vector<Renamed>     vRenamed;
+    FsVector            vRemoved;
+    FsVector            vChanged;
+    FsVector            vAdded;
+
+    bool empty() const
+    {
+        return    vRenamed.empty()
+               && vRemoved.empty()
+               && vChanged.empty()
+               && vAdded.empty();
+    }
+};
+typedef shared_ptr<FsWatchResult> PFsWatchResult;
+
+struct WatchedContainer
+{
+    FsContainer         *pCnr;
+    weak_ptr<FsObject>  pwObject;
+};
+
+/**
+ *  What has happened in one watched directory since the last batch.
+ */
+struct PendingDir
+{
+    set<string>                     setNames;
+    vector<pair<string, string>>    vRenames;           // Old and new name.
+    bool                            fRevalidate = false;
+};
+
+struct FsWatcher::Impl
+{
+    int                                     fdInotify;
+
+    Mutex                                   mutex;          // Protects the two maps below.
+    map<int, vector<WatchedContainer>>      mapWatches;     // inotify watch descriptor -> containers
+    map<FsContainer*, int>                  mapContainers;
+
+    // Only used on the watcher thread.
+    map<int, PendingDir>                    mapPending;
+    map<uint32_t, pair<int, string>>        mapMovedFrom;   // Cookie -> watch descriptor and old name.
+    bool                                    fOverflow = false;
+
+    WorkerResultQueue<PFsWatchResult>       workerResults;
+
+    Impl(int fdInotify_)
+        : fdInotify(fdInotify_)
+    {
+        workerResults.setTraceName("watcher results");
+    }
+};
+
+
+/***************************************************************************
+ *
+ *  FsWatcher
+ *
+ **************************************************************************/
+
+FsWatcher::FsWatcher(int fdInotify)
+    : _pImpl(new Impl(fdInotify))
+{
+    _pImpl->workerResults.connect([this]()
+    {
+        this->onChangesReady();
+    });
+
+    XWP::Thread::Create([this]()
+    {
+        TraceSink::SetThreadName("inotify watcher");
+        this->run();
+    });
+}
+
+/* static */
+FsWatcher*
+FsWatcher::Get()
+{
+    static bool s_fTried = false;
+    static FsWatcher *s_pWatcher = nullptr;
+    if (!s_fTried)
+    {
+        s_fTried = true;
+        // These are enums, which would otherwise pick up FlagSet's operator|.
+        int fd = inotify_init1((int)IN_NONBLOCK | (int)IN_CLOEXEC);
+        if (fd == -1)
+            Debug::Log(DEBUG_ALWAYS, string("inotify_init1() failed, not watching directories: ") + strerror(errno));
+        else
+            s_pWatcher = new FsWatcher(fd);
+    }
+
+    return s_pWatcher;
+}
+
+void
+FsWatcher::addWatch(FsContainer &cnr,
+                    const string &strPath)
+{
+    DEBUG_SCOPE(d, FILEMONITORS, string(__func__) + "(" + quote(strPath) + ")");
+
+    int wd = inotify_add_watch(_pImpl->fdInotify, strPath.c_str(), WATCH_EVENTS);
+    if (wd == -1)
+    {
+        // Most likely ENOSPC because fs.inotify.max_user_watches has been reached. The
+        // directory then only gets updated on refresh, like before.
+        DEBUG_LOG(FILEMONITORS, "inotify_add_watch(" + quote(strPath) + ") failed: " + strerror(errno));
+        return;
+    }
+
+    // Watching the same directory through a symlink returns the same descriptor.
+    Lock lock(_pImpl->mutex);
+    _pImpl->mapWatches[wd].push_back({ &cnr, cnr._refBase.shared_from_this() });
+    _pImpl->mapContainers[&cnr] = wd;
+}
+
+void
+FsWatcher::removeWatch(FsContainer &cnr)
+{
+    Lock lock(_pImpl->mutex);
+    auto it = _pImpl->mapContainers.find(&cnr);
+    if (it == _pImpl->mapContainers.end())
+        return;
+
+    int wd = it->second;
+    _pImpl->mapContainers.erase(it);
+
+    auto &v = _pImpl->mapWatches[wd];
+    v.erase(remove_if(v.begin(),
+                      v.end(),
+                      [&cnr](const WatchedContainer &w)
+                      {
+                          return w.pCnr == &cnr;
+                      }),
+            v.end());
+    if (v.empty())
+    {
+        DEBUG_LOG(FILEMONITORS, string(__func__) + "(): removing watch " + to_string(wd));
+        _pImpl->mapWatches.erase(wd);
+        inotify_rm_watch(_pImpl->fdInotify, wd);
+    }
+}
+
+/**
+ *  The watcher thread. This reads the inotify events into Impl::mapPending and calls
+ *  processPending() once things have calmed down.
+ */
+void
+FsWatcher::run()
+{
+    typedef chrono::steady_clock Clock;
+
+    // The records are variable-sized, but each is aligned like struct inotify_event.
+    alignas(struct inotify_event) char buf[64 * 1024];
+    Clock::time_point tFirst;
+    bool fHavePending = false;
+
+    while (true)
+    {
+        int msTimeout = -1;
+        if (fHavePending)
+        {
+            auto msPending = chrono::duration_cast<chrono::milliseconds>(Clock::now() - tFirst).count();
+            msTimeout = max<int>(0, min<int>(DEBOUNCE_MS, MAX_DELAY_MS - msPending));
+        }
+
+        struct pollfd pfd = { _pImpl->fdInotify, POLLIN, 0 };
+        int rc = poll(&pfd, 1, msTimeout);
+        if (rc > 0)
+        {
+            ssize_t cb;
+            while ((cb = read(_pImpl->fdInotify, buf, sizeof(buf))) > 0)
+            {
+                for (char *p = buf; p < buf + cb; )
+                {
+                    auto pEvent = reinterpret_cast<struct inotify_event*>(p);
+                    p += sizeof(struct inotify_event) + pEvent->len;
+
+                    if (pEvent->mask & IN_Q_OVERFLOW)
+                    {
+                        DEBUG_LOG(FILEMONITORS, "inotify queue overflow, revalidating all watched directories");
+                        _pImpl->fOverflow = true;
+                    }
+                    else if (pEvent->len)
+                    {
+                        // The name is null-terminated and padded.
+                        string strName(pEvent->name);
+                        PendingDir &dir = _pImpl->mapPending[pEvent->wd];
+                        if (dir.fRevalidate)
+                            continue;
+
+                        if (pEvent->mask & IN_MOVED_FROM)
+                            _pImpl->mapMovedFrom[pEvent->cookie] = make_pair(pEvent->wd, strName);
+                        else if (pEvent->mask & IN_MOVED_TO)
+                        {
+                            // Only renames within a directory keep the object; moves between
+                            // directories are a remove and an add.
+                            auto it = _pImpl->mapMovedFrom.find(pEvent->cookie);
+                            if (it != _pImpl->mapMovedFrom.end())
+                            {
+                                if (it->second.first == pEvent->wd)
+                                    dir.vRenames.push_back(make_pair(it->second.second, strName));
+                                _pImpl->mapMovedFrom.erase(it);
+                            }
+                        }
+
+                        dir.setNames.insert(strName);
+                        if (dir.setNames.size() > MAX_NAMES_PER_DIR)
+                        {
+                            dir.fRevalidate = true;
+                            dir.setNames.clear();
+                            dir.vRenames.clear();
+                        }
+                    }
+                }
+            }
+
+            if (    (!fHavePending)
+                 && (    (_pImpl->fOverflow)
+                      || (!_pImpl->mapPending.empty())
+                    )
+               )
+            {
+                fHavePending = true;
+                tFirst = Clock::now();
+            }
+        }
+        else if (    (rc < 0)
+                  && (errno != EINTR)
+                )
+        {
+            Debug::Log(DEBUG_ALWAYS, string("poll() on inotify failed, not watching directories any more: ") + strerror(errno));
+            break;
+        }
+
+        if (    (fHavePending)
+             && (    (rc == 0)
+                  || (Clock::now() - tFirst >= chrono::milliseconds(MAX_DELAY_MS))
+                )
+           )
+        {
+            processPending();
+
+            // Directories that were being populated have been put back for the next round.
+            if ((fHavePending = !_pImpl->mapPending.empty()))
+                tFirst = Clock::now();
+        }
+    }
+}
+
+/**
+ *  Revalidates a container as a whole with getContents(), populating it the same way it
+ *  was populated before, for overflows and large bursts.
+ */
+static void
+RevalidateAll(FsContainer &cnr,
+              FsWatchResult &result)
+{
+    FsContainer::Get getContents;
+    if (cnr.isCompletelyPopulated())
+        getContents = FsContainer::Get::ALL;
+    else if (cnr.isPopulatedWithDirectories())
+        getContents = FsContainer::Get::FOLDERS_ONLY;
+    else
+        return;
+
+    DEBUG_SCOPE(d, FILEMONITORS, string(__func__) + "(" + quote(cnr._refBase.getPath()) + ")");
+
+    // Files may have been modified in place, which only a full comparison finds.
+    cnr.unsetPopulated(true);
+    FsVector vFiles;
+    cnr.getContents(vFiles,
+                    getContents,
+                    &result.vAdded,
+                    &result.vRemoved,
+                    nullptr);
+}
+
+/**
+ *  Applies the changes that have been collected in Impl::mapPending to the containers on
+ *  the watcher thread and posts the results to the GUI thread.
+ */
+void
+FsWatcher::processPending()
+{
+    map<int, PendingDir> mapPending;
+    mapPending.swap(_pImpl->mapPending);
+    // Whatever has not been matched by now was moved out of the watched directories.
+    _pImpl->mapMovedFrom.clear();
+    bool fOverflow = _pImpl->fOverflow;
+    _pImpl->fOverflow = false;
+
+    struct Job
+    {
+        int                 wd;
+        FsContainer         *pCnr;
+        PFsObject           pObject;
+        const PendingDir    *pDir;      // nullptr for an overflow.
+    };
+    vector<Job> vJobs;
+    {
+        Lock lock(_pImpl->mutex);
+        for (auto &pr : _pImpl->mapWatches)
+        {
+            const PendingDir *pDir = nullptr;
+            if (!fOverflow)
+            {
+                auto it = mapPending.find(pr.first);
+                if (it == mapPending.end())
+                    continue;
+                pDir = &it->second;
+            }
+
+            for (auto &w : pr.second)
+            {
+                PFsObject pObject;
+                if ((pObject = w.pwObject.lock()))
+                    vJobs.push_back({ pr.first, w.pCnr, pObject, pDir });
+            }
+        }
+    }
+
+    for (auto &job : vJobs)
+    {
+        // The populate may or may not see the changes, and its results go to the views
+        // without us, so wait for it to finish and come back in the next round.
+        if (job.pObject->hasFlag(FSFlag::POPULATING))
+        {
+            if (job.pDir)
+                _pImpl->mapPending[job.wd] = *job.pDir;
+            else
+                _pImpl->mapPending[job.wd].fRevalidate = true;
+            continue;
+        }
+
+        PFsWatchResult pResult = make_shared<FsWatchResult>();
+        pResult->pObject = job.pObject;
+        pResult->pCnr = job.pCnr;
+        FsContainer &cnr = *job.pCnr;
+
+        try
+        {
+            if (    (!job.pDir)
+                 || (job.pDir->fRevalidate)
+               )
+                RevalidateAll(cnr, *pResult);
+            else
+            {
+                for (auto &prRename : job.pDir->vRenames)
+                {
+                    PFsObject pFS;
+                    if ((pFS = cnr.renameEntry(prRename.first, prRename.second)))
+                        pResult->vRenamed.push_back({ pFS, prRename.first, prRename.second });
+                }
+
+                // This includes the names of renamed entries, which is harmless, and catches
+                // renames over existing files.
+                for (auto &strName : job.pDir->setNames)
+                    cnr.revalidateEntry(strName,
+                                        pResult->vAdded,
+                                        pResult->vRemoved,
+                                        pResult->vChanged);
+            }
+        }
+        catch (FSException &e)
+        {
+            DEBUG_LOG(FILEMONITORS, string(__func__) + "(): " + e.what());
+        }
+
+        if (!pResult->empty())
+            _pImpl->workerResults.postResultToGui(pResult);
+    }
+}
+
+/**
+ *  Called on the GUI thread for every result that processPending() has posted.
+ */
+void
+FsWatcher::onChangesReady()
+{
+    PFsWatchResult pResult = _pImpl->workerResults.fetchResult();
+    if (!pResult)
+        return;
+
+    DEBUG_SCOPE(d, FILEMONITORS, string(__func__) + "(" + quote(pResult->pObject->getPath()) + ")");
+
+    FsContainer &cnr = *pResult->pCnr;
+    for (auto &r : pResult->vRenamed)
+        cnr.notifyFileRenamed(r.pFS, r.strOldName, r.strNewName);
+    cnr.notifyFilesRemoved(pResult->vRemoved);
+    for (auto &pFS : pResult->vChanged)
+        cnr.notifyFileChanged(pFS);
+    cnr.notifyFilesAdded(pResult->vAdded);
+}
@@ -31,10 +31,12 @@
 #include "elisso/application.h"
 
 #include "elisso/mainwindow.h"
+#include "elisso/fsmodel_posix.h"
 
 #include "xwp/except.h"
 #include "xwp/exec.h"
 
+#include <cstring>
 #include <malloc.h>
 
 
@@ -425,7 +427,28 @@ main(int argc, char *argv[])
 
     mallopt(M_ARENA_MAX, 2);
 
-    FsGioImpl::Init();
+    // "--trace=FILE" or ELISSO_TRACE=FILE writes a Chrome trace-event file on exit. Remove
+    // the switch before Gtk sees it.
+    const char *pcszTrace = getenv("ELISSO_TRACE");
+    for (int i = 1; i < argc; ++i)
+        if (!strncmp(argv[i], "--trace=", 8))
+        {
+            pcszTrace = argv[i] + 8;
+            for (int j = i; j < argc; ++j)
+                argv[j] = argv[j + 1];
+            --argc;
+            break;
+        }
+    if (    (pcszTrace)
+         && (*pcszTrace)
+       )
+    {
+        TraceSink::Init(pcszTrace);
+        TraceSink::SetThreadName("GUI");
+    }
+
+    // Local files go through POSIX calls, everything else through Gio.
+    FsPosixImpl::Init();
 
     auto app = ElissoApplication::create(argc,
                                          argv);
@@ -444,5 +467,7 @@ main(int argc, char *argv[])
         dlg.run();
     }
 
+    TraceSink::Write();
+
     return rc;
 }
@@ -10,6 +10,8 @@
 
 #include "elisso/populate.h"
 
+#include <chrono>
+
 
 /***************************************************************************
  *
@@ -19,6 +21,14 @@
 
 std::atomic<uint> g_uPopulateThreadID(0);
 
+/**
+ *  The populate thread posts a partial result to the GUI whenever this many files have
+ *  been added, or when POPULATE_BATCH_MS milliseconds have passed since the previous
+ *  one, so that large folders show their first rows long before the populate is done.
+ */
+#define POPULATE_BATCH_SIZE         500
+#define POPULATE_BATCH_MS           50
+
 
 /***************************************************************************
  *
@@ -83,19 +93,59 @@ PopulateThread::threadFunc(uint idPopulateThread,
                            bool fClickFromTree,
                            bool fFollowSymlinks)
 {
+    TraceSink::SetThreadName("populate " + to_string(idPopulateThread));
+    TRACE_SCOPE(t, "populate " + _pDir->getPath());
+
     PViewPopulatedResult pResult = std::make_shared<ViewPopulatedResult>(idPopulateThread,
                                                                          fClickFromTree,
                                                                          _pDirSelectPrevious);
+    // Batch of added files for the next partial result. The callback below can get
+    // called on several of getContents()'s worker threads at once.
+    Mutex mutexBatch;
+    PViewPopulatedResult pBatch;
+    auto tLastBatch = std::chrono::steady_clock::now();
+
     try
     {
         FsContainer *pCnr = _pDir->getContainer();
         if (pCnr)
+        {
+            // Let getContents() spread the stat calls over all cores for big folders.
+            uint cWorkerThreads = XWP::Thread::getHardwareConcurrency();
             pCnr->getContents(*pResult->pvContents,
                               FsDirectory::Get::ALL,
                               &pResult->vAdded,
                               &pResult->vRemoved,
                               &_stopFlag,
-                              fFollowSymlinks);
+                              fFollowSymlinks,
+                              (cWorkerThreads) ? cWorkerThreads : 1,
+                              [&](PFsObject &pFS)
+            {
+                using namespace std::chrono;
+
+                Lock lock(mutexBatch);
+                if (!pBatch)
+                {
+                    pBatch = std::make_shared<ViewPopulatedResult>(idPopulateThread,
+                                                                   fClickFromTree,
+                                                                   _pDirSelectPrevious);
+                    pBatch->fPartial = true;
+                }
+                pBatch->vAdded.push_back(pFS);
+
+                auto tNow = steady_clock::now();
+                if (    (pBatch->vAdded.size() >= POPULATE_BATCH_SIZE)
+                     || (duration_cast<milliseconds>(tNow - tLastBatch).count() >= POPULATE_BATCH_MS)
+                   )
+                {
+                    if (!_stopFlag)
+                        _pWorkerResult->postResultToGui(pBatch);
+                    pBatch = nullptr;
+                    tLastBatch = tNow;
+                }
+            });
+            // Whatever is left in pBatch is in the final result too, so no need to post it.
+        }
     }
     catch (exception &e)
     {
@@ -120,12 +120,15 @@ bool ElissoPreviewWindow::setFile(PFsGioFile pFile,
             {
                 try
                 {
-                    FileContents fc(*pInput->pFile);
+                    FileStream stream(*pInput->pFile);
 
                     auto pLoader = Gdk::PixbufLoader::create(pInput->pFormat->get_name());
                     if (pLoader)
                     {
-                        pLoader->write((const guint8*)fc._pData, fc._size);       // can throw
+                        const char *pData;
+                        size_t cb;
+                        while (stream.next(pData, cb))                  // can throw
+                            pLoader->write((const guint8*)pData, cb);   // can throw
 
                         pInput->pPixbufFullsize = pLoader->get_pixbuf();
                         pLoader->close();
@@ -11,7 +11,6 @@
 #include "elisso/thumbnailer.h"
 
 #include "elisso/worker.h"
-#include "elisso/application.h"
 #include "elisso/contenttype.h"
 #include "xwp/debug.h"
 #include "xwp/stringhelp.h"
@@ -25,12 +24,10 @@
 struct ThumbnailTemp
 {
     PThumbnail      pThumb;
-    PFileContents   pFileContents;
     PPixbuf         ppbOrig;
 
-    ThumbnailTemp(PThumbnail &pThumb_, PFileContents &pFileContents_)
-        : pThumb(pThumb_),
-          pFileContents(pFileContents_)
+    ThumbnailTemp(PThumbnail &pThumb_)
+        : pThumb(pThumb_)
     { }
 
     ~ThumbnailTemp()
@@ -38,8 +35,6 @@ struct ThumbnailTemp
 
     void setLoaded(PPixbuf p)
     {
-        // Release the memory of the loaded file.
-        pFileContents = nullptr;
         ppbOrig = p;
     }
 };
@@ -69,7 +64,8 @@ typedef std::shared_ptr<ThumbnailTemp> PThumbnailTemp;
  *
  *  When external caller (probably on the GUI thread) post an FSFile to
  *  be thumbnailed, it gets added to qFileReader; the file reader thread then
- *  reads the image file from disk. It then posts the full-size pixbuf to
+ *  opens the image file and passes it to a pixbuf loader thread, which reads
+ *  and decodes it. That then posts the full-size pixbuf to
  *  both scaler thread queues, which wake up and scale the pixbuf to two
  *  resolutions. When both results are ready, the WorkerResult is posted
  *  so that the GUI thread receives the result.
@@ -85,16 +81,23 @@ struct Thumbnailer::Impl : WorkerResultQueue<PThumbnail>
     WorkerInputQueue<PThumbnailTemp>    qScalerIconSmall;
     WorkerInputQueue<PThumbnailTemp>    qScalerIconBig;
 
-    Impl()
+    Impl(uint cLoaderThreads)
     {
         // This returns 8 on a four-core machine with 8 hyperthreads.
         // 3 pixbuf threads are good fit for that, so scale accordingly.
         unsigned int cHyperThreads = XWP::Thread::getHardwareConcurrency();
-        cPixbufLoaders = MAX(1, (cHyperThreads / 2 - 1));
+        cPixbufLoaders = (cLoaderThreads) ? cLoaderThreads : MAX(1, (cHyperThreads / 2 - 1));
         // Would love to have a vector here to make this easier but WorkerInputQueue is not copyable.
         paqPixbufLoaders = new WorkerInputQueue<PThumbnailTemp>[cPixbufLoaders];
 
-        Debug::Log(THUMBNAILER, "Thumbnailer: std::thread::hardware_concurrency=" + to_string(cHyperThreads) + " => " + to_string(cPixbufLoaders) + " JPEG threads");
+        qFileReader_.pcszTraceName = "thumbnailer file reader";
+        for (uint u = 0; u < cPixbufLoaders; ++u)
+            paqPixbufLoaders[u].pcszTraceName = "thumbnailer pixbuf loader";
+        qScalerIconSmall.pcszTraceName = "thumbnailer small scaler";
+        qScalerIconBig.pcszTraceName = "thumbnailer big scaler";
+        setTraceName("thumbnailer results");
+
+        DEBUG_LOG(THUMBNAILER, "Thumbnailer: std::thread::hardware_concurrency=" + to_string(cHyperThreads) + " => " + to_string(cPixbufLoaders) + " JPEG threads");
     }
 
     ~Impl()
@@ -110,11 +113,12 @@ struct Thumbnailer::Impl : WorkerResultQueue<PThumbnail>
  *
  **************************************************************************/
 
-Thumbnailer::Thumbnailer(ElissoApplication &app)
-    : _pImpl(new Impl),
-      _app(app)
+Thumbnailer::Thumbnailer(FnGetFileTypeIcon fnGetFileTypeIcon,
+                         uint cLoaderThreads)
+    : _pImpl(new Impl(cLoaderThreads)),
+      _fnGetFileTypeIcon(fnGetFileTypeIcon)
 {
-    Debug::Log(THUMBNAILER, "Thumbnailer constructed");
+    DEBUG_LOG(THUMBNAILER, "Thumbnailer constructed");
 
      // Create the file reader thread.
     _pImpl->aThreads.push_back(XWP::Thread::Create([this]()
@@ -178,8 +182,10 @@ Thumbnailer::connect(std::function<void ()> fn)
 void
 Thumbnailer::enqueue(PFsGioFile pFile)
 {
-    Debug::Log(THUMBNAILER, string(__func__) + ":  " + pFile->getBasename());
-    _pImpl->qFileReader_.post(make_shared<Thumbnail>(pFile));
+    DEBUG_LOG(THUMBNAILER, string(__func__) + ":  " + pFile->getBasename());
+    auto pThumb = make_shared<Thumbnail>(pFile);
+    pThumb->times.tEnqueued = std::chrono::steady_clock::now();
+    _pImpl->qFileReader_.post(pThumb);
 }
 
 PThumbnail
@@ -205,6 +211,27 @@ Thumbnailer::isBusy()
     return false;
 }
 
+ThumbnailerQueueDepths
+Thumbnailer::getQueueDepths()
+{
+    ThumbnailerQueueDepths depths;
+    depths.cFileReader = _pImpl->qFileReader_.size();
+    for (uint u = 0;
+         u < _pImpl->cPixbufLoaders;
+         ++u)
+        depths.cPixbufLoaders += _pImpl->paqPixbufLoaders[u].size();
+    depths.cScalerSmall = _pImpl->qScalerIconSmall.size();
+    depths.cScalerBig = _pImpl->qScalerIconBig.size();
+    depths.cResults = _pImpl->size();
+    return depths;
+}
+
+uint
+Thumbnailer::getLoaderThreadCount() const
+{
+    return _pImpl->cPixbufLoaders;
+}
+
 void
 Thumbnailer::clearQueues()
 {
@@ -239,15 +266,20 @@ Thumbnailer::clearQueues()
 
 /**
  *  First thread spawned by the constructor. This blocks on the primary
- *  queue that is fed by enqueue() and then creates a FileContents for
- *  every such file. We then test for the file type; if it's an image
- *  file, the data gets loaded and passed on to the pixbuf reader thread,
- *  otherwise we determine a default icon here.
+ *  queue that is fed by enqueue() and then tests every such file for
+ *  its type; if it's an image file, we pass it on to the least busy
+ *  pixbuf loader thread, which opens and reads it, otherwise we
+ *  determine a default icon here.
+ *
+ *  Files are not opened here, since this thread runs far ahead of the
+ *  loaders: for a large folder, thousands of files would be open (and
+ *  read ahead) at the same time.
  */
 void
 Thumbnailer::fileReaderThread()
 {
-    Debug::Log(THUMBNAILER, string(__func__) + " started, blocking");
+    TraceSink::SetThreadName("thumbnailer file reader");
+    DEBUG_LOG(THUMBNAILER, string(__func__) + " started, blocking");
 
     PThumbnail pThumbnailIn;
     while(1)
@@ -259,28 +291,29 @@ Thumbnailer::fileReaderThread()
                 // NULL means terminate thread.
                 break;
 
+            TRACE_SCOPE(t, "read " + quote(pThumbnailIn->pFile->getBasename()));
             using namespace std::chrono;
             steady_clock::time_point t1 = steady_clock::now();
+            pThumbnailIn->times.tReadBegin = t1;
 
             if (!(pThumbnailIn->pFormat2 = ContentType::IsImageFile(pThumbnailIn->pFile)))
             {
                 // Is not an image file:
-                pThumbnailIn->ppbIconBig = _app.getFileTypeIcon(*pThumbnailIn->pFile, ICON_SIZE_BIG);
-                pThumbnailIn->ppbIconSmall = _app.getFileTypeIcon(*pThumbnailIn->pFile, ICON_SIZE_SMALL);
+                pThumbnailIn->ppbIconBig = _fnGetFileTypeIcon(*pThumbnailIn->pFile, ICON_SIZE_BIG);
+                pThumbnailIn->ppbIconSmall = _fnGetFileTypeIcon(*pThumbnailIn->pFile, ICON_SIZE_SMALL);
 
                 // In this case, post back to GUI immediately.
+                pThumbnailIn->times.tReadEnd = pThumbnailIn->times.tPosted = steady_clock::now();
                 _pImpl->postResultToGui(pThumbnailIn);
             }
             else
             {
                 // Is image file:
-                std::shared_ptr<FileContents> pFileContents = make_shared<FileContents>(*pThumbnailIn->pFile);
-
-                auto pThumbnailTemp = make_shared<ThumbnailTemp>(pThumbnailIn,
-                                                                 pFileContents);
+                auto pThumbnailTemp = make_shared<ThumbnailTemp>(pThumbnailIn);
 
-                milliseconds time_span = duration_cast<milliseconds>(steady_clock::now() - t1);
-                Debug::Log(THUMBNAILER, string(__func__) + ": reading file \"" + pThumbnailIn->pFile->getBasename() + "\" took " + to_string(time_span.count()) + "ms");
+                pThumbnailIn->times.tReadEnd = steady_clock::now();
+                milliseconds time_span = duration_cast<milliseconds>(pThumbnailIn->times.tReadEnd - t1);
+                DEBUG_LOG(THUMBNAILER, string(__func__) + ": checking file \"" + pThumbnailIn->pFile->getBasename() + "\" took " + to_string(time_span.count()) + "ms");
 
                 // Find the queue that's least busy. There is a race between
                 // our size() query and the post() call later, but it's still
@@ -299,7 +332,7 @@ Thumbnailer::fileReaderThread()
                     }
                 }
 
-                Debug::Log(THUMBNAILER, string(__func__) + ": queue " + to_string(uLeastBusyThread) + " is least busy (" + to_string(uLeastBusyQueueSize) + "), queueing there");
+                DEBUG_LOG(THUMBNAILER, string(__func__) + ": queue " + to_string(uLeastBusyThread) + " is least busy (" + to_string(uLeastBusyQueueSize) + "), queueing there");
                 _pImpl->paqPixbufLoaders[uLeastBusyThread].post(pThumbnailTemp);
 
     //                 ppb = Gdk::Pixbuf::create_from_file(strPath);
@@ -308,7 +341,7 @@ Thumbnailer::fileReaderThread()
         }
         catch (exception &e)
         {
-            Debug::Log(CMD_TOP, string("Exception in Thumbnailer::fileReaderThread(): ") + e.what());
+            DEBUG_LOG(CMD_TOP, string("Exception in Thumbnailer::fileReaderThread(): ") + e.what());
         }
     }
 }
@@ -318,13 +351,21 @@ Thumbnailer::fileReaderThread()
  *  times in order to parse the input files into a Pixbuf via PixbufLoader with optimal
  *  parallel processing.
  *
+ *  Each of these threads also opens its files right before reading them, so that only
+ *  as many files are open as there are loader threads, and reads them chunk by chunk,
+ *  handing every chunk to the PixbufLoader as soon as it is there. That way decoding starts with the first
+ *  chunk instead of after the whole file, and there are as many reads in flight as
+ *  there are loader threads, which hides slow disks and NFS much better than a single
+ *  reader thread could.
+ *
  *  The aqPixbufLoaders queues get fed by the single fileReaderThread; the results are
  *  then passed on to the two scaler threads.
  */
 void
 Thumbnailer::pixbufLoaderThread(uint threadno)
 {
-    Debug::Log(THUMBNAILER, string(__func__) + " started, blocking");
+    TraceSink::SetThreadName("thumbnailer pixbuf loader " + to_string(threadno));
+    DEBUG_LOG(THUMBNAILER, string(__func__) + " started, blocking");
 
     PThumbnailTemp pTemp;
     while (1)
@@ -334,8 +375,10 @@ Thumbnailer::pixbufLoaderThread(uint threadno)
             // NULL means terminate thread.
             break;
 
+        TRACE_SCOPE(t, "load " + quote(pTemp->pThumb->pFile->getBasename()));
         using namespace std::chrono;
         steady_clock::time_point t1 = steady_clock::now();
+        pTemp->pThumb->times.tLoadBegin = t1;
 
         string strFormatName = pTemp->pThumb->pFormat2->get_name();
         auto pLoader = Gdk::PixbufLoader::create(strFormatName);
@@ -345,9 +388,19 @@ Thumbnailer::pixbufLoaderThread(uint threadno)
             string strStatus("unknown");
             try
             {
-                strStatus = "writing";
-                pLoader->write((const guint8*)pTemp->pFileContents->_pData,
-                               pTemp->pFileContents->_size);       // can throw
+                strStatus = "opening";
+                FileStream stream(*pTemp->pThumb->pFile);       // can throw
+
+                const char *pData;
+                size_t cb;
+                while (1)
+                {
+                    strStatus = "reading";
+                    if (!stream.next(pData, cb))                // can throw
+                        break;
+                    strStatus = "writing";
+                    pLoader->write((const guint8*)pData, cb);   // can throw
+                }
                 strStatus = "closing";
                 pLoader->close();
 
@@ -360,8 +413,9 @@ Thumbnailer::pixbufLoaderThread(uint threadno)
 
             if (ppb)
             {
-                milliseconds time_span = duration_cast<milliseconds>(steady_clock::now() - t1);
-                Debug::Log(THUMBNAILER, string(__func__) + to_string(threadno) + ": loading \"" + pTemp->pThumb->pFile->getBasename() + "\" took " + to_string(time_span.count()) + "ms");
+                pTemp->pThumb->times.tLoadEnd = steady_clock::now();
+                milliseconds time_span = duration_cast<milliseconds>(pTemp->pThumb->times.tLoadEnd - t1);
+                DEBUG_LOG(THUMBNAILER, string(__func__) + to_string(threadno) + ": loading \"" + pTemp->pThumb->pFile->getBasename() + "\" took " + to_string(time_span.count()) + "ms");
 
                 pTemp->setLoaded(ppb);
 
@@ -369,7 +423,7 @@ Thumbnailer::pixbufLoaderThread(uint threadno)
                 _pImpl->qScalerIconBig.post(pTemp);
             }
             else
-                Debug::Log(CMD_TOP, "pixbufLoaderThread(): failed to load " + quote(pTemp->pThumb->pFile->getBasename()) + " (format " + strFormatName + ", status " + strStatus + ")");
+                DEBUG_LOG(CMD_TOP, "pixbufLoaderThread(): failed to load " + quote(pTemp->pThumb->pFile->getBasename()) + " (format " + strFormatName + ", status " + strStatus + ")");
         }
     }
 }
@@ -427,7 +481,8 @@ PPixbuf Thumbnailer::scale(PFsGioFile pFS,
 
 void Thumbnailer::scalerSmallThread()
 {
-    Debug::Log(THUMBNAILER, string(__func__) + " started, blocking");
+    TraceSink::SetThreadName("thumbnailer small scaler");
+    DEBUG_LOG(THUMBNAILER, string(__func__) + " started, blocking");
 
     PThumbnailTemp pTemp;
     while (1)
@@ -437,16 +492,20 @@ void Thumbnailer::scalerSmallThread()
             // NULL means terminate thread.
             break;
 
+        TRACE_SCOPE(t, "scale " + quote(pTemp->pThumb->pFile->getBasename()));
         using namespace std::chrono;
         steady_clock::time_point t1 = steady_clock::now();
+        pTemp->pThumb->times.tScaleSmallBegin = t1;
 
         PPixbuf ppb = scale(pTemp->pThumb->pFile, pTemp->ppbOrig, ICON_SIZE_SMALL);
 
         bool fBothThumbnailsReady = false;
         if (ppb)
         {
-            milliseconds time_span = duration_cast<milliseconds>(steady_clock::now() - t1);
-            Debug::Log(THUMBNAILER, string(__func__) + ": scaling file \"" + pTemp->pThumb->pFile->getBasename() + "\" took " + to_string(time_span.count()) + "ms");
+            // Before taking the lock so that the other scaler sees it if it posts the result.
+            pTemp->pThumb->times.tScaleSmallEnd = steady_clock::now();
+            milliseconds time_span = duration_cast<milliseconds>(pTemp->pThumb->times.tScaleSmallEnd - t1);
+            DEBUG_LOG(THUMBNAILER, string(__func__) + ": scaling file \"" + pTemp->pThumb->pFile->getBasename() + "\" took " + to_string(time_span.count()) + "ms");
 
             Lock lock(mutex);
             pTemp->pThumb->ppbIconSmall = ppb;
@@ -456,13 +515,17 @@ void Thumbnailer::scalerSmallThread()
         }
 
         if (fBothThumbnailsReady)
+        {
+            pTemp->pThumb->times.tPosted = steady_clock::now();
             _pImpl->postResultToGui(pTemp->pThumb);
+        }
     }
 }
 
 void Thumbnailer::scalerBigThread()
 {
-    Debug::Log(THUMBNAILER, string(__func__) + " started, blocking");
+    TraceSink::SetThreadName("thumbnailer big scaler");
+    DEBUG_LOG(THUMBNAILER, string(__func__) + " started, blocking");
 
     PThumbnailTemp pTemp;
     while (1)
@@ -472,16 +535,20 @@ void Thumbnailer::scalerBigThread()
             // NULL means terminate thread.
             break;
 
+        TRACE_SCOPE(t, "scale " + quote(pTemp->pThumb->pFile->getBasename()));
         using namespace std::chrono;
         steady_clock::time_point t1 = steady_clock::now();
+        pTemp->pThumb->times.tScaleBigBegin = t1;
 
         PPixbuf ppb = scale(pTemp->pThumb->pFile, pTemp->ppbOrig, ICON_SIZE_BIG);
 
         bool fBothThumbnailsReady = false;
         if (ppb)
         {
-            milliseconds time_span = duration_cast<milliseconds>(steady_clock::now() - t1);
-            Debug::Log(THUMBNAILER, string(__func__) + ": scaling file \"" + pTemp->pThumb->pFile->getBasename() + "\" took " + to_string(time_span.count()) + "ms");
+            // Before taking the lock so that the other scaler sees it if it posts the result.
+            pTemp->pThumb->times.tScaleBigEnd = steady_clock::now();
+            milliseconds time_span = duration_cast<milliseconds>(pTemp->pThumb->times.tScaleBigEnd - t1);
+            DEBUG_LOG(THUMBNAILER, string(__func__) + ": scaling file \"" + pTemp->pThumb->pFile->getBasename() + "\" took " + to_string(time_span.count()) + "ms");
 
             Lock lock(mutex);
             pTemp->pThumb->ppbIconBig = ppb;
@@ -491,6 +558,9 @@ void Thumbnailer::scalerBigThread()
         }
 
         if (fBothThumbnailsReady)
+        {
+            pTemp->pThumb->times.tPosted = steady_clock::now();
             _pImpl->postResultToGui(pTemp->pThumb);
+        }
     }
 }
@@ -12,11 +12,11 @@
 #include "xwp/thread.h"
 #include "xwp/debug_c.h"
 
-#include <list>
 #include <iostream>
 #include <chrono>
 #include <cstdarg>
 #include <cstring>
+#include <vector>
 
 namespace XWP {
 
@@ -36,6 +36,9 @@ struct FuncItem
     { }
 };
 
+/**
+ *  Serializes the output of all threads.
+ */
 Mutex g_mutexDebug;
 
 class DebugLock : public XWP::Lock
@@ -46,46 +49,43 @@ public:
     { }
 };
 
-list<FuncItem> g_llFuncs2;
-uint g_iIndent2 = 0;
 bool g_fNeedsNewline2 = false;
 
+/**
+ *  The open scopes of the current thread and its indentation level. Only scopes whose flag
+ *  is enabled get pushed, so these are never touched while tracing is off.
+ */
+thread_local vector<FuncItem> t_vFuncs2;
+thread_local uint t_iIndent2 = 0;
+
 /* static */
 void Debug::Enter2(DebugFlag fl,
                    const string &strFuncName,
                    const string &strExtra /* = "" */ )
 {
-    DebugLock lock;
-    if ( (fl == DEBUG_ALWAYS) || (g_flDebugSet & (uint)fl) )
-    {
-        string str2("Entering " + strFuncName);
-        if (strExtra.length())
-            str2.append(": " + strExtra);
-        Debug::Log(fl, str2);
-        ++g_iIndent2;
-    }
-    g_llFuncs2.push_back({fl, strFuncName});
+    string str2("Entering " + strFuncName);
+    if (strExtra.length())
+        str2.append(": " + strExtra);
+    Debug::Log(fl, str2);
+    ++t_iIndent2;
+    t_vFuncs2.push_back({fl, strFuncName});
 }
 
 /* static */
 void Debug::Leave2(const string &strExtra /* = "" */)
 {
-    DebugLock lock;
-    if (!g_llFuncs2.empty())
+    if (!t_vFuncs2.empty())
     {
-        FuncItem f = g_llFuncs2.back();      // Make a copy.
-        g_llFuncs2.pop_back();
-
-        if ( (f.fl == DEBUG_ALWAYS) || (g_flDebugSet & (uint)f.fl) )
-        {
-            --g_iIndent2;
-            string s = "Leaving " + f.strFuncName;
-            if (!strExtra.empty())
-                s += " (" + strExtra + ")";
-            chrono::milliseconds time_span = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - f.t1);
-            s += " -- took " + to_string(time_span.count()) + "ms";
-            Debug::Log(f.fl, s);
-        }
+        FuncItem f = std::move(t_vFuncs2.back());
+        t_vFuncs2.pop_back();
+
+        --t_iIndent2;
+        string s = "Leaving " + f.strFuncName;
+        if (!strExtra.empty())
+            s += " (" + strExtra + ")";
+        chrono::milliseconds time_span = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - f.t1);
+        s += " -- took " + to_string(time_span.count()) + "ms";
+        Debug::Log(f.fl, s);
     }
 }
 
@@ -94,12 +94,10 @@ void Debug::Log(DebugFlag fl,
                 const string &str,
                 uint8_t flMessage /* = 0 */)
 {
-    DebugLock lock;
-    bool fAlways;
-    if (    (fAlways = (fl == DEBUG_ALWAYS))
-         || (g_flDebugSet & (uint)fl)
-       )
+    if (IsEnabled(fl))
     {
+        DebugLock lock;
+        bool fAlways = (fl == DEBUG_ALWAYS);
         bool fContinue = !!(flMessage & CONTINUE_FROM_PREVIOUS);
 
         if (g_fNeedsNewline2)
@@ -113,10 +111,10 @@ void Debug::Log(DebugFlag fl,
         const string &strProgName = (fContinue) ? "" : g_strDebugProgramName;
 
         string strIndent;
-        if (fAlways && (g_iIndent2 > 0))
-            cout << strProgName << MakeColor(AnsiColor::BRIGHT_WHITE, ">") << string(g_iIndent2 * 2 - 1, ' ');
+        if (fAlways && (t_iIndent2 > 0))
+            cout << strProgName << MakeColor(AnsiColor::BRIGHT_WHITE, ">") << string(t_iIndent2 * 2 - 1, ' ');
         else
-            cout << strProgName << string(g_iIndent2 * 2, ' ');
+            cout << strProgName << string(t_iIndent2 * 2, ' ');
         cout << str;
         if ( (!fAlways) || (0 == (flMessage & NO_ECHO_NEWLINE)) )
             cout << "\n";
@@ -210,6 +208,9 @@ Debug::Warning(const string& str)
 
 void DebugEnter(const char *pcszFormat, ...)
 {
+    if (!Debug::IsEnabled(DEBUG_C))
+        return;
+
     std::string str;
     if (pcszFormat && *pcszFormat)
     {
@@ -228,6 +229,9 @@ void DebugEnter(const char *pcszFormat, ...)
 
 void DebugLeave(const char *pcszFormat, ...)
 {
+    if (!Debug::IsEnabled(DEBUG_C))
+        return;
+
     std::string str;
     if (pcszFormat && *pcszFormat)
     {
@@ -246,6 +250,9 @@ void DebugLeave(const char *pcszFormat, ...)
 
 void DebugLog(const char *pcszFormat, ...)
 {
+    if (!Debug::IsEnabled(DEBUG_C))
+        return;
+
     std::string str;
     if (pcszFormat && *pcszFormat)
     {
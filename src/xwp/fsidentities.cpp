@@ -0,0 +1,230 @@
+/*
+ * libxwp -- generic helper routines for C++11. (C) 2015--2017 Baubadil GmbH.
+ *
+ * libxwp is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the libxwp main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#include "xwp/fsmodel_base.h"
+
+#include <deque>
+#include <map>
+
+#include <grp.h>
+#include <pwd.h>
+
+
+/***************************************************************************
+ *
+ *  FsIdentities
+ *
+ **************************************************************************/
+
+enum class IdentityKind : uint8_t
+{
+    UNKNOWN,
+    UID,
+    GID,
+    USER_NAME,
+    GROUP_NAME
+};
+
+struct Identity
+{
+    IdentityKind    kind;
+    uint32_t        uNumeric;
+    bool            fResolved;          // strName is valid; always true unless kind is UID or GID.
+    string          strName;
+
+    Identity(IdentityKind kind_, uint32_t uNumeric_, const string &strName_, bool fResolved_)
+        : kind(kind_),
+          uNumeric(uNumeric_),
+          fResolved(fResolved_),
+          strName(strName_)
+    { }
+};
+
+/**
+ *  The table itself. A deque never moves its elements when growing, so references to
+ *  the names stay valid after the lock has been released.
+ */
+struct IdentitiesTable
+{
+    Mutex                               mutex;
+    deque<Identity>                     dqIdentities;
+    map<uint64_t, FsIdentityID>         mapNumeric;     // (kind << 32 | uid or gid) -> ID
+    map<string, FsIdentityID>           mapUserNames;
+    map<string, FsIdentityID>           mapGroupNames;
+    map<uint64_t, string>               mapOwnerStrings; // (user ID << 32 | group ID) -> "user:group"
+
+    IdentitiesTable()
+    {
+        dqIdentities.emplace_back(IdentityKind::UNKNOWN, 0, "", true);
+    }
+
+    FsIdentityID add(IdentityKind kind, uint32_t uNumeric, const string &strName, bool fResolved)
+    {
+        dqIdentities.emplace_back(kind, uNumeric, strName, fResolved);
+        return dqIdentities.size() - 1;
+    }
+};
+
+static IdentitiesTable& GetTable()
+{
+    static IdentitiesTable s_table;
+    return s_table;
+}
+
+static FsIdentityID
+FromNumeric(IdentityKind kind,
+            uint32_t u)
+{
+    auto &t = GetTable();
+    Lock lock(t.mutex);
+    uint64_t uKey = ((uint64_t)kind << 32) | u;
+    auto it = t.mapNumeric.find(uKey);
+    if (it != t.mapNumeric.end())
+        return it->second;
+
+    return t.mapNumeric[uKey] = t.add(kind, u, "", false);
+}
+
+static FsIdentityID
+FromName(IdentityKind kind,
+         map<string, FsIdentityID> IdentitiesTable::*pMap,
+         const string &strName)
+{
+    if (strName.empty())
+        return 0;
+
+    auto &t = GetTable();
+    Lock lock(t.mutex);
+    auto &mapNames = t.*pMap;
+    auto it = mapNames.find(strName);
+    if (it != mapNames.end())
+        return it->second;
+
+    return mapNames[strName] = t.add(kind, 0, strName, true);
+}
+
+/* static */
+FsIdentityID
+FsIdentities::FromUid(uint32_t uid)
+{
+    // Almost all files in a directory have the same owner, so remember the last one per
+    // thread and skip the lock for it.
+    static thread_local uint32_t t_uLastUid = 0;
+    static thread_local FsIdentityID t_idLast = 0;
+    if (!t_idLast || (uid != t_uLastUid))
+    {
+        t_idLast = FromNumeric(IdentityKind::UID, uid);
+        t_uLastUid = uid;
+    }
+    return t_idLast;
+}
+
+/* static */
+FsIdentityID
+FsIdentities::FromGid(uint32_t gid)
+{
+    static thread_local uint32_t t_uLastGid = 0;
+    static thread_local FsIdentityID t_idLast = 0;
+    if (!t_idLast || (gid != t_uLastGid))
+    {
+        t_idLast = FromNumeric(IdentityKind::GID, gid);
+        t_uLastGid = gid;
+    }
+    return t_idLast;
+}
+
+/* static */
+FsIdentityID
+FsIdentities::FromUserName(const string &strName)
+{
+    return FromName(IdentityKind::USER_NAME, &IdentitiesTable::mapUserNames, strName);
+}
+
+/* static */
+FsIdentityID
+FsIdentities::FromGroupName(const string &strName)
+{
+    return FromName(IdentityKind::GROUP_NAME, &IdentitiesTable::mapGroupNames, strName);
+}
+
+/* static */
+const string&
+FsIdentities::GetName(FsIdentityID id)
+{
+    auto &t = GetTable();
+    Lock lock(t.mutex);
+    if (id >= t.dqIdentities.size())
+        id = 0;
+    Identity &ident = t.dqIdentities[id];
+    if (!ident.fResolved)
+    {
+        // This can be slow with NSS modules like LDAP, but it only happens once per identity.
+        char sz[FS_BUF_LEN * 4];
+        if (ident.kind == IdentityKind::UID)
+        {
+            struct passwd pwd, *pResult = nullptr;
+            if (    (0 == getpwuid_r(ident.uNumeric, &pwd, sz, sizeof(sz), &pResult))
+                 && (pResult)
+               )
+                ident.strName = pResult->pw_name;
+        }
+        else
+        {
+            struct group grp, *pResult = nullptr;
+            if (    (0 == getgrgid_r(ident.uNumeric, &grp, sz, sizeof(sz), &pResult))
+                 && (pResult)
+               )
+                ident.strName = pResult->gr_name;
+        }
+
+        // Like ls, show the number if there is no name for it.
+        if (ident.strName.empty())
+            ident.strName = to_string(ident.uNumeric);
+        ident.fResolved = true;
+    }
+
+    return ident.strName;
+}
+
+/* static */
+const string&
+FsIdentities::GetOwnerString(FsIdentityID idUser,
+                             FsIdentityID idGroup)
+{
+    auto &t = GetTable();
+    uint64_t uKey = ((uint64_t)idUser << 32) | idGroup;
+    Lock lock(t.mutex);
+    auto it = t.mapOwnerStrings.find(uKey);
+    if (it != t.mapOwnerStrings.end())
+        return it->second;
+
+    // The mutex is recursive, so GetName() can lock it again.
+    return t.mapOwnerStrings[uKey] = GetName(idUser) + ":" + GetName(idGroup);
+}
+
+/* static */
+bool
+FsIdentities::GetNumeric(FsIdentityID id,
+                         uint32_t &u)
+{
+    auto &t = GetTable();
+    Lock lock(t.mutex);
+    if (id >= t.dqIdentities.size())
+        return false;
+
+    const Identity &ident = t.dqIdentities[id];
+    if (    (ident.kind != IdentityKind::UID)
+         && (ident.kind != IdentityKind::GID)
+       )
+        return false;
+
+    u = ident.uNumeric;
+    return true;
+}
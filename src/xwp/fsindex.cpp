@@ -0,0 +1,172 @@
+/*
+ * libxwp -- generic helper routines for C++11. (C) 2015--2017 Baubadil GmbH.
+ *
+ * libxwp is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the libxwp main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#include "xwp/fsindex.h"
+
+#include <algorithm>
+#include <functional>
+
+
+/***************************************************************************
+ *
+ *  FsContentsIndex
+ *
+ **************************************************************************/
+
+#define MIN_SLOTS       16
+
+PFsObject
+FsContentsIndex::find(const string &strBasename) const
+{
+    if (!_c)
+        return nullptr;
+
+    size_t i = findSlot(strBasename, std::hash<string>()(strBasename));
+    return _vSlots[i].p;
+}
+
+PFsObject
+FsContentsIndex::insert(PFsObject p)
+{
+    // Keep the load factor below 3/4 so that probe sequences stay short.
+    if ((_c + 1) * 4 > _vSlots.size() * 3)
+        grow();
+
+    const string &strBasename = p->getBasename();
+    size_t uHash = std::hash<string>()(strBasename);
+    Slot &slot = _vSlots[findSlot(strBasename, uHash)];
+
+    PFsObject pOld = slot.p;
+    if (!pOld)
+        ++_c;
+    slot.uHash = uHash;
+    slot.p = p;
+    _fSortedValid = false;
+
+    return pOld;
+}
+
+PFsObject
+FsContentsIndex::remove(const string &strBasename)
+{
+    if (!_c)
+        return nullptr;
+
+    size_t mask = _vSlots.size() - 1;
+    size_t i = findSlot(strBasename, std::hash<string>()(strBasename));
+    PFsObject pOld = _vSlots[i].p;
+    if (!pOld)
+        return nullptr;
+
+    // Backward-shift deletion: move following entries of the same probe run into the hole
+    // unless their home slot lies cyclically between the hole and themselves.
+    size_t j = i;
+    while (true)
+    {
+        j = (j + 1) & mask;
+        Slot &slotJ = _vSlots[j];
+        if (!slotJ.p)
+            break;
+
+        size_t k = slotJ.uHash & mask;
+        bool fStays = (i <= j) ? ((i < k) && (k <= j))
+                               : ((i < k) || (k <= j));
+        if (!fStays)
+        {
+            _vSlots[i] = std::move(slotJ);
+            i = j;
+        }
+    }
+    _vSlots[i].p = nullptr;
+
+    --_c;
+    _fSortedValid = false;
+
+    return pOld;
+}
+
+void
+FsContentsIndex::clear()
+{
+    _vSlots.clear();
+    _c = 0;
+    _vSorted.clear();
+    _fSortedValid = false;
+}
+
+const FsVector&
+FsContentsIndex::getSorted()
+{
+    if (!_fSortedValid)
+    {
+        _vSorted.clear();
+        _vSorted.reserve(_c);
+        for (auto &slot : _vSlots)
+            if (slot.p)
+                _vSorted.push_back(slot.p);
+
+        std::sort(_vSorted.begin(), _vSorted.end(), [](const PFsObject &a, const PFsObject &b)
+        {
+            return a->getBasename() < b->getBasename();
+        });
+
+        _fSortedValid = true;
+    }
+
+    return _vSorted;
+}
+
+void
+FsContentsIndex::dropSorted()
+{
+    FsVector().swap(_vSorted);
+    _fSortedValid = false;
+}
+
+/**
+ *  Returns the index of the slot that holds the given name, or of the empty slot where it
+ *  would have to be inserted. The table must not be empty.
+ */
+size_t
+FsContentsIndex::findSlot(const string &strBasename,
+                          size_t uHash) const
+{
+    size_t mask = _vSlots.size() - 1;
+    size_t i = uHash & mask;
+    while (true)
+    {
+        const Slot &slot = _vSlots[i];
+        if (    (!slot.p)
+             || (    (slot.uHash == uHash)
+                  && (slot.p->getBasename() == strBasename)
+                )
+           )
+            return i;
+        i = (i + 1) & mask;
+    }
+}
+
+void
+FsContentsIndex::grow()
+{
+    vector<Slot> vOld;
+    vOld.swap(_vSlots);
+    _vSlots.resize(vOld.empty() ? MIN_SLOTS : vOld.size() * 2);
+
+    size_t mask = _vSlots.size() - 1;
+    for (auto &slot : vOld)
+        if (slot.p)
+        {
+            size_t i = slot.uHash & mask;
+            while (_vSlots[i].p)
+                i = (i + 1) & mask;
+            _vSlots[i] = std::move(slot);
+        }
+}
@@ -9,16 +9,20 @@
  */
 
 #include "xwp/fsmodel_base.h"
+#include "xwp/fsindex.h"
+#include "xwp/slab.h"
 
 #include "xwp/debug.h"
 #include "xwp/stringhelp.h"
 #include "xwp/except.h"
 #include <mutex>
 #include <condition_variable>
+#include <future>
 #include <atomic>
 #include <set>
 #include <map>
 #include <list>
+#include <unordered_map>
 
 #include <unistd.h>
 
@@ -33,6 +37,52 @@ atomic<uint64_t>  g_uFSID(1);
 
 FsImplBase* g_pFsImpl = nullptr;
 
+/**
+ *  The number of FsObject instances, for the memory budget.
+ */
+atomic<uint64_t>  g_cObjectsAwake(0);
+
+/**
+ *  What an awake object costs on average, including its shared_ptr control block,
+ *  its slot in the parent's contents index and the path in its PathCache. This is an
+ *  estimate for typical names and paths on 64-bit systems.
+ */
+#define FSOBJECT_BYTES_ESTIMATE     384
+
+atomic<uint64_t>  g_cbMemoryBudget(0);
+
+/**
+ *  The containers that eviction may release the contents of, from the least to the most
+ *  recently used. Each container has the iterator to its own entry, and only the container
+ *  itself (when it is destroyed) and EvictLRU() remove entries, so entries may have expired
+ *  while their containers are being destroyed.
+ */
+typedef list<weak_ptr<FsObject>> LRUList;
+
+Mutex           g_mutexLRU;             // Protects the following two.
+LRUList         g_llLRU;
+FsCacheStats    g_cacheStats;
+
+atomic<bool>    g_fEvicting(false);
+
+/**
+ *  Bumped whenever the paths of awake objects change; see FsObject::PathCache.
+ */
+atomic<uint64_t>  g_uPathGeneration(0);
+
+/**
+ *  The cache behind FsImplBase::FindCachedPath(). It only holds weak references and is
+ *  dropped as a whole when g_uPathGeneration changes or it grows too large, so it never
+ *  needs to be updated for individual objects.
+ */
+#define MAX_PATH_LOOKUPS            10000
+
+typedef unordered_map<string, weak_ptr<FsObject>> PathLookupsMap;
+
+std::mutex      g_mutexPathLookups;     // Protects the following two.
+PathLookupsMap  g_mapPathLookups;
+uint64_t        g_uPathLookupsGeneration = 0;
+
 
 /***************************************************************************
  *
@@ -45,6 +95,55 @@ FsImplBase::FsImplBase()
     g_pFsImpl = this;
 }
 
+/* static */
+PFsObject
+FsImplBase::FindCachedPath(const string &strPath,
+                           uint64_t &uGeneration)
+{
+    PFsObject pFS;
+    {
+        std::lock_guard<std::mutex> lock(g_mutexPathLookups);
+        uGeneration = g_uPathGeneration;
+        if (g_uPathLookupsGeneration != uGeneration)
+            return nullptr;
+        auto it = g_mapPathLookups.find(strPath);
+        if (it == g_mapPathLookups.end())
+            return nullptr;
+        pFS = it->second.lock();
+    }
+
+    // Files that have been removed from their parents don't bump the generation.
+    if (    (pFS)
+         && (    (pFS->getParent())
+              || (pFS->hasFlag(FSFlag::IS_ROOT_DIRECTORY))
+            )
+       )
+        return pFS;
+
+    return nullptr;
+}
+
+/* static */
+void
+FsImplBase::CachePath(const string &strPath,
+                      const PFsObject &pFS,
+                      uint64_t uGeneration)
+{
+    std::lock_guard<std::mutex> lock(g_mutexPathLookups);
+    if (    (uGeneration != g_uPathLookupsGeneration)
+         || (g_mapPathLookups.size() >= MAX_PATH_LOOKUPS)
+       )
+    {
+        // A path may have changed while the caller was resolving it.
+        if (uGeneration != g_uPathGeneration)
+            return;
+        g_mapPathLookups.clear();
+        g_uPathLookupsGeneration = uGeneration;
+    }
+
+    g_mapPathLookups[strPath] = pFS;
+}
+
 
 /***************************************************************************
  *
@@ -52,15 +151,31 @@ FsImplBase::FsImplBase()
  *
  **************************************************************************/
 
-typedef map<const string, PFsObject> FilesMap;
 typedef list<PFsMonitorBase> FSMonitorsList;
 
 struct FsContainer::Impl
 {
     Mutex           mutexContents;
     Mutex           mutexFind;
-    FilesMap        mapContents;
+    FsContentsIndex indexContents;
     FSMonitorsList  llMonitors;
+    // FsImplBase::getContentsStamp() from before the last complete populate from disk, or 0.
+    // Only accessed by the thread that has set the POPULATING flag.
+    uint64_t        uContentsStamp = 0;
+    // Entry in g_llLRU if fInLRU is set; both are protected by g_mutexLRU.
+    atomic<bool>    fInLRU{false};
+    LRUList::iterator itLRU;
+
+    // Every directory has one of these, so they come from the slab pool like the objects.
+    static void* operator new(size_t cb)
+    {
+        return SlabPool::Allocate(cb);
+    }
+
+    static void operator delete(void *p, size_t cb)
+    {
+        SlabPool::Free(p, cb);
+    }
 
     /**
      *  Tests if a file-system object with the given name has already been instantiated in this
@@ -70,27 +185,21 @@ struct FsContainer::Impl
      */
     PFsObject
     isAwake(ContentsLock &lock,
-            const string &strParticle,
-            FilesMap::iterator *pIt)
+            const string &strParticle)
     {
-        FilesMap::iterator it = mapContents.find(strParticle);
-        if (it != mapContents.end())
-        {
-            if (pIt)
-                *pIt = it;
-            return it->second;
-        }
-
-        return nullptr;
+        return indexContents.find(strParticle);
     }
 
     void removeImpl(ContentsLock &lock,
-                    FilesMap::iterator it)
+                    PFsObject p)
     {
-        auto p = it->second;
-        mapContents.erase(it);
-        p->_pParent = nullptr;
+        indexContents.remove(p->getBasename());
+        p->_pParent.reset();
+        p->resetPathCache();
         p->clearFlag(FSFlag::IS_LOCAL);
+        // Paths through a removed directory or symlink now lead elsewhere.
+        if (p->getType() != FSType::FILE)
+            ++g_uPathGeneration;
     }
 };
 
@@ -157,31 +266,61 @@ FsMonitorBase::~FsMonitorBase()
         stopWatching(*_pContainer);
 }
 
+/* virtual */
+void
+FsMonitorBase::onItemsAdded(const FsVector &vFS)
+{
+    for (auto pFS : vFS)
+        onItemAdded(pFS);
+}
+
+/* virtual */
+void
+FsMonitorBase::onItemsRemoved(const FsVector &vFS)
+{
+    for (auto pFS : vFS)
+        onItemRemoved(pFS);
+}
+
 void
 FsMonitorBase::startWatching(FsContainer &cnr)
 {
-    FsLock lock;
-    if (_pContainer)
+    bool fFirst = false;
     {
-        if (_pContainer != &cnr)
-            throw FSException("Monitor is already busy with another container");
-    }
-    else
-    {
-        cnr._pImpl->llMonitors.push_back(shared_from_this());
-        _pContainer = &cnr;
+        FsLock lock;
+        if (_pContainer)
+        {
+            if (_pContainer != &cnr)
+                throw FSException("Monitor is already busy with another container");
+        }
+        else
+        {
+            fFirst = cnr._pImpl->llMonitors.empty();
+            cnr._pImpl->llMonitors.push_back(shared_from_this());
+            _pContainer = &cnr;
+        }
     }
+
+    if (fFirst)
+        g_pFsImpl->onMonitoringStarted(cnr);
 }
 
 void
 FsMonitorBase::stopWatching(FsContainer &cnr)
 {
-    FsLock lock;
-    if (_pContainer != &cnr)
-        throw FSException("Cannot remove monitor as it's not active for this container");
+    bool fLast;
+    {
+        FsLock lock;
+        if (_pContainer != &cnr)
+            throw FSException("Cannot remove monitor as it's not active for this container");
 
-    _pContainer = nullptr;
-    cnr._pImpl->llMonitors.remove(shared_from_this());
+        _pContainer = nullptr;
+        cnr._pImpl->llMonitors.remove(shared_from_this());
+        fLast = cnr._pImpl->llMonitors.empty();
+    }
+
+    if (fLast)
+        g_pFsImpl->onMonitoringStopped(cnr);
 }
 
 
@@ -199,15 +338,24 @@ FsObject::FsObject(FSType type,
       _strBasename(strBasename),
       _cbSize(info._cbSize),
       _uLastModified(info._uLastModified),
-      _strOwnerUser(info._strOwnerUser),
-      _strOwnerGroup(info._strOwnerGroup)
+      _idOwnerUser(info._idOwnerUser),
+      _idOwnerGroup(info._idOwnerGroup),
+      _uInode(info._uInode)
+{
+    ++g_cObjectsAwake;
+}
+
+/* virtual */
+FsObject::~FsObject()
 {
+    --g_cObjectsAwake;
 }
 
 bool
 FsObject::isHidden()
 {
-    FsLock lock;
+    // Two threads may get here at the same time, but they will both set the same bits.
+    // HIDDEN must be set before HIDDEN_CHECKED so that whoever sees the latter sees the former.
     if (!_fl.test(FSFlag::HIDDEN_CHECKED))
     {
         auto len = _strBasename.length();
@@ -229,12 +377,29 @@ FsObject::isHidden()
 //     return pInfo->is_hidden();
 }
 
-string
-FsObject::makeOwnerString()
+const string&
+FsObject::makeOwnerString() const
 {
-    return _strOwnerUser + ":" + _strOwnerGroup;
+    return FsIdentities::GetOwnerString(_idOwnerUser, _idOwnerGroup);
 }
 
+/**
+ *  Every object caches its path and an optional backend handle in a PathCache, which is
+ *  never modified once it has been published; updates replace the whole instance with
+ *  atomic_store() so that no lock is needed to read it.
+ *
+ *  Instead of visiting all descendants when a directory gets renamed or moved, that
+ *  bumps the global g_uPathGeneration, which makes every cache older than that stale.
+ *  Since readers fetch the generation before walking up the parents, it suffices to
+ *  bump it after the change is complete.
+ */
+struct FsObject::PathCache
+{
+    uint64_t                uGeneration;
+    string                  strPath;
+    std::shared_ptr<void>   pHandle;
+};
+
 string
 FsObject::getPath() const
 {
@@ -247,28 +412,67 @@ FsObject::getPath() const
 string
 FsObject::getPathImpl() const
 {
-    string strFullpath;
+    return getPathCache()->strPath;
+}
 
-    if (_pParent)
+std::shared_ptr<const FsObject::PathCache>
+FsObject::getPathCache() const
+{
+    uint64_t uGeneration = g_uPathGeneration;
+    auto pCache = atomic_load(&_pPathCache);
+    if (    (!pCache)
+         || (pCache->uGeneration != uGeneration)
+       )
     {
-        // If we have a parent, recurse FIRST.
-        strFullpath = _pParent->getPathImpl();
-        if (strFullpath != "/")
-            strFullpath += '/';
+        string strFullpath;
+
+        PFsObject pParent;
+        if ((pParent = _pParent.lock()))
+        {
+            // If we have a parent, recurse FIRST.
+            strFullpath = pParent->getPathImpl();
+            if (strFullpath != "/")
+                strFullpath += '/';
+        }
+        strFullpath += getBasename();
+
+        auto pNew = allocate_shared<PathCache>(SlabAllocator<PathCache>());
+        pNew->uGeneration = uGeneration;
+        pNew->strPath = std::move(strFullpath);
+        atomic_store(&_pPathCache, std::shared_ptr<const PathCache>(pNew));
+        pCache = pNew;
     }
 
-    return strFullpath + getBasename();
+    return pCache;
+}
+
+void
+FsObject::resetPathCache()
+{
+    atomic_store(&_pPathCache, std::shared_ptr<const PathCache>());
+}
+
+std::shared_ptr<void>
+FsObject::getBackendHandle() const
+{
+    return getPathCache()->pHandle;
+}
+
+void
+FsObject::setBackendHandle(std::shared_ptr<void> pHandle) const
+{
+    auto pCache = getPathCache();
+    auto pNew = allocate_shared<PathCache>(SlabAllocator<PathCache>(), *pCache);
+    pNew->pHandle = pHandle;
+    // If another thread has replaced the cache in the meantime, we simply lose the handle.
+    atomic_compare_exchange_strong(&_pPathCache, &pCache, std::shared_ptr<const PathCache>(pNew));
 }
 
 PFsObject
 FsObject::getParent() const
 {
-    if (_pParent)
-        ;
-    else if (_fl.test(FSFlag::IS_ROOT_DIRECTORY))
-        ;       // return NULL;
-
-    return _pParent;
+    // nullptr for root directories.
+    return _pParent.lock();
 }
 
 bool
@@ -338,15 +542,21 @@ FsObject::operator==(const FsObject &o) const
     return     (this->_type == o._type)
             && (this->_cbSize == o._cbSize)
             && (this->_uLastModified == o._uLastModified)
-            && (this->_strOwnerUser == o._strOwnerUser)
-            && (this->_strOwnerGroup == o._strOwnerGroup)
+            && (this->_idOwnerUser == o._idOwnerUser)
+            && (this->_idOwnerGroup == o._idOwnerGroup)
+               // Same name but a different file, e.g. after a rename over it. Unknown inodes match.
+            && (    (!this->_uInode)
+                 || (!o._uInode)
+                 || (this->_uInode == o._uInode)
+               )
             ;
 }
 
 void
 FsObject::rename(const string &strNewName)
 {
-    auto pCnr = _pParent->getContainer();
+    auto pParent = getParent();
+    auto pCnr = (pParent) ? pParent->getContainer() : nullptr;
     if (pCnr)
     {
         // Update the contents map, which sorts by name.
@@ -359,6 +569,9 @@ FsObject::rename(const string &strNewName)
 
         _strBasename = strNewName;
         pCnr->addChild(cLock, shared_from_this());
+
+        // Paths of all objects under this have changed too.
+        ++g_uPathGeneration;
     }
 }
 
@@ -403,7 +616,7 @@ FsObject::copyOrMoveImpl(PFsObject pTarget,
     if (strBasename.empty())
         throw FSException("cannot copy or move: basename is empty");
 
-    Debug d(FILE_HIGH, string(__func__) + "(" + quote(strBasename) + ", target=" + quote(pTarget->getBasename()) + ")");
+    DEBUG_SCOPE(d, FILE_HIGH, string(__func__) + "(" + quote(strBasename) + ", target=" + quote(pTarget->getBasename()) + ")");
 
     auto pParent = getParent();
     if (!pParent)
@@ -449,6 +662,9 @@ FsObject::copyOrMoveImpl(PFsObject pTarget,
 
 //                 pParentCnr->dumpContents("After copy/move, contents of ", cLock);
         }
+
+        // Paths of all objects under this have changed too.
+        ++g_uPathGeneration;
     }
 
     return pReturn;
@@ -473,7 +689,7 @@ FsObject::FindDirectory(const string &strPath)
 {
     if (auto pFS = g_pFsImpl->findPath(strPath))
     {
-        Debug::Log(FILE_MID, string(__func__) + "(" + quote(strPath) + ") => " + pFS->describe(true));
+        DEBUG_LOG(FILE_MID, string(__func__) + "(" + quote(strPath) + ") => " + pFS->describe(true));
         if (pFS->getType() == FSType::DIRECTORY)
             return static_pointer_cast<FsDirectory>(pFS);
     }
@@ -516,7 +732,14 @@ FsContainer::~FsContainer()
 {
     {
         ContentsLock lock(*this);
-        _pImpl->mapContents.clear();
+        _pImpl->indexContents.clear();
+    }
+
+    if (_pImpl->fInLRU)
+    {
+        Lock lock(g_mutexLRU);
+        if (_pImpl->fInLRU)
+            g_llLRU.erase(_pImpl->itLRU);
     }
 
     delete _pImpl;
@@ -526,29 +749,29 @@ void FsContainer::addChild(ContentsLock &lock,
                            PFsObject p)
 {
     const string &strBasename = p->getBasename();
-    Debug::Log(FILE_LOW, "storing " + quote(strBasename) + " in parent map");
+    DEBUG_LOG(FILE_LOW, "storing " + quote(strBasename) + " in parent map");
 
-    if (p->_pParent)
+    if (!p->_pParent.expired())
         throw FSException("addChild() called for a child who already has a parent");
 
-    _pImpl->mapContents[strBasename] = p;
+    _pImpl->indexContents.insert(p);
 
     // Propagate DIR_IS_LOCAL from parents.
     if (_refBase.hasFlag(FSFlag::IS_LOCAL))
         p->setFlag(FSFlag::IS_LOCAL);
 
     p->_pParent = _refBase.getSharedFromThis();
+    p->resetPathCache();
 }
 
 void
 FsContainer::removeChild(ContentsLock &lock,
                          PFsObject p)
 {
-    auto it = _pImpl->mapContents.find(p->getBasename());
-    if (it == _pImpl->mapContents.end())
+    if (_pImpl->indexContents.find(p->getBasename()) != p)
         throw FSException("internal: cannot find myself in parent");
 
-    _pImpl->removeImpl(lock, it);
+    _pImpl->removeImpl(lock, p);
 }
 
 void
@@ -558,8 +781,8 @@ FsContainer::dumpContents(const string &strIntro,
 //     if (g_flDebugSet & FOLDER_POPULATE_LOW)
 //     {
 //         Debug::Log(FOLDER_POPULATE_LOW, strIntro + _refBase.getPath() + ": ");
-//         for (auto &p : _pImpl->mapContents)
-//             Debug::Log(FOLDER_POPULATE_LOW, "  " + quote(p.second->getPath()));
+//         for (auto &p : _pImpl->indexContents.getSorted())
+//             Debug::Log(FOLDER_POPULATE_LOW, "  " + quote(p->getPath()));
 //     }
 }
 
@@ -591,11 +814,11 @@ FsContainer::find(const string &strParticle)
 {
     PFsObject pReturn;
     ContentsLock cLock(*this);
-    if ((pReturn = _pImpl->isAwake(cLock, strParticle, nullptr)))
-        Debug::Log(FILE_MID, "Directory::find(" + quote(strParticle) + ") => already awake " + pReturn->describe());
+    if ((pReturn = _pImpl->isAwake(cLock, strParticle)))
+        DEBUG_LOG(FILE_MID, "Directory::find(" + quote(strParticle) + ") => already awake " + pReturn->describe());
     else
     {
-        Debug d(FILE_MID, "Directory::find(" + quote(strParticle) + "): particle needs waking up");
+        DEBUG_SCOPE(d, FILE_MID, "Directory::find(" + quote(strParticle) + "): particle needs waking up");
 
         if ((pReturn = g_pFsImpl->makeAwake(_refBase.getPathImpl(),
                                             strParticle,
@@ -603,32 +826,62 @@ FsContainer::find(const string &strParticle)
             this->addChild(cLock, pReturn);
     }
 
+    // Otherwise objects that were only found through paths could never be evicted.
+    if (pReturn)
+        touchLRU(false);
+
     return pReturn;
 }
 
 bool
 FsContainer::isPopulatedWithDirectories() const
 {
-    FsLock lock;
     return _refBase._fl.test(FSFlag::POPULATED_WITH_DIRECTORIES);
 }
 
 bool
 FsContainer::isCompletelyPopulated() const
 {
-    FsLock lock;
     return _refBase._fl.test(FSFlag::POPULATED_WITH_ALL);
 }
 
+bool
+FsContainer::isPopulatedFromCache() const
+{
+    return _refBase._fl.test(FSFlag::POPULATED_FROM_CACHE);
+}
+
 void
-FsContainer::unsetPopulated()
+FsContainer::unsetPopulated(bool fCompare /* = false */)
 {
-    FsLock lock;
+    if (fCompare)
+    {
+        ContentsLock cLock(*this);
+        _pImpl->uContentsStamp = 0;
+    }
+    _refBase._fl.set(FSFlag::REFRESH_FROM_DISK);
     _refBase._fl.clear(FSFlag::POPULATED_WITH_ALL);
     _refBase._fl.clear(FSFlag::POPULATED_WITH_DIRECTORIES);
 }
 
-condition_variable_any g_condFolderPopulated;
+/**
+ *  Threads that wait for another thread to finish populating a container or following
+ *  a symlink block on one of these condition variables, picked by the address of the
+ *  object they are waiting for. That way, finishing one object only wakes up the threads
+ *  that wait for objects in the same stripe, not every waiting thread in the process.
+ *
+ *  This works because condition_variable_any, unlike condition_variable, allows waiters
+ *  to use different mutexes; each waiter holds the mutex of the object it waits for.
+ */
+#define WAIT_STRIPES        64
+condition_variable_any g_acondWait[WAIT_STRIPES];
+
+static condition_variable_any&
+GetWaitCondition(const void *pObject)
+{
+    // Fibonacci hashing, since the low bits of heap addresses are mostly the same.
+    return g_acondWait[((uintptr_t)pObject * 0x9E3779B97F4A7C15ull) >> 58];
+}
 
 size_t
 FsContainer::getContents(FsVector &vFiles,
@@ -636,23 +889,32 @@ FsContainer::getContents(FsVector &vFiles,
                          FsVector *pvFilesAdded,
                          FsVector *pvFilesRemoved,        //!< out: list of file-system object that have been removed, or nullptr (optional)
                          StopFlag *pStopFlag,
-                         bool fFollowSymlinks /* = false */)
+                         bool fFollowSymlinks /* = false */,
+                         uint cWorkerThreads /* = 1 */,
+                         FnFsObjectAdded fnAdded /* = nullptr */)
 {
-    Debug d(FILE_HIGH, "FsContainer::getContents(\"" + _refBase.getPath() + "\")");
+    DEBUG_SCOPE(d, FILE_HIGH, "FsContainer::getContents(\"" + _refBase.getPath() + "\")");
+
+    touchLRU(true);
 
     size_t c = 0;
 
     string strException;
+    bool fStopped = false;
+    // Only set if this call actually read the directory.
+    PFsDirEnumeratorBase pEnumerator;
+    // Set if this is a refresh of a directory whose entries haven't changed.
+    bool fUnchanged = false;
+    uint64_t uStamp = 0;
 
     try
     {
-        bool fStopped = false;
 
         // If this container is being populated on another thread, block on the global
         // condition variable until the other thread posts it (when populate is done).
         unique_lock<recursive_mutex> lock(_pImpl->mutexFind);
         while (_refBase._fl.test(FSFlag::POPULATING))
-            g_condFolderPopulated.wait(lock);
+            GetWaitCondition(this).wait(lock);
         // Lock is held again now. Folder state is now guaranteed to not be POPULATING
         // (either it's never been populated, or it was populated earlier, or the
         // other thread is done); now go test the state for good.
@@ -668,155 +930,178 @@ FsContainer::getContents(FsVector &vFiles,
 
             PFsObject pSharedThis = _refBase.getSharedFromThis();
 
-            /* The refresh algorithm is simple. For every file returned from the Gio backend,
-             * we check if it's already in the contents map; if not, it is added. This adds
-             * missing files. To remove awake files that have been removed on disk, every file
-             * returned by the Gio backend that was either already awake or has been added in
-             * the above loop is marked with  a "dirty" flag. A final loop then removes all
-             * objects from the contents map that do not have the "dirty" flag set. */
-            if (getContents == Get::ALL)
+            // Take the stamp before reading the directory, so that changes while we read it
+            // are noticed by the next refresh.
+            bool fRefresh = _refBase._fl.test(FSFlag::REFRESH_FROM_DISK);
+            uStamp = g_pFsImpl->getContentsStamp(*this);
+            if (    (fRefresh)
+                 && (uStamp)
+                 && (uStamp == _pImpl->uContentsStamp)
+               )
             {
-                ContentsLock cLock(*this);
-                FsLock lock2Temp;
-                for (auto it : _pImpl->mapContents)
-                {
-                    auto &p = it.second;
-                    p->_fl.set(FSFlag::DIRTY);
-                }
+                // Nothing has been added, removed or renamed since the last complete populate,
+                // so the contents we have are still complete.
+                DEBUG_LOG(FOLDER_POPULATE_HIGH, "Directory unchanged since last populate, not reading it");
+                fUnchanged = true;
             }
-
-            bool fIsLocal = _refBase.hasFlag(FSFlag::IS_LOCAL);
-
-            string strThisPath = _refBase.getPathImpl();
-            PFsDirEnumeratorBase pEnumerator = g_pFsImpl->beginEnumerateChildren(*this);
-            string strBasename;
-            while (g_pFsImpl->getNextChild(pEnumerator, strBasename))
+            else
             {
-                if (pStopFlag)
-                    if (*pStopFlag)
-                    {
-                        fStopped = true;
-                        break;
-                    }
-
-                ContentsLock cLock(*this);
-
-                // Check if the object is already in this container.
-                FilesMap::iterator it;
-                PFsObject pAwake = _pImpl->isAwake(cLock, strBasename, &it);
-                // Also wake up a new object from the GioFile. This is necessary
-                // so we can detect if the type of the file changed. This will not have the dirty flag set.
-                PFsObject pTemp = g_pFsImpl->makeAwake(strThisPath,
-                                                       strBasename,
-                                                       fIsLocal);
-
-                if (    (pAwake)
-                    // Use our operator== to compare, which which check timestamps and size.
-                     && (*pAwake == *pTemp)
-                   )
+                /* The refresh algorithm is simple. For every file returned from the Gio backend,
+                 * we check if it's already in the contents map; if not, it is added. This adds
+                 * missing files. To remove awake files that have been removed on disk, every file
+                 * returned by the Gio backend that was either already awake or has been added in
+                 * the above loop is marked with  a "dirty" flag. A final loop then removes all
+                 * objects from the contents map that do not have the "dirty" flag set. */
+                if (getContents == Get::ALL)
                 {
-                    // Cached item valid: clear the dirty flag.
-                    FsLock lock2Temp;
-                    pAwake->_fl.clear(FSFlag::DIRTY);
+                    ContentsLock cLock(*this);
+                    _pImpl->indexContents.forEach([](const PFsObject &p)
+                    {
+                        p->_fl.set(FSFlag::DIRTY);
+                    });
                 }
+
+                // With several worker threads, only enumerate the names here and have the
+                // workers wake up the objects, which is where the time goes. Get::FIRST_FOLDER_ONLY
+                // wants to stop early, which doesn't go well with that.
+                bool fParallel =    (cWorkerThreads > 1)
+                                 && (getContents != Get::FIRST_FOLDER_ONLY);
+
+                // If this is a refresh after a complete populate from disk, then the entries
+                // have mostly been added or removed, so only the names are needed to find out
+                // which, and the objects that are still there can be kept as they are, unless
+                // the inode number or type that came with the name says that it's another file.
+                bool fKeepAwake =    (fRefresh)
+                                  && (_pImpl->uContentsStamp);
+                _pImpl->uContentsStamp = 0;
+
+                // The backend sets this again if it serves the contents from a cache.
+                _refBase._fl.clear(FSFlag::POPULATED_FROM_CACHE);
+                pEnumerator = g_pFsImpl->beginEnumerateChildren(*this,
+                                                                fParallel || fKeepAwake,        // fNamesOnly
+                                                                getContents != Get::ALL);       // fDirectoriesOnly
+                string strBasename;
+                // The backend gives us a new object for every directory entry, created from the
+                // metadata that came with the entry. This is necessary so we can detect if the
+                // type of the file changed. This will not have the dirty flag set. If we asked
+                // for names only, we may have to wake up the object ourselves.
+                PFsObject pTemp;
+                string strThisPath = _refBase.getPathImpl();
+                bool fIsLocal = _refBase.hasFlag(FSFlag::IS_LOCAL);
+
+                // New symlinks that need following are collected in here and followed all at
+                // once after the enumeration. Get::FOLDERS_ONLY has to follow them anyway to
+                // find the ones to directories.
+                FsVector vSymlinks;
+                bool fCollectSymlinks =    (    (fFollowSymlinks)
+                                             || (getContents == Get::FOLDERS_ONLY)
+                                           )
+                                        && (getContents != Get::FIRST_FOLDER_ONLY);
+
+                if (fParallel)
+                    fStopped = populateParallel(pEnumerator,
+                                                getContents,
+                                                pvFilesAdded,
+                                                pvFilesRemoved,
+                                                pStopFlag,
+                                                (fCollectSymlinks) ? &vSymlinks : nullptr,
+                                                cWorkerThreads,
+                                                fKeepAwake,
+                                                fnAdded);
                 else
                 {
-                    PFsObject pAddToContents;
-
-                    if (pAwake)
+                    while (g_pFsImpl->getNextChild(pEnumerator, strBasename, pTemp))
                     {
-                        // Type of file changed: then remove it from the folder before adding the new one.
-                        if (pvFilesRemoved)
-                            pvFilesRemoved->push_back(pAwake);
-                        _pImpl->removeImpl(cLock, it);
+                        if (pStopFlag)
+                            if (*pStopFlag)
+                            {
+                                fStopped = true;
+                                break;
+                            }
 
-                        pAwake = nullptr;
-                    }
+                        if (!pTemp)
+                            if (!(pTemp = wakeUpEntry(strThisPath, strBasename, pEnumerator->idCurrent, fIsLocal, fKeepAwake)))
+                                continue;
 
-                    auto t = pTemp->getType();
-                    switch (t)
-                    {
-                        case FSType::DIRECTORY:
+                        PFsObject pAdded;
                         {
-                            // Always wake up directories.
-                            Debug d(FILE_LOW, "Waking up directory " + strBasename);
-                            pAddToContents = pTemp;
+                            ContentsLock cLock(*this);
+                            pAdded = mergeChild(cLock,
+                                                strBasename,
+                                                pTemp,
+                                                getContents,
+                                                pvFilesAdded,
+                                                pvFilesRemoved);
                         }
-                        break;
 
-                        case FSType::SYMLINK:
+                        if (pAdded)
                         {
-                            // Need to wake up the symlink to figure out if it's a link to a dir.
-                            Debug d(FILE_LOW, "Waking up symlink " + strBasename);
-                            pAddToContents = pTemp;
-                        }
-                        break;
+                            auto t = pAdded->getType();
+                            FSTypeResolved tr;
 
-                        default:
-                            // Ordinary file:
-                            if (getContents == Get::ALL)
+                            if (    (t == FSType::SYMLINK)
+                                 && (fCollectSymlinks)
+                               )
                             {
-                                Debug d(FILE_LOW, "Waking up plain file " + strBasename);
-                                pAddToContents = pTemp;
+                                // Followed below, and fnAdded gets called then.
+                                vSymlinks.push_back(pAdded);
+                                continue;
                             }
-                        break;
-                    }
 
-                    if (pAddToContents)
-                    {
-                        this->addChild(cLock, pAddToContents);
-                        if (pvFilesAdded)
-                            pvFilesAdded->push_back(pAddToContents);
-
-                        FSTypeResolved tr;
+                            if (t == FSType::SYMLINK)
+                                if (fFollowSymlinks)
+                                    tr = pAdded->getResolvedType();   // This calls follow() and we don't have to typecast here.
 
-                        if (t == FSType::SYMLINK)
-                            if (fFollowSymlinks)
-                                tr = pAddToContents->getResolvedType();   // This calls follow() and we don't have to typecast here.
+                            if (fnAdded)
+                                fnAdded(pAdded);
 
-                        if (    (getContents == Get::FIRST_FOLDER_ONLY)
-                             && (!pAddToContents->isHidden())
-                           )
-                        {
-                            if (t == FSType::DIRECTORY)
-                                break;      // we're done
-                            else if (t == FSType::SYMLINK)
+                            if (    (getContents == Get::FIRST_FOLDER_ONLY)
+                                 && (!pAdded->isHidden())
+                               )
                             {
-                                if (!fFollowSymlinks)
-                                    // Not yet followed above:
-                                    tr = pAddToContents->getResolvedType();
-                                if (tr == FSTypeResolved::SYMLINK_TO_DIRECTORY)
-                                    break;
+                                if (t == FSType::DIRECTORY)
+                                    break;      // we're done
+                                else if (t == FSType::SYMLINK)
+                                {
+                                    if (!fFollowSymlinks)
+                                        // Not yet followed above:
+                                        tr = pAdded->getResolvedType();
+                                    if (tr == FSTypeResolved::SYMLINK_TO_DIRECTORY)
+                                        break;
+                                }
                             }
                         }
                     }
                 }
+
+                if (    (!fStopped)
+                     && (!vSymlinks.empty())
+                   )
+                    fStopped = FollowSymlinks(vSymlinks, pStopFlag, fnAdded);
             }
         }
 
         if (!fStopped)
         {
             ContentsLock cLock(*this);
-            for (auto it = _pImpl->mapContents.begin();
-                 it != _pImpl->mapContents.end();
-                )
+            PFsObject pParentOfThis = _refBase.getParent();
+            // Removing from the index doesn't touch the sorted vector, so we can
+            // iterate over it and remove at the same time.
+            for (auto &p : _pImpl->indexContents.getSorted())
             {
-                auto &p = it->second;
                 if (    (getContents == Get::ALL)
                      && (p->_fl.test(FSFlag::DIRTY))
                    )
                 {
-                    Debug::Log(FOLDER_POPULATE_HIGH, "Removing dirty file " + quote(p->getBasename()));
+                    DEBUG_LOG(FOLDER_POPULATE_HIGH, "Removing dirty file " + quote(p->getBasename()));
                     if (pvFilesRemoved)
                         pvFilesRemoved->push_back(p);
-                    _pImpl->removeImpl(cLock, it);
-                    // Note the post increment. http://stackoverflow.com/questions/180516/how-to-filter-items-from-a-stdmap/180616#180616
-                    it++;
+                    _pImpl->removeImpl(cLock, p);
                 }
                 else
                 {
                     // Leave out ".." in the list.
-                    if (p != _refBase._pParent)
+                    if (p != pParentOfThis)
                     {
                         if (    (getContents == Get::ALL)
                              || (p->getType() == FSType::DIRECTORY)
@@ -835,8 +1120,6 @@ FsContainer::getContents(FsVector &vFiles,
                             }
                         }
                     }
-
-                    ++it;
                 }
             }
 
@@ -847,11 +1130,10 @@ FsContainer::getContents(FsVector &vFiles,
             if (    (getContents == Get::FIRST_FOLDER_ONLY)
                  && (!c)
                )
-                for (auto it : _pImpl->mapContents)
+                for (auto &p : _pImpl->indexContents.getSorted())
                 {
-                    auto &p = it.second;
                     // Leave out ".." in the list.
-                    if (p != _refBase._pParent)
+                    if (p != pParentOfThis)
                         if (p->getResolvedType() == FSTypeResolved::SYMLINK_TO_DIRECTORY)
                         {
                             vFiles.push_back(p);
@@ -860,14 +1142,27 @@ FsContainer::getContents(FsVector &vFiles,
                         }
                 }
 
-            FsLock lock2Temp;
-            if (getContents == Get::FOLDERS_ONLY)
-                _refBase._fl.set(FSFlag::POPULATED_WITH_DIRECTORIES);
-            else if (getContents == Get::ALL)
+            if (    (getContents == Get::ALL)
+                 || (fUnchanged)
+               )
             {
                 _refBase._fl.set(FSFlag::POPULATED_WITH_DIRECTORIES);
                 _refBase._fl.set(FSFlag::POPULATED_WITH_ALL);
             }
+            else if (getContents == Get::FOLDERS_ONLY)
+                _refBase._fl.set(FSFlag::POPULATED_WITH_DIRECTORIES);
+
+            if (    (pEnumerator)
+                 || (fUnchanged)
+               )
+                _refBase._fl.clear(FSFlag::REFRESH_FROM_DISK);
+
+            // Remember the stamp if we have just read all entries from disk.
+            if (    (pEnumerator)
+                 && (getContents == Get::ALL)
+                 && (!_refBase._fl.test(FSFlag::POPULATED_FROM_CACHE))
+               )
+                _pImpl->uContentsStamp = uStamp;
         } // if (!fStopped)
     }
     catch (FSException &e)
@@ -875,15 +1170,422 @@ FsContainer::getContents(FsVector &vFiles,
         strException = e.what();
     }
 
-    _refBase._fl.clear(FSFlag::POPULATING);
-    g_condFolderPopulated.notify_all();
+    {
+        // Clear the flag under the same mutex that the waiters above test it with, or
+        // one of them could miss the notification.
+        Lock lock(_pImpl->mutexFind);
+        _refBase._fl.clear(FSFlag::POPULATING);
+    }
+    GetWaitCondition(this).notify_all();
 
     if (!strException.empty())
         throw FSException(strException);
 
+    if (    (pEnumerator)
+         && (!fStopped)
+         && (getContents == Get::ALL)
+       )
+        g_pFsImpl->onContentsPopulated(*this,
+                                       pEnumerator,
+                                       FsVector(vFiles.end() - c, vFiles.end()));
+
+    if (    (pEnumerator)
+         && (g_cbMemoryBudget)
+         && (g_cObjectsAwake * FSOBJECT_BYTES_ESTIMATE > g_cbMemoryBudget)
+       )
+        EvictLRU();
+
     return c;
 }
 
+/**
+ *  Helper for getContents() for a directory entry that the enumerator has only returned
+ *  the name for. This wakes up the object with FsImplBase::makeAwake() and returns it, or
+ *  returns nullptr if the entry has disappeared since it was enumerated.
+ *
+ *  With fKeepAwake, if an object of that name is awake already and matches what the
+ *  enumerator told us about the entry in id, this keeps it as it is without any I/O,
+ *  clears its dirty flag and returns nullptr. If the inode number or the type differ,
+ *  the name now refers to another file (renamed over it, or deleted and recreated),
+ *  and the entry is woken up so that mergeChild() replaces the old object.
+ */
+PFsObject
+FsContainer::wakeUpEntry(const string &strThisPath,
+                         const string &strBasename,
+                         const FsDirEntryID &id,
+                         bool fIsLocal,
+                         bool fKeepAwake)
+{
+    if (fKeepAwake)
+    {
+        ContentsLock cLock(*this);
+        PFsObject pAwake;
+        if ((pAwake = _pImpl->isAwake(cLock, strBasename)))
+        {
+            if (    (    (id.type == FSType::UNINITIALIZED)
+                      || (id.type == pAwake->_type)
+                    )
+                 && (    (!id.uInode)
+                      || (!pAwake->_uInode)
+                      || (id.uInode == pAwake->_uInode)
+                    )
+               )
+            {
+                pAwake->_fl.clear(FSFlag::DIRTY);
+                return nullptr;
+            }
+
+            DEBUG_LOG(FOLDER_POPULATE_HIGH, quote(strBasename) + " has been replaced, waking it up again");
+        }
+    }
+
+    try
+    {
+        // This may return nullptr for types that the backend doesn't handle.
+        return g_pFsImpl->makeAwake(strThisPath, strBasename, fIsLocal);
+    }
+    catch (FSException &e)
+    {
+        // The file may have been deleted since we enumerated the names.
+        DEBUG_LOG(FOLDER_POPULATE_HIGH, "Skipping " + quote(strBasename) + ": " + e.what());
+    }
+
+    return nullptr;
+}
+
+/**
+ *  Helper for getContents() which merges one directory entry that the backend has
+ *  just given us into the contents map. pTemp is the fresh object for that entry.
+ *
+ *  If an object of that name is already awake and compares equal to pTemp, its
+ *  dirty flag is cleared and it is kept. Otherwise the old object (if any) is removed,
+ *  and pTemp is added instead, unless it's a plain file and we're not populating
+ *  with Get::ALL.
+ *
+ *  Returns pTemp if it was added to the contents, or nullptr otherwise.
+ */
+PFsObject
+FsContainer::mergeChild(ContentsLock &cLock,
+                        const string &strBasename,
+                        PFsObject pTemp,
+                        Get getContents,
+                        FsVector *pvFilesAdded,
+                        FsVector *pvFilesRemoved)
+{
+    // Check if the object is already in this container.
+    PFsObject pAwake = _pImpl->isAwake(cLock, strBasename);
+
+    if (    (pAwake)
+        // Use our operator== to compare, which which check timestamps and size.
+         && (*pAwake == *pTemp)
+       )
+    {
+        // Cached item valid: clear the dirty flag.
+        pAwake->_fl.clear(FSFlag::DIRTY);
+        // Objects from a snapshot don't know their inode yet.
+        if (!pAwake->_uInode)
+            pAwake->_uInode = pTemp->_uInode;
+        return nullptr;
+    }
+
+    PFsObject pAddToContents;
+
+    if (pAwake)
+    {
+        // Type of file changed: then remove it from the folder before adding the new one.
+        if (pvFilesRemoved)
+            pvFilesRemoved->push_back(pAwake);
+        _pImpl->removeImpl(cLock, pAwake);
+    }
+
+    switch (pTemp->getType())
+    {
+        case FSType::DIRECTORY:
+        {
+            // Always wake up directories.
+            DEBUG_SCOPE(d, FILE_LOW, "Waking up directory " + strBasename);
+            pAddToContents = pTemp;
+        }
+        break;
+
+        case FSType::SYMLINK:
+        {
+            // Need to wake up the symlink to figure out if it's a link to a dir.
+            DEBUG_SCOPE(d, FILE_LOW, "Waking up symlink " + strBasename);
+            pAddToContents = pTemp;
+        }
+        break;
+
+        default:
+            // Ordinary file:
+            if (getContents == Get::ALL)
+            {
+                DEBUG_SCOPE(d, FILE_LOW, "Waking up plain file " + strBasename);
+                pAddToContents = pTemp;
+            }
+        break;
+    }
+
+    if (pAddToContents)
+    {
+        this->addChild(cLock, pAddToContents);
+        if (pvFilesAdded)
+            pvFilesAdded->push_back(pAddToContents);
+    }
+
+    return pAddToContents;
+}
+
+/**
+ *  Directories with fewer entries than this per worker thread are not worth spreading
+ *  over several threads.
+ */
+#define MIN_ENTRIES_PER_WORKER      256
+
+/**
+ *  Helper for getContents() with more than one worker thread. pEnumerator must have
+ *  been created with fNamesOnly = true. This reads all names from the enumerator first
+ *  and then has cWorkerThreads threads (including the calling one) pick names from
+ *  that list, wake up objects for them with wakeUpEntry() (unless the enumerator
+ *  has returned an object for the name anyway) and merge them
+ *  into the contents with mergeChild(), which works exactly like the single-threaded
+ *  loop in getContents(), so the dirty, added and removed bookkeeping is the same.
+ *  If pvSymlinks is not nullptr, new symlinks are appended to it instead of being reported
+ *  to fnAdded, for FollowSymlinks(). fKeepAwake is passed on to wakeUpEntry().
+ *
+ *  Returns true if the stop flag was set.
+ */
+bool
+FsContainer::populateParallel(PFsDirEnumeratorBase pEnumerator,
+                              Get getContents,
+                              FsVector *pvFilesAdded,
+                              FsVector *pvFilesRemoved,
+                              StopFlag *pStopFlag,
+                              FsVector *pvSymlinks,
+                              uint cWorkerThreads,
+                              bool fKeepAwake,
+                              const FnFsObjectAdded &fnAdded)
+{
+    struct Entry
+    {
+        string          strName;
+        PFsObject       pTemp;
+        FsDirEntryID    id;
+    };
+    vector<Entry> vEntries;
+    string strBasename;
+    PFsObject pTemp;
+    while (g_pFsImpl->getNextChild(pEnumerator, strBasename, pTemp))
+    {
+        if (pStopFlag)
+            if (*pStopFlag)
+                return true;
+        vEntries.push_back({ strBasename, pTemp, pEnumerator->idCurrent });
+    }
+
+    cWorkerThreads = min<size_t>(cWorkerThreads, vEntries.size() / MIN_ENTRIES_PER_WORKER + 1);
+    DEBUG_SCOPE(d, FOLDER_POPULATE_HIGH, string(__func__) + "(): waking up " + to_string(vEntries.size()) + " entries on " + to_string(cWorkerThreads) + " thread(s)");
+
+    string strThisPath = _refBase.getPathImpl();
+    bool fIsLocal = _refBase.hasFlag(FSFlag::IS_LOCAL);
+
+    atomic<size_t> iNext(0);
+    atomic<bool> fStopped(false);
+    Mutex mutexError;
+    string strError;
+    Mutex mutexSymlinks;
+
+    auto fnWorker = [&]()
+    {
+        try
+        {
+            size_t i;
+            while ((i = iNext++) < vEntries.size())
+            {
+                if (pStopFlag)
+                    if (*pStopFlag)
+                    {
+                        fStopped = true;
+                        break;
+                    }
+
+                const string &strName = vEntries[i].strName;
+                PFsObject pTemp2 = vEntries[i].pTemp;
+                if (!pTemp2)
+                    if (!(pTemp2 = wakeUpEntry(strThisPath, strName, vEntries[i].id, fIsLocal, fKeepAwake)))
+                        continue;
+
+                PFsObject pAdded;
+                {
+                    ContentsLock cLock(*this);
+                    pAdded = mergeChild(cLock,
+                                        strName,
+                                        pTemp2,
+                                        getContents,
+                                        pvFilesAdded,
+                                        pvFilesRemoved);
+                }
+
+                if (pAdded)
+                {
+                    if (    (pvSymlinks)
+                         && (pAdded->getType() == FSType::SYMLINK)
+                       )
+                    {
+                        Lock lock(mutexSymlinks);
+                        pvSymlinks->push_back(pAdded);
+                    }
+                    else if (fnAdded)
+                        fnAdded(pAdded);
+                }
+            }
+        }
+        catch (exception &e)
+        {
+            Lock lock(mutexError);
+            if (strError.empty())
+                strError = e.what();
+        }
+    };
+
+    vector<std::thread*> vThreads;
+    for (uint u = 1; u < cWorkerThreads; ++u)
+        vThreads.push_back(XWP::Thread::Create([&fnWorker]()
+                                               {
+                                                   TraceSink::SetThreadName("getContents worker");
+                                                   fnWorker();
+                                               },
+                                               false));     // fDetach
+    fnWorker();
+    for (auto pThread : vThreads)
+    {
+        pThread->join();
+        delete pThread;
+    }
+
+    if (!strError.empty())
+        throw FSException(strError);
+
+    return fStopped;
+}
+
+/**
+ *  Symlinks are followed on at most this many threads. Following is mostly waiting for
+ *  readlink() and stat() rather than computing, so this is not tied to the number of CPUs.
+ */
+#define MAX_SYMLINK_WORKERS         8
+
+/**
+ *  Batches with fewer symlinks than this per thread are not worth starting threads for.
+ */
+#define MIN_SYMLINKS_PER_WORKER     64
+
+/**
+ *  Helper for getContents() which follows all the given symlinks, which must be FsSymlink
+ *  instances, on up to MAX_SYMLINK_WORKERS threads (including the calling one) and calls
+ *  fnAdded for each right after it has been followed.
+ *
+ *  Directories full of symlinks tend to have lots of them point to the same few targets,
+ *  so each target path is only looked up once per batch; threads that need a target which
+ *  another thread is looking up wait for its result.
+ *
+ *  Returns true if the stop flag was set.
+ */
+/* static */
+bool
+FsContainer::FollowSymlinks(const FsVector &vSymlinks,
+                            StopFlag *pStopFlag,
+                            const FnFsObjectAdded &fnAdded)
+{
+    size_t cThreads = min<size_t>(MAX_SYMLINK_WORKERS, vSymlinks.size() / MIN_SYMLINKS_PER_WORKER + 1);
+    DEBUG_SCOPE(d, FOLDER_POPULATE_HIGH, string(__func__) + "(): following " + to_string(vSymlinks.size()) + " symlinks on " + to_string(cThreads) + " thread(s)");
+
+    Mutex mutexTargets;
+    map<string, shared_future<PFsObject>> mapTargets;
+    FsSymlink::FnFindTarget fnFind = [&](const string &strTarget) -> PFsObject
+    {
+        unique_lock<Mutex> lock(mutexTargets);
+        auto it = mapTargets.find(strTarget);
+        if (it != mapTargets.end())
+        {
+            shared_future<PFsObject> futureTarget = it->second;
+            lock.unlock();
+            // This rethrows the exception if the lookup failed.
+            return futureTarget.get();
+        }
+
+        promise<PFsObject> promiseTarget;
+        mapTargets[strTarget] = promiseTarget.get_future().share();
+        lock.unlock();
+
+        try
+        {
+            PFsObject pTarget = g_pFsImpl->findPath(strTarget);
+            promiseTarget.set_value(pTarget);
+            return pTarget;
+        }
+        catch (...)
+        {
+            promiseTarget.set_exception(current_exception());
+            throw;
+        }
+    };
+
+    atomic<size_t> iNext(0);
+    atomic<bool> fStopped(false);
+    Mutex mutexError;
+    string strError;
+
+    auto fnWorker = [&]()
+    {
+        try
+        {
+            size_t i;
+            while ((i = iNext++) < vSymlinks.size())
+            {
+                if (pStopFlag)
+                    if (*pStopFlag)
+                    {
+                        fStopped = true;
+                        break;
+                    }
+
+                PFsObject pFS = vSymlinks[i];
+                static_cast<FsSymlink*>(&*pFS)->follow(&fnFind);
+
+                if (fnAdded)
+                    fnAdded(pFS);
+            }
+        }
+        catch (exception &e)
+        {
+            Lock lock(mutexError);
+            if (strError.empty())
+                strError = e.what();
+        }
+    };
+
+    vector<std::thread*> vThreads;
+    for (uint u = 1; u < cThreads; ++u)
+        vThreads.push_back(XWP::Thread::Create([&fnWorker]()
+                                               {
+                                                   TraceSink::SetThreadName("symlink follower");
+                                                   fnWorker();
+                                               },
+                                               false));     // fDetach
+    fnWorker();
+    for (auto pThread : vThreads)
+    {
+        pThread->join();
+        delete pThread;
+    }
+
+    if (!strError.empty())
+        throw FSException(strError);
+
+    return fStopped;
+}
+
 PFsDirectory
 FsContainer::createSubdirectory(const string &strName)
 {
@@ -920,7 +1622,7 @@ FsContainer::createEmptyDocument(const string &strName)
 void
 FsContainer::notifyFileAdded(PFsObject pFS) const
 {
-    Debug d(FILEMONITORS, string(__func__) + "(" + pFS->getPath() + ")");
+    DEBUG_SCOPE(d, FILEMONITORS, string(__func__) + "(" + pFS->getPath() + ")");
     FsLock lock;
     for (auto &pMonitor : _pImpl->llMonitors)
         pMonitor->onItemAdded(pFS);
@@ -929,7 +1631,7 @@ FsContainer::notifyFileAdded(PFsObject pFS) const
 void
 FsContainer::notifyFileRemoved(PFsObject pFS) const
 {
-    Debug d(FILEMONITORS, string(__func__) + "(" + pFS->getPath() + ")");
+    DEBUG_SCOPE(d, FILEMONITORS, string(__func__) + "(" + pFS->getPath() + ")");
     FsLock lock;
     for (auto &pMonitor : _pImpl->llMonitors)
         pMonitor->onItemRemoved(pFS);
@@ -938,12 +1640,348 @@ FsContainer::notifyFileRemoved(PFsObject pFS) const
 void
 FsContainer::notifyFileRenamed(PFsObject pFS, const string &strOldName, const string &strNewName) const
 {
-    Debug d(FILEMONITORS, string(__func__) + "(" + strOldName + " -> " + strNewName + ")");
+    DEBUG_SCOPE(d, FILEMONITORS, string(__func__) + "(" + strOldName + " -> " + strNewName + ")");
     FsLock lock;
     for (auto &pMonitor : _pImpl->llMonitors)
         pMonitor->onItemRenamed(pFS, strOldName, strNewName);
 }
 
+void
+FsContainer::notifyFileChanged(PFsObject pFS) const
+{
+    DEBUG_SCOPE(d, FILEMONITORS, string(__func__) + "(" + pFS->getPath() + ")");
+    FsLock lock;
+    for (auto &pMonitor : _pImpl->llMonitors)
+        pMonitor->onItemChanged(pFS);
+}
+
+void
+FsContainer::notifyFilesAdded(const FsVector &vFiles) const
+{
+    if (vFiles.empty())
+        return;
+
+    DEBUG_SCOPE(d, FILEMONITORS, string(__func__) + "(" + to_string(vFiles.size()) + " files in " + _refBase.getPath() + ")");
+    FsLock lock;
+    for (auto &pMonitor : _pImpl->llMonitors)
+        pMonitor->onItemsAdded(vFiles);
+}
+
+void
+FsContainer::notifyFilesRemoved(const FsVector &vFiles) const
+{
+    if (vFiles.empty())
+        return;
+
+    DEBUG_SCOPE(d, FILEMONITORS, string(__func__) + "(" + to_string(vFiles.size()) + " files in " + _refBase.getPath() + ")");
+    FsLock lock;
+    for (auto &pMonitor : _pImpl->llMonitors)
+        pMonitor->onItemsRemoved(vFiles);
+}
+
+void
+FsContainer::revalidateEntry(const string &strBasename,
+                             FsVector &vAdded,
+                             FsVector &vRemoved,
+                             FsVector &vChanged)
+{
+    DEBUG_SCOPE(d, FILEMONITORS, string(__func__) + "(" + quote(strBasename) + ")");
+
+    // Stat without holding the lock. nullptr means the entry is gone.
+    PFsObject pNew;
+    try
+    {
+        pNew = g_pFsImpl->makeAwake(_refBase.getPathImpl(),
+                                    strBasename,
+                                    _refBase.hasFlag(FSFlag::IS_LOCAL));
+    }
+    catch (FSException &e)
+    {
+        // Unreadable now, which is treated like gone.
+    }
+
+    ContentsLock cLock(*this);
+    PFsObject pAwake;
+    if ((pAwake = _pImpl->isAwake(cLock, strBasename)))
+    {
+        if (    (pNew)
+             && (pNew->getType() == pAwake->getType())
+           )
+        {
+            if (    (*pNew == *pAwake)
+                 || (pNew->getType() == FSType::DIRECTORY)
+                 || (pNew->getType() == FSType::SYMLINK)
+               )
+                return;
+
+            _pImpl->removeImpl(cLock, pAwake);
+            this->addChild(cLock, pNew);
+            vChanged.push_back(pNew);
+            return;
+        }
+
+        _pImpl->removeImpl(cLock, pAwake);
+        vRemoved.push_back(pAwake);
+    }
+
+    if (    (pNew)
+         && (    (isCompletelyPopulated())
+              || (    (isPopulatedWithDirectories())
+                   && (    (pNew->getType() == FSType::DIRECTORY)
+                        || (pNew->getType() == FSType::SYMLINK)
+                      )
+                 )
+            )
+       )
+    {
+        this->addChild(cLock, pNew);
+        vAdded.push_back(pNew);
+    }
+}
+
+PFsObject
+FsContainer::renameEntry(const string &strOldName,
+                         const string &strNewName)
+{
+    DEBUG_SCOPE(d, FILEMONITORS, string(__func__) + "(" + quote(strOldName) + " -> " + quote(strNewName) + ")");
+
+    ContentsLock cLock(*this);
+    PFsObject pFS;
+    if (    (!(pFS = _pImpl->isAwake(cLock, strOldName)))
+         || (_pImpl->isAwake(cLock, strNewName))
+       )
+        return nullptr;
+
+    // Same as in FsObject::rename(), minus the disk.
+    removeChild(cLock, pFS);
+    pFS->_strBasename = strNewName;
+    addChild(cLock, pFS);
+    ++g_uPathGeneration;
+
+    return pFS;
+}
+
+/* static */
+void
+FsContainer::SetMemoryBudget(uint64_t cbBudget)
+{
+    g_cbMemoryBudget = cbBudget;
+}
+
+/* static */
+FsCacheStats
+FsContainer::GetCacheStats()
+{
+    Lock lock(g_mutexLRU);
+    FsCacheStats stats = g_cacheStats;
+    stats.cObjectsAwake = g_cObjectsAwake;
+    stats.cbEstimated = stats.cObjectsAwake * FSOBJECT_BYTES_ESTIMATE;
+    stats.cbBudget = g_cbMemoryBudget;
+    stats.cContainersTracked = g_llLRU.size();
+    return stats;
+}
+
+/**
+ *  Puts this container on the LRU list for eviction if it isn't there yet. With
+ *  fMoveToBack, it is also marked as the most recently used one. Does nothing unless
+ *  a memory budget has been set.
+ */
+void
+FsContainer::touchLRU(bool fMoveToBack)
+{
+    if (    (!g_cbMemoryBudget)
+         || (    (!fMoveToBack)
+              && (_pImpl->fInLRU)
+            )
+       )
+        return;
+
+    Lock lock(g_mutexLRU);
+    if (_pImpl->fInLRU)
+        g_llLRU.splice(g_llLRU.end(), g_llLRU, _pImpl->itLRU);
+    else
+    {
+        _pImpl->itLRU = g_llLRU.insert(g_llLRU.end(), _refBase.shared_from_this());
+        _pImpl->fInLRU = true;
+    }
+}
+
+/**
+ *  Helper for EvictLRU(), which must hold g_mutexLRU. If none of the container's children
+ *  is referenced by anything but the contents index and none of them has children of its
+ *  own, this removes all of them from the index, moves them to vEvicted, clears the
+ *  container's populated flags and returns true. Otherwise this changes nothing and
+ *  returns false.
+ *
+ *  This must never block, since EvictLRU() holds g_mutexLRU, which threads that hold any
+ *  of the locks below may request, e.g. when their last reference to a container goes
+ *  away. So all locks are only tried.
+ */
+bool
+FsContainer::evictContents(FsVector &vEvicted)
+{
+    // Claim the container like getContents() does so that nobody populates it meanwhile.
+    {
+        unique_lock<recursive_mutex> lockFind(_pImpl->mutexFind, try_to_lock);
+        if (    (!lockFind.owns_lock())
+             || (_refBase._fl.test(FSFlag::POPULATING))
+           )
+            return false;
+        _refBase._fl.set(FSFlag::POPULATING);
+    }
+
+    bool fEvicted = false;
+    unique_lock<recursive_mutex> lockFs(g_mutexFiles2, try_to_lock);
+    if (    (lockFs.owns_lock())
+         && (_pImpl->llMonitors.empty())
+       )
+    {
+        lockFs.unlock();
+
+        unique_lock<recursive_mutex> lockContents(_pImpl->mutexContents, try_to_lock);
+        if (lockContents.owns_lock())
+        {
+            FsContentsIndex &index = _pImpl->indexContents;
+            // The sorted vector holds a second reference to every child.
+            index.dropSorted();
+
+            bool fInUse = false;
+            index.forEach([&fInUse](const PFsObject &p)
+            {
+                if (fInUse)
+                    return;
+                if (p.use_count() > 1)
+                    fInUse = true;
+                else
+                {
+                    // Not getContainer(), which follows symlinks.
+                    FsContainer *pCnr = nullptr;
+                    if (p->getType() == FSType::DIRECTORY)
+                        pCnr = static_cast<FsDirectory*>(&*p);
+                    else if (p->getType() == FSType::SYMLINK)
+                        pCnr = static_cast<FsSymlink*>(&*p);
+                    if (pCnr)
+                    {
+                        unique_lock<recursive_mutex> lockChild(pCnr->_pImpl->mutexContents, try_to_lock);
+                        if (    (!lockChild.owns_lock())
+                             || (pCnr->_pImpl->indexContents.size())
+                           )
+                            fInUse = true;
+                    }
+                }
+            });
+
+            if (!fInUse)
+            {
+                // Detach the children like removeImpl() does, since FindCachedPath() can
+                // still get hold of one through its weak reference and must not accept it.
+                bool fPathsChanged = false;
+                index.forEach([&vEvicted, &fPathsChanged](const PFsObject &p)
+                {
+                    vEvicted.push_back(p);
+                    p->_pParent.reset();
+                    p->resetPathCache();
+                    p->clearFlag(FSFlag::IS_LOCAL);
+                    if (p->getType() != FSType::FILE)
+                        fPathsChanged = true;
+                });
+                index.clear();
+                if (fPathsChanged)
+                    ++g_uPathGeneration;
+
+                // The next getContents() must read everything again.
+                _pImpl->uContentsStamp = 0;
+                _refBase._fl.clear(FSFlag::POPULATED_WITH_ALL);
+                _refBase._fl.clear(FSFlag::POPULATED_WITH_DIRECTORIES);
+                _refBase._fl.clear(FSFlag::POPULATED_FROM_CACHE);
+                fEvicted = true;
+            }
+        }
+    }
+
+    {
+        Lock lock(_pImpl->mutexFind);
+        _refBase._fl.clear(FSFlag::POPULATING);
+    }
+    GetWaitCondition(this).notify_all();
+
+    return fEvicted;
+}
+
+/**
+ *  Called by getContents() when the awake objects exceed the memory budget. This goes
+ *  through the LRU list from the least recently used container and evicts the contents
+ *  of each that allows it, until the objects are below 90% of the budget. Since evicting
+ *  the contents of a container can make its parent evictable, this takes several passes
+ *  if necessary.
+ *
+ *  Only one thread evicts at a time; others just return.
+ */
+/* static */
+void
+FsContainer::EvictLRU()
+{
+    bool fExpected = false;
+    if (!g_fEvicting.compare_exchange_strong(fExpected, true))
+        return;
+
+    uint64_t cLowWater = g_cbMemoryBudget / FSOBJECT_BYTES_ESTIMATE / 10 * 9;
+    DEBUG_SCOPE(d, FILE_HIGH, string(__func__) + "(): " + to_string(g_cObjectsAwake) + " objects awake, evicting down to " + to_string(cLowWater));
+
+    {
+        Lock lock(g_mutexLRU);
+        ++g_cacheStats.cEvictionRuns;
+
+        bool fProgress = true;
+        while (    (fProgress)
+                && (g_cObjectsAwake > cLowWater)
+              )
+        {
+            fProgress = false;
+
+            // Work on a copy, since destroying objects removes entries from the list.
+            vector<weak_ptr<FsObject>> vLRU(g_llLRU.begin(), g_llLRU.end());
+            FsVector vEvicted;
+            for (auto &pw : vLRU)
+            {
+                if (g_cObjectsAwake - vEvicted.size() <= cLowWater)
+                    break;
+
+                PFsObject pObject;
+                if (!(pObject = pw.lock()))
+                    continue;
+
+                FsContainer *pCnr = nullptr;
+                if (pObject->getType() == FSType::DIRECTORY)
+                    pCnr = static_cast<FsDirectory*>(&*pObject);
+                else if (pObject->getType() == FSType::SYMLINK)
+                    pCnr = static_cast<FsSymlink*>(&*pObject);
+                if (!pCnr)
+                    continue;
+
+                size_t cBefore = vEvicted.size();
+                if (pCnr->evictContents(vEvicted))
+                {
+                    ++g_cacheStats.cContainersEvicted;
+                    g_cacheStats.cObjectsEvicted += vEvicted.size() - cBefore;
+                    // An empty container stays empty until it is used again.
+                    g_llLRU.erase(pCnr->_pImpl->itLRU);
+                    pCnr->_pImpl->fInLRU = false;
+                    fProgress = true;
+                }
+                else
+                    ++g_cacheStats.cContainersSkipped;
+            }
+
+            // This destroys the evicted objects unless someone has picked one up in the
+            // meantime, which is harmless.
+        }
+    }
+
+    d.Log(FILE_HIGH, to_string(g_cObjectsAwake) + " objects awake afterwards");
+    g_fEvicting = false;
+}
+
 
 /***************************************************************************
  *
@@ -1005,14 +2043,14 @@ PFsSymlink
 FsSymlink::Create(const string &strBasename,
                   uint64_t uLastModified)
 {
-    /* This nasty trickery is necessary to make make_shared work with a protected constructor. */
+    /* This nasty trickery is necessary to make allocate_shared work with a protected constructor. */
     class Derived : public FsSymlink
     {
     public:
         Derived(const string &strBasename, uint64_t uLastModified) : FsSymlink(strBasename, uLastModified) { }
     };
 
-    return make_shared<Derived>(strBasename, uLastModified);
+    return allocate_shared<Derived>(SlabAllocator<Derived>(), strBasename, uLastModified);
 }
 
 PFsObject
@@ -1022,10 +2060,8 @@ FsSymlink::getTarget()
     return _pTarget;
 }
 
-condition_variable_any g_condSymlinkResolved;
-
 FsSymlink::State
-FsSymlink::follow()
+FsSymlink::follow(const FnFindTarget *pfnFind /* = nullptr */)
 {
     // Make sure that only one thread resolves this link at a time. We
     // set the link's state to State::RESOLVING below while we're following,
@@ -1035,7 +2071,7 @@ FsSymlink::follow()
     // other thread.
     unique_lock<recursive_mutex> lock(_mutexState);
     while (_state == State::RESOLVING)
-        g_condSymlinkResolved.wait(lock);
+        GetWaitCondition(this).wait(lock);
 
     // Lock is held again now.
     // Either we're the only thread, or the other thread is done following.
@@ -1043,16 +2079,17 @@ FsSymlink::follow()
 
     if (_state == State::NOT_FOLLOWED_YET)
     {
-        Debug d(FILE_MID, "FsSymlink::follow(" + quote(getPath()) + "): not followed yet, resolving");
+        DEBUG_SCOPE(d, FILE_MID, "FsSymlink::follow(" + quote(getPath()) + "): not followed yet, resolving");
 
-        if (!_pParent)
+        PFsObject pParent;
+        if (!(pParent = getParent()))
             throw FSException("symlink with no parent no good");
 
         _state = State::RESOLVING;
         lock.unlock();
 
-        string strParentDir = _pParent->getPathImpl();
-        Debug::Log(FILE_LOW, "parent = \"" + strParentDir + "\"");
+        string strParentDir = pParent->getPathImpl();
+        DEBUG_LOG(FILE_LOW, "parent = \"" + strParentDir + "\"");
 
         string strThisPath = quote(this->getPath());
 
@@ -1062,7 +2099,7 @@ FsSymlink::follow()
 
             if (strContents.empty())
             {
-                Debug::Log(FILE_MID, "readlink(" + strThisPath + ") returned empty string -> BROKEN_SYMLINK");
+                DEBUG_LOG(FILE_MID, "readlink(" + strThisPath + ") returned empty string -> BROKEN_SYMLINK");
                 lock.lock();
                 _state = State::BROKEN;
             }
@@ -1079,7 +2116,7 @@ FsSymlink::follow()
                     strTarget += strContents;
                 }
 
-                auto pTarget = g_pFsImpl->findPath(strTarget);
+                auto pTarget = (pfnFind) ? (*pfnFind)(strTarget) : g_pFsImpl->findPath(strTarget);
                 if (pTarget)
                 {
                     lock.lock();
@@ -1103,20 +2140,27 @@ FsSymlink::follow()
                         break;
                     }
 
-                    Debug::Log(FILE_MID, "Woke up symlink target \"" + strTarget + "\", state: " + to_string((int)_state));
+                    DEBUG_LOG(FILE_MID, "Woke up symlink target \"" + strTarget + "\", state: " + to_string((int)_state));
+                }
+                else
+                {
+                    // Must not leave the state at RESOLVING or waiters would block forever.
+                    DEBUG_LOG(FILE_HIGH, "Symlink target of " + strThisPath + " not found --> BROKEN");
+                    lock.lock();
+                    _state = State::BROKEN;
                 }
             }
         }
         catch (...)
         {
-            Debug::Log(FILE_HIGH, "Could not find symlink target of " + strThisPath + " --> BROKEN");
+            DEBUG_LOG(FILE_HIGH, "Could not find symlink target of " + strThisPath + " --> BROKEN");
             lock.lock();
             _state = State::BROKEN;
         }
 
         // Post the condition variable so that other threads who may be blocked in this function
         // on this symlink will wake up.
-        g_condSymlinkResolved.notify_all();
+        GetWaitCondition(this).notify_all();
     }
 
     return _state;
@@ -0,0 +1,474 @@
+/*
+ * libxwp -- generic helper routines for C++11. (C) 2015--2017 Baubadil GmbH.
+ *
+ * libxwp is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the libxwp main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#include "xwp/fssnapshot.h"
+
+#include "xwp/debug.h"
+#include "xwp/stringhelp.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+
+/***************************************************************************
+ *
+ *  Snapshot file format
+ *
+ **************************************************************************/
+
+/*  A snapshot file consists of:
+ *
+ *   -- a SnapshotHeader;
+ *
+ *   -- the absolute path of the directory (cbPath bytes, no null terminator), since
+ *      the file name is only a hash of it;
+ *
+ *   -- cEntries times a SnapshotEntry followed by the entry's name (cbName bytes).
+ *      Owners are stored as the numeric uid and gid, which FsIdentities turns into
+ *      names only when they are displayed.
+ *
+ *  Everything is in host byte order since snapshots never leave the machine. Records
+ *  are not aligned in the file, so they are always copied out with memcpy(). */
+
+#define SNAPSHOT_MAGIC      "XWPSNAP2"
+
+struct SnapshotHeader
+{
+    char        achMagic[8];
+    uint64_t    uDevice;
+    uint64_t    uInode;
+    uint64_t    uModifiedNs;
+    uint64_t    uChangedNs;
+    uint32_t    cbPath;
+    uint32_t    cEntries;
+};
+
+struct SnapshotEntry
+{
+    uint64_t    cbSize;
+    uint64_t    uLastModified;
+    uint32_t    uid;
+    uint32_t    gid;
+    uint16_t    cbName;
+    uint8_t     type;           // FSType
+    uint8_t     uReserved;
+};
+
+/**
+ *  The directory that snapshots are stored in, or empty if snapshots are disabled.
+ *  Set once by FsSnapshot::Init() at startup.
+ */
+string g_strSnapshotsDir;
+
+/**
+ *  Directories with fewer entries are read from disk about as fast as from a snapshot,
+ *  so Write() does not bother.
+ */
+#define SNAPSHOT_MIN_ENTRIES        64
+
+/**
+ *  When the snapshots take up more than SNAPSHOT_MAX_BYTES, PruneSnapshots() deletes the
+ *  least recently used ones until they are down to SNAPSHOT_PRUNE_TO_BYTES. It runs from
+ *  Write() after every SNAPSHOT_PRUNE_INTERVAL bytes written, and after the first write.
+ */
+#define SNAPSHOT_MAX_BYTES          (64 * 1024 * 1024ull)
+#define SNAPSHOT_PRUNE_TO_BYTES     (SNAPSHOT_MAX_BYTES / 4 * 3)
+#define SNAPSHOT_PRUNE_INTERVAL     (SNAPSHOT_MAX_BYTES / 16)
+
+std::atomic<uint64_t> g_cbWrittenSincePrune(SNAPSHOT_PRUNE_INTERVAL);
+
+/**
+ *  Temporary files from Write() that are older than this were left behind by a crash.
+ */
+#define SNAPSHOT_TEMP_MAX_AGE_S     3600
+
+
+/***************************************************************************
+ *
+ *  Helpers
+ *
+ **************************************************************************/
+
+/**
+ *  Deletes the least recently used snapshots if all of them together exceed
+ *  SNAPSHOT_MAX_BYTES, as well as stale temporary files. A snapshot counts as used when
+ *  it was last read or written, as far as the access time tells; with noatime mounts,
+ *  this degrades to the time it was written.
+ */
+static void
+PruneSnapshots()
+{
+    DEBUG_SCOPE(d, FILE_MID, string(__func__) + "()");
+
+    DIR *pDir = opendir(g_strSnapshotsDir.c_str());
+    if (!pDir)
+        return;
+    int fdDir = dirfd(pDir);
+
+    struct Snapshot
+    {
+        string      strName;
+        uint64_t    cb;
+        time_t      tLastUsed;
+    };
+    vector<Snapshot> vSnapshots;
+    uint64_t cbTotal = 0;
+    time_t tNow = time(nullptr);
+
+    while (struct dirent *pEntry = readdir(pDir))
+    {
+        struct stat st;
+        if (    (pEntry->d_name[0] == '.')
+             || (fstatat(fdDir, pEntry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+             || (!S_ISREG(st.st_mode))
+           )
+            continue;
+
+        if (strchr(pEntry->d_name, '.'))
+        {
+            // Temporary file from Write(), which may still be in progress.
+            if (st.st_mtime + SNAPSHOT_TEMP_MAX_AGE_S < tNow)
+                unlinkat(fdDir, pEntry->d_name, 0);
+            continue;
+        }
+
+        vSnapshots.push_back({ pEntry->d_name, (uint64_t)st.st_size, std::max(st.st_atime, st.st_mtime) });
+        cbTotal += st.st_size;
+    }
+
+    if (cbTotal > SNAPSHOT_MAX_BYTES)
+    {
+        std::sort(vSnapshots.begin(), vSnapshots.end(), [](const Snapshot &a, const Snapshot &b)
+        {
+            return a.tLastUsed < b.tLastUsed;
+        });
+
+        size_t cDeleted = 0;
+        for (auto &snap : vSnapshots)
+        {
+            if (cbTotal <= SNAPSHOT_PRUNE_TO_BYTES)
+                break;
+            if (unlinkat(fdDir, snap.strName.c_str(), 0) == 0)
+            {
+                cbTotal -= snap.cb;
+                ++cDeleted;
+            }
+        }
+        d.setExit("deleted " + to_string(cDeleted) + " of " + to_string(vSnapshots.size()) + " snapshots");
+    }
+
+    closedir(pDir);
+}
+
+
+/***************************************************************************
+ *
+ *  FsSnapshotStamp
+ *
+ **************************************************************************/
+
+/* static */
+FsSnapshotStamp
+FsSnapshotStamp::FromStat(const struct stat &st)
+{
+    FsSnapshotStamp stamp;
+    stamp.uDevice = st.st_dev;
+    stamp.uInode = st.st_ino;
+    stamp.uModifiedNs = (uint64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    stamp.uChangedNs = (uint64_t)st.st_ctim.tv_sec * 1000000000 + st.st_ctim.tv_nsec;
+    return stamp;
+}
+
+/**
+ *  How many nanoseconds a directory must not have been modified for isSettled().
+ */
+#define STAMP_MIN_AGE_NS        (2 * 1000000000ull)
+
+bool
+FsSnapshotStamp::isSettled() const
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t uNowNs = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    return    (uNowNs >= uModifiedNs + STAMP_MIN_AGE_NS)
+           && (uNowNs >= uChangedNs + STAMP_MIN_AGE_NS);
+}
+
+uint64_t
+FsSnapshotStamp::getHash() const
+{
+    uint64_t uHash = 0;
+    for (uint64_t u : { uDevice, uInode, uModifiedNs, uChangedNs })
+        uHash = (uHash ^ u) * 0x9E3779B97F4A7C15ull + 1;
+    return uHash ? uHash : 1;
+}
+
+
+/***************************************************************************
+ *
+ *  FsSnapshot
+ *
+ **************************************************************************/
+
+FsSnapshot::~FsSnapshot()
+{
+    munmap((void*)_pMap, _cbMap);
+}
+
+/* static */
+void
+FsSnapshot::Init(const string &strDirectory)
+{
+    // Create the directory and all missing parents.
+    for (size_t p = 1; p != string::npos; )
+    {
+        p = strDirectory.find('/', p + 1);
+        string strPart = strDirectory.substr(0, p);
+        if (    (mkdir(strPart.c_str(), 0700) != 0)
+             && (errno != EEXIST)
+           )
+        {
+            Debug::Log(DEBUG_ALWAYS, "Cannot create " + quote(strPart) + ", snapshots are disabled: " + strerror(errno));
+            return;
+        }
+    }
+
+    g_strSnapshotsDir = strDirectory;
+}
+
+/* static */
+bool
+FsSnapshot::IsEnabled()
+{
+    return !g_strSnapshotsDir.empty();
+}
+
+/* static */
+PFsSnapshot
+FsSnapshot::Open(const string &strPath,
+                 const FsSnapshotStamp &stamp)
+{
+    if (!IsEnabled())
+        return nullptr;
+
+    string strFile = MakeFileName(strPath);
+    int fd = open(strFile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return nullptr;
+
+    PFsSnapshot pSnapshot;
+    struct stat st;
+    if (    (fstat(fd, &st) == 0)
+         && ((size_t)st.st_size >= sizeof(SnapshotHeader))
+       )
+    {
+        void *pMap = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (pMap != MAP_FAILED)
+        {
+            pSnapshot = PFsSnapshot(new FsSnapshot((const char*)pMap, st.st_size));
+            if (!pSnapshot->parse(strPath, stamp))
+                pSnapshot = nullptr;
+        }
+    }
+    close(fd);
+
+    DEBUG_LOG(FILE_MID, string(__func__) + "(" + quote(strPath) + "): " + (pSnapshot ? to_string(pSnapshot->size()) + " entries" : "no valid snapshot"));
+
+    return pSnapshot;
+}
+
+/* static */
+void
+FsSnapshot::Write(const string &strPath,
+                  const FsSnapshotStamp &stamp,
+                  const FsVector &vContents)
+{
+    if (!IsEnabled())
+        return;
+
+    DEBUG_SCOPE(d, FILE_MID, string(__func__) + "(" + quote(strPath) + ", " + to_string(vContents.size()) + " entries)");
+
+    if (vContents.size() < SNAPSHOT_MIN_ENTRIES)
+        return;
+
+    string strEntries;
+    uint32_t cEntries = 0;
+    for (auto &pFS : vContents)
+    {
+        const string &strName = pFS->getBasename();
+        SnapshotEntry e;
+        memset(&e, 0, sizeof(e));
+        e.cbSize = pFS->getFileSize();
+        e.uLastModified = pFS->getLastModified();
+        // Objects for local files always have numeric owners, except that symlinks have none
+        // at all (ID 0).
+        if (    (    (pFS->getOwnerUser())
+                  && (!FsIdentities::GetNumeric(pFS->getOwnerUser(), e.uid))
+                )
+             || (    (pFS->getOwnerGroup())
+                  && (!FsIdentities::GetNumeric(pFS->getOwnerGroup(), e.gid))
+                )
+           )
+        {
+            DEBUG_LOG(FILE_MID, "Owners of " + quote(strName) + " are not numeric, not writing snapshot");
+            return;
+        }
+        e.cbName = strName.length();
+        e.type = (uint8_t)pFS->getType();
+        strEntries.append((const char*)&e, sizeof(e));
+        strEntries.append(strName);
+        ++cEntries;
+    }
+
+    SnapshotHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.achMagic, SNAPSHOT_MAGIC, sizeof(hdr.achMagic));
+    hdr.uDevice = stamp.uDevice;
+    hdr.uInode = stamp.uInode;
+    hdr.uModifiedNs = stamp.uModifiedNs;
+    hdr.uChangedNs = stamp.uChangedNs;
+    hdr.cbPath = strPath.length();
+    hdr.cEntries = cEntries;
+
+    string strData((const char*)&hdr, sizeof(hdr));
+    strData += strPath;
+    strData += strEntries;
+
+    // Write to a temporary file and rename that over the old snapshot so that readers
+    // never see a half-written file.
+    string strFile = MakeFileName(strPath);
+    string strTemp = strFile + ".XXXXXX";
+    int fd = mkstemp(&strTemp[0]);
+    if (fd == -1)
+    {
+        DEBUG_LOG(FILE_MID, "Cannot create " + quote(strTemp) + ": " + strerror(errno));
+        return;
+    }
+
+    bool fOK = true;
+    for (size_t ofs = 0; ofs < strData.length(); )
+    {
+        ssize_t cb = write(fd, strData.data() + ofs, strData.length() - ofs);
+        if (cb < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fOK = false;
+            break;
+        }
+        ofs += cb;
+    }
+    if (close(fd) != 0)
+        fOK = false;
+
+    if (    (!fOK)
+         || (rename(strTemp.c_str(), strFile.c_str()) != 0)
+       )
+    {
+        DEBUG_LOG(FILE_MID, "Cannot write " + quote(strFile) + ": " + strerror(errno));
+        unlink(strTemp.c_str());
+        return;
+    }
+
+    // Only one of several concurrent writers gets the counter above the interval.
+    if (    ((g_cbWrittenSincePrune += strData.length()) >= SNAPSHOT_PRUNE_INTERVAL)
+         && (g_cbWrittenSincePrune.exchange(0) >= SNAPSHOT_PRUNE_INTERVAL)
+       )
+        PruneSnapshots();
+}
+
+bool
+FsSnapshot::getNext(Entry &e)
+{
+    if (_iNext >= _cEntries)
+        return false;
+
+    SnapshotEntry e2;
+    if (_ofsNext + sizeof(e2) > _cbMap)
+        return false;
+    memcpy(&e2, _pMap + _ofsNext, sizeof(e2));
+    _ofsNext += sizeof(e2);
+
+    if (_ofsNext + e2.cbName > _cbMap)
+    {
+        // Truncated or corrupt: pretend this was the end.
+        _iNext = _cEntries;
+        return false;
+    }
+
+    e.strName.assign(_pMap + _ofsNext, e2.cbName);
+    _ofsNext += e2.cbName;
+    e.type = (FSType)e2.type;
+    e.cbSize = e2.cbSize;
+    e.uLastModified = e2.uLastModified;
+    e.uid = e2.uid;
+    e.gid = e2.gid;
+    ++_iNext;
+
+    return true;
+}
+
+/**
+ *  Checks the header of a freshly mapped snapshot against the given directory path
+ *  and stamp. Returns false if the snapshot is for a different directory, outdated, or
+ *  corrupt.
+ */
+bool
+FsSnapshot::parse(const string &strPath,
+                  const FsSnapshotStamp &stamp)
+{
+    SnapshotHeader hdr;
+    memcpy(&hdr, _pMap, sizeof(hdr));
+    size_t ofs = sizeof(hdr);
+
+    if (    (memcmp(hdr.achMagic, SNAPSHOT_MAGIC, sizeof(hdr.achMagic)))
+         || (hdr.uDevice != stamp.uDevice)
+         || (hdr.uInode != stamp.uInode)
+         || (hdr.uModifiedNs != stamp.uModifiedNs)
+         || (hdr.uChangedNs != stamp.uChangedNs)
+         || (ofs + hdr.cbPath > _cbMap)
+         // A different directory whose path has the same hash.
+         || (strPath.compare(0, string::npos, _pMap + ofs, hdr.cbPath))
+       )
+        return false;
+    ofs += hdr.cbPath;
+
+    _ofsNext = ofs;
+    _cEntries = hdr.cEntries;
+    return true;
+}
+
+/**
+ *  Returns the snapshot file for the given directory path, which is named after a
+ *  64-bit FNV-1a hash of the path.
+ */
+/* static */
+string
+FsSnapshot::MakeFileName(const string &strPath)
+{
+    uint64_t uHash = 0xcbf29ce484222325ull;
+    for (char c : strPath)
+    {
+        uHash ^= (uint8_t)c;
+        uHash *= 0x100000001b3ull;
+    }
+
+    char sz[20];
+    snprintf(sz, sizeof(sz), "%016llx", (unsigned long long)uHash);
+    return g_strSnapshotsDir + "/" + sz;
+}
@@ -0,0 +1,264 @@
+/*
+ * libxwp -- generic helper routines for C++11. (C) 2015--2017 Baubadil GmbH.
+ *
+ * libxwp is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the libxwp main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#include "xwp/slab.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+namespace XWP
+{
+
+/***************************************************************************
+ *
+ *  Globals
+ *
+ **************************************************************************/
+
+#define SLAB_GRANULARITY        16
+#define SLAB_CLASSES            (SlabPool::SLAB_MAX_BLOCK / SLAB_GRANULARITY)
+#define SLAB_SIZE               (64 * 1024)
+
+/**
+ *  How many free blocks a thread keeps per size class before it gives half of them
+ *  back to the global list, and how many it takes from there when it runs out.
+ */
+#define THREAD_CACHE_MAX        64
+#define THREAD_CACHE_BATCH      32
+
+/**
+ *  Free blocks are chained through their first bytes.
+ */
+struct FreeBlock
+{
+    FreeBlock   *pNext;
+};
+
+/**
+ *  The global free list of one size class.
+ */
+struct SizeClass
+{
+    std::mutex  mutex;
+    FreeBlock   *pFree = nullptr;
+};
+
+SizeClass               g_aClasses[SLAB_CLASSES];
+
+std::atomic<uint64_t>   g_cSlabs(0);
+std::atomic<uint64_t>   g_cRefills(0);
+std::atomic<uint64_t>   g_cLarge(0);
+
+/**
+ *  The free blocks that the current thread holds back. This is plain old data so that it
+ *  can still be used safely while other thread-local objects are being destroyed at thread
+ *  exit, which may free objects from the pool; ThreadCacheFlusher returns the blocks when
+ *  the thread ends, and fDead makes later calls bypass the cache.
+ */
+struct ThreadCache
+{
+    FreeBlock   *apFree[SLAB_CLASSES];
+    uint16_t    acFree[SLAB_CLASSES];
+    bool        fDead;
+};
+
+thread_local ThreadCache g_threadCache;     // Zero-initialized.
+
+static void ReturnBlocks(size_t iClass, size_t c);
+
+struct ThreadCacheFlusher
+{
+    ~ThreadCacheFlusher()
+    {
+        for (size_t iClass = 0; iClass < SLAB_CLASSES; ++iClass)
+            ReturnBlocks(iClass, g_threadCache.acFree[iClass]);
+        g_threadCache.fDead = true;
+    }
+};
+
+thread_local ThreadCacheFlusher g_threadCacheFlusher;
+
+
+/***************************************************************************
+ *
+ *  Helpers
+ *
+ **************************************************************************/
+
+/**
+ *  Moves c blocks from the current thread's cache to the global list of the given
+ *  size class.
+ */
+static void
+ReturnBlocks(size_t iClass,
+             size_t c)
+{
+    if (!c)
+        return;
+
+    ThreadCache &cache = g_threadCache;
+    FreeBlock *pFirst = cache.apFree[iClass];
+    FreeBlock *pLast = pFirst;
+    for (size_t i = 1; i < c; ++i)
+        pLast = pLast->pNext;
+    cache.apFree[iClass] = pLast->pNext;
+    cache.acFree[iClass] -= c;
+
+    SizeClass &sc = g_aClasses[iClass];
+    std::lock_guard<std::mutex> lock(sc.mutex);
+    pLast->pNext = sc.pFree;
+    sc.pFree = pFirst;
+}
+
+/**
+ *  Carves a new slab into blocks of the given size and puts them on the global list.
+ *  Caller must hold the size class's mutex.
+ */
+static void
+AddSlab(SizeClass &sc,
+        size_t cbBlock)
+{
+    char *pSlab = (char*)malloc(SLAB_SIZE);
+    if (!pSlab)
+        throw std::bad_alloc();
+    ++g_cSlabs;
+
+    for (size_t ofs = 0; ofs + cbBlock <= SLAB_SIZE; ofs += cbBlock)
+    {
+        FreeBlock *p = (FreeBlock*)(pSlab + ofs);
+        p->pNext = sc.pFree;
+        sc.pFree = p;
+    }
+}
+
+/**
+ *  Moves up to THREAD_CACHE_BATCH blocks of the given size class from the global list
+ *  to the current thread's cache, adding a slab first if the global list is empty.
+ */
+static void
+TakeBlocks(size_t iClass)
+{
+    ThreadCache &cache = g_threadCache;
+    SizeClass &sc = g_aClasses[iClass];
+    std::lock_guard<std::mutex> lock(sc.mutex);
+    if (!sc.pFree)
+        AddSlab(sc, (iClass + 1) * SLAB_GRANULARITY);
+
+    size_t c = 0;
+    while (    (sc.pFree)
+            && (c < THREAD_CACHE_BATCH)
+          )
+    {
+        FreeBlock *p = sc.pFree;
+        sc.pFree = p->pNext;
+        p->pNext = cache.apFree[iClass];
+        cache.apFree[iClass] = p;
+        ++c;
+    }
+    cache.acFree[iClass] += c;
+    ++g_cRefills;
+}
+
+
+/***************************************************************************
+ *
+ *  SlabPool
+ *
+ **************************************************************************/
+
+/* static */
+void*
+SlabPool::Allocate(size_t cb)
+{
+    if (cb > SLAB_MAX_BLOCK)
+    {
+        ++g_cLarge;
+        return ::operator new(cb);
+    }
+
+    size_t iClass = cb ? (cb - 1) / SLAB_GRANULARITY : 0;
+    ThreadCache &cache = g_threadCache;
+    if (cache.fDead)
+    {
+        // The thread is exiting, so use the global list directly.
+        SizeClass &sc = g_aClasses[iClass];
+        std::lock_guard<std::mutex> lock(sc.mutex);
+        if (!sc.pFree)
+            AddSlab(sc, (iClass + 1) * SLAB_GRANULARITY);
+        FreeBlock *p = sc.pFree;
+        sc.pFree = p->pNext;
+        return p;
+    }
+
+    if (!cache.apFree[iClass])
+    {
+        // Make sure the thread-local flusher gets constructed before the thread takes blocks.
+        (void)&g_threadCacheFlusher;
+        TakeBlocks(iClass);
+    }
+
+    FreeBlock *p = cache.apFree[iClass];
+    cache.apFree[iClass] = p->pNext;
+    --cache.acFree[iClass];
+    return p;
+}
+
+/* static */
+void
+SlabPool::Free(void *p,
+               size_t cb)
+{
+    if (!p)
+        return;
+
+    if (cb > SLAB_MAX_BLOCK)
+    {
+        ::operator delete(p);
+        return;
+    }
+
+    size_t iClass = cb ? (cb - 1) / SLAB_GRANULARITY : 0;
+    FreeBlock *pBlock = (FreeBlock*)p;
+    ThreadCache &cache = g_threadCache;
+    if (cache.fDead)
+    {
+        SizeClass &sc = g_aClasses[iClass];
+        std::lock_guard<std::mutex> lock(sc.mutex);
+        pBlock->pNext = sc.pFree;
+        sc.pFree = pBlock;
+        return;
+    }
+
+    // A thread that only ever frees (e.g. the last owner of objects that another thread
+    // allocated) needs the flusher as well, or its blocks are lost when it exits.
+    if (!cache.apFree[iClass])
+        (void)&g_threadCacheFlusher;
+
+    pBlock->pNext = cache.apFree[iClass];
+    cache.apFree[iClass] = pBlock;
+    if (++cache.acFree[iClass] > THREAD_CACHE_MAX)
+        ReturnBlocks(iClass, THREAD_CACHE_MAX - THREAD_CACHE_BATCH);
+}
+
+/* static */
+SlabStats
+SlabPool::GetStats()
+{
+    SlabStats stats;
+    stats.cSlabs = g_cSlabs;
+    stats.cbReserved = stats.cSlabs * SLAB_SIZE;
+    stats.cRefills = g_cRefills;
+    stats.cLarge = g_cLarge;
+    return stats;
+}
+
+} // namespace XWP
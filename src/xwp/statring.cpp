@@ -0,0 +1,376 @@
+/*
+ * libxwp -- generic helper routines for C++11. (C) 2015--2017 Baubadil GmbH.
+ *
+ * libxwp is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the libxwp main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#include "xwp/statring.h"
+
+#include "xwp/debug.h"
+#include "xwp/except.h"
+
+#include <cstring>
+#include <exception>
+#include <vector>
+
+#ifdef USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace XWP
+{
+
+#ifdef USE_IO_URING
+
+/***************************************************************************
+ *
+ *  StatxRing::Impl
+ *
+ **************************************************************************/
+
+struct StatxRing::Impl
+{
+    int             fdRing = -1;
+
+    void            *pSqRing = nullptr;
+    size_t          cbSqRing = 0;
+    void            *pCqRing = nullptr;         // Same as pSqRing with IORING_FEAT_SINGLE_MMAP.
+    size_t          cbCqRing = 0;
+    io_uring_sqe    *paSqes = nullptr;
+    size_t          cbSqes = 0;
+
+    // Pointers into the submission queue ring.
+    unsigned        *puSqTail;
+    unsigned        *puSqMask;
+    unsigned        *paSqArray;
+    unsigned        cSqEntries;
+
+    // Pointers into the completion queue ring.
+    unsigned        *puCqHead;
+    unsigned        *puCqTail;
+    unsigned        *puCqMask;
+    io_uring_cqe    *paCqes;
+
+    ~Impl()
+    {
+        destroy();
+    }
+
+    /**
+     *  Unmaps and closes the ring. Entries that are still in the submission queue are
+     *  then never submitted, and statAll() refuses to use the ring again.
+     */
+    void destroy()
+    {
+        if (paSqes)
+            munmap(paSqes, cbSqes);
+        if (pCqRing && (pCqRing != pSqRing))
+            munmap(pCqRing, cbCqRing);
+        if (pSqRing)
+            munmap(pSqRing, cbSqRing);
+        if (fdRing != -1)
+            close(fdRing);
+        paSqes = nullptr;
+        pCqRing = nullptr;
+        pSqRing = nullptr;
+        fdRing = -1;
+    }
+
+    bool init(uint uQueueDepth)
+    {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        if ((fdRing = syscall(__NR_io_uring_setup, uQueueDepth, &p)) < 0)
+            return false;
+
+        cbSqRing = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cbCqRing = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+            cbSqRing = cbCqRing = max(cbSqRing, cbCqRing);
+
+        if (MAP_FAILED == (pSqRing = mmap(nullptr, cbSqRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fdRing, IORING_OFF_SQ_RING)))
+        {
+            pSqRing = nullptr;
+            return false;
+        }
+
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+            pCqRing = pSqRing;
+        else if (MAP_FAILED == (pCqRing = mmap(nullptr, cbCqRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fdRing, IORING_OFF_CQ_RING)))
+        {
+            pCqRing = nullptr;
+            return false;
+        }
+
+        cbSqes = p.sq_entries * sizeof(io_uring_sqe);
+        void *pv;
+        if (MAP_FAILED == (pv = mmap(nullptr, cbSqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fdRing, IORING_OFF_SQES)))
+            return false;
+        paSqes = (io_uring_sqe*)pv;
+
+        char *pSq = (char*)pSqRing;
+        puSqTail = (unsigned*)(pSq + p.sq_off.tail);
+        puSqMask = (unsigned*)(pSq + p.sq_off.ring_mask);
+        paSqArray = (unsigned*)(pSq + p.sq_off.array);
+        cSqEntries = p.sq_entries;
+
+        char *pCq = (char*)pCqRing;
+        puCqHead = (unsigned*)(pCq + p.cq_off.head);
+        puCqTail = (unsigned*)(pCq + p.cq_off.tail);
+        puCqMask = (unsigned*)(pCq + p.cq_off.ring_mask);
+        paCqes = (io_uring_cqe*)(pCq + p.cq_off.cqes);
+
+        return supportsStatx();
+    }
+
+    /**
+     *  Kernels 5.1 to 5.5 have io_uring but not IORING_OP_STATX and fail every such
+     *  request with EINVAL. Probing for opcodes came with 5.6 as well, so if the probe
+     *  fails, statx isn't there either.
+     */
+    bool supportsStatx()
+    {
+        const unsigned cOps = 256;
+        vector<char> buf(sizeof(io_uring_probe) + cOps * sizeof(io_uring_probe_op), 0);
+        io_uring_probe *pProbe = (io_uring_probe*)buf.data();
+        if (syscall(__NR_io_uring_register, fdRing, IORING_REGISTER_PROBE, pProbe, cOps) < 0)
+            return false;
+
+        return    (IORING_OP_STATX < pProbe->ops_len)
+               && (pProbe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    /**
+     *  Queues a statx for the given request. The caller must make sure that no more
+     *  than cSqEntries are in flight.
+     */
+    void queueStatx(int fdDir,
+                    StatxRequest &req,
+                    uint64_t idx)
+    {
+        unsigned tail = *puSqTail;
+        unsigned i = tail & *puSqMask;
+        io_uring_sqe *pSqe = &paSqes[i];
+        memset(pSqe, 0, sizeof(*pSqe));
+        pSqe->opcode = IORING_OP_STATX;
+        pSqe->fd = fdDir;
+        pSqe->addr = (uint64_t)req.strName.c_str();
+        pSqe->len = STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_UID | STATX_GID | STATX_INO;
+        pSqe->off = (uint64_t)&req.stx;
+        pSqe->statx_flags = AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT;
+        pSqe->user_data = idx;
+        paSqArray[i] = i;
+        // Make the SQE visible to the kernel before the new tail.
+        __atomic_store_n(puSqTail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    /**
+     *  Submits cToSubmit queued entries and waits until at least cWait completions
+     *  are available. Returns false, with cToSubmit reduced to the entries that are
+     *  still queued, if the kernel is temporarily short of resources or its completion
+     *  queue is full (EAGAIN or EBUSY), in which case the caller should reap completions
+     *  and try again. Throws on other errors.
+     */
+    bool enter(unsigned &cToSubmit,
+               unsigned cWait)
+    {
+        while (true)
+        {
+            int rc = syscall(__NR_io_uring_enter,
+                             fdRing,
+                             cToSubmit,
+                             cWait,
+                             cWait ? IORING_ENTER_GETEVENTS : 0,
+                             nullptr,
+                             0);
+            if (rc >= 0)
+            {
+                cToSubmit -= min(cToSubmit, (unsigned)rc);
+                if (!cToSubmit)
+                    return true;
+            }
+            else if (    (errno == EAGAIN)
+                      || (errno == EBUSY)
+                    )
+                return false;
+            else if (errno != EINTR)
+                throw ErrnoException("io_uring_enter failed");
+        }
+    }
+};
+
+
+/***************************************************************************
+ *
+ *  StatxRing
+ *
+ **************************************************************************/
+
+StatxRing::StatxRing()
+    : _pImpl(new Impl)
+{
+}
+
+StatxRing::~StatxRing()
+{
+    delete _pImpl;
+}
+
+/* static */
+PStatxRing
+StatxRing::Create(uint uQueueDepth)
+{
+    /* This nasty trickery is necessary to make make_shared work with a private constructor. */
+    class Derived : public StatxRing
+    {
+    public:
+        Derived() : StatxRing() { }
+    };
+
+    auto p = make_shared<Derived>();
+    if (!p->_pImpl->init(uQueueDepth))
+    {
+        DEBUG_LOG(FILE_MID, string(__func__) + ": io_uring or its statx not available, falling back to sequential stat");
+        return nullptr;
+    }
+
+    return p;
+}
+
+void
+StatxRing::statAll(int fdDir,
+                   StatxRequestsVector &v,
+                   std::function<void (StatxRequest&)> fnDone)
+{
+    Impl &ring = *_pImpl;
+    if (ring.fdRing == -1)
+        throw FSException("io_uring has been shut down after an earlier error");
+
+    size_t cTotal = v.size();
+    size_t cQueued = 0;
+    size_t cDone = 0;
+    unsigned cInFlight = 0;         // Queued and not completed yet.
+    unsigned cUnsubmitted = 0;      // Of those, not taken by the kernel yet.
+    // If fnDone throws, we must not leave until the kernel is done writing into v.
+    std::exception_ptr pException;
+
+    // Reaps everything that has completed by now, and calls fnDone for it unless fnDone
+    // has thrown before or fCallback is false.
+    auto reap = [&](bool fCallback)
+    {
+        unsigned head = *ring.puCqHead;
+        unsigned tail = __atomic_load_n(ring.puCqTail, __ATOMIC_ACQUIRE);
+        while (head != tail)
+        {
+            io_uring_cqe *pCqe = &ring.paCqes[head & *ring.puCqMask];
+            StatxRequest &req = v[pCqe->user_data];
+            req.rc = (pCqe->res < 0) ? -pCqe->res : 0;
+            ++head;
+            --cInFlight;
+            ++cDone;
+            if (    (fCallback)
+                 && (!pException)
+               )
+                try
+                {
+                    fnDone(req);
+                }
+                catch (...)
+                {
+                    pException = std::current_exception();
+                }
+        }
+        __atomic_store_n(ring.puCqHead, head, __ATOMIC_RELEASE);
+    };
+
+    while (cDone < cQueued || (!pException && cDone < cTotal))
+    {
+        // Top up the submission queue.
+        while (    (!pException)
+                && (cQueued < cTotal)
+                && (cInFlight < ring.cSqEntries)
+              )
+        {
+            ring.queueStatx(fdDir, v[cQueued], cQueued);
+            ++cQueued;
+            ++cInFlight;
+            ++cUnsubmitted;
+        }
+
+        try
+        {
+            if (!ring.enter(cUnsubmitted, 1))
+            {
+                // Make room by waiting for one of ours, if the kernel has any; otherwise
+                // give it a moment to find the resources.
+                unsigned cNone = 0;
+                if (cInFlight == cUnsubmitted)
+                    usleep(1000);
+                else
+                    ring.enter(cNone, 1);
+            }
+        }
+        catch (...)
+        {
+            // The kernel still writes the results of the requests it has taken into v
+            // and may post their completions any time, so wait for all of them (which
+            // does not need io_uring_enter) before v goes away, and then shut the ring
+            // down so that neither the rest of the submission queue nor stale
+            // completions can ever get mixed up with a later statAll().
+            while (cInFlight > cUnsubmitted)
+            {
+                reap(false);
+                if (cInFlight > cUnsubmitted)
+                    usleep(1000);
+            }
+            ring.destroy();
+            throw;
+        }
+
+        reap(true);
+    }
+
+    if (pException)
+        std::rethrow_exception(pException);
+}
+
+#else // USE_IO_URING
+
+struct StatxRing::Impl
+{
+};
+
+StatxRing::StatxRing()
+    : _pImpl(nullptr)
+{
+}
+
+StatxRing::~StatxRing()
+{
+}
+
+/* static */
+PStatxRing
+StatxRing::Create(uint uQueueDepth)
+{
+    return nullptr;
+}
+
+void
+StatxRing::statAll(int fdDir,
+                   StatxRequestsVector &v,
+                   std::function<void (StatxRequest&)> fnDone)
+{
+    throw FSException("io_uring support not compiled in");
+}
+
+#endif // USE_IO_URING
+
+} // namespace XWP
@@ -0,0 +1,293 @@
+/*
+ * libxwp -- generic helper routines for C++11. (C) 2015--2017 Baubadil GmbH.
+ *
+ * libxwp is free software; you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, in version 2 as it comes
+ * in the "LICENSE" file of the libxwp main distribution. This program is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the LICENSE file for more details.
+ */
+
+#include "xwp/trace.h"
+
+#include "xwp/debug.h"
+#include "xwp/stringhelp.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace XWP
+{
+
+/***************************************************************************
+ *
+ *  Globals
+ *
+ **************************************************************************/
+
+bool g_fTraceEnabled = false;
+
+string g_strTraceFile;
+
+std::chrono::steady_clock::time_point g_tTraceStart;
+
+/**
+ *  One recorded event. chPhase is the Chrome trace-event phase: 'B' and 'E' for the
+ *  beginning and end of a scope, 's' and 'f' for the start and finish of a flow, 'M'
+ *  for the thread name.
+ */
+struct TraceEvent
+{
+    uint64_t    uTimeNs;
+    uint64_t    idFlow;
+    string      strName;
+    char        chPhase;
+};
+
+// Small, since populating spawns short-lived threads whose buffers are kept until the end.
+#define EVENTS_PER_CHUNK            256
+// One million events per thread at most; later ones are dropped.
+#define MAX_CHUNKS_PER_THREAD       4096
+
+/**
+ *  The events of one thread are kept in a list of these. Only the owning thread appends;
+ *  it publishes each event by incrementing cEvents and each new chunk through pNext, so
+ *  that Write() can read everything up to there at any time.
+ */
+struct TraceChunk
+{
+    TraceEvent                  aEvents[EVENTS_PER_CHUNK];
+    std::atomic<size_t>         cEvents{0};
+    std::atomic<TraceChunk*>    pNext{nullptr};
+};
+
+struct ThreadBuffer
+{
+    pid_t                       tid;
+    TraceChunk                  *pFirst;
+    TraceChunk                  *pCurrent;          // Only used by the owning thread.
+    size_t                      cChunks = 1;        // Ditto.
+    ThreadBuffer                *pNext = nullptr;   // Next in g_pThreadBuffers.
+};
+
+/**
+ *  All thread buffers, prepended lock-free. They are never freed so that the events of
+ *  threads that have ended are still there for Write().
+ */
+std::atomic<ThreadBuffer*>  g_pThreadBuffers(nullptr);
+
+thread_local ThreadBuffer   *t_pThreadBuffer = nullptr;
+
+
+/***************************************************************************
+ *
+ *  Helpers
+ *
+ **************************************************************************/
+
+static ThreadBuffer*
+GetThreadBuffer()
+{
+    if (!t_pThreadBuffer)
+    {
+        auto pBuffer = new ThreadBuffer;
+        pBuffer->tid = (pid_t)syscall(SYS_gettid);
+        pBuffer->pFirst = pBuffer->pCurrent = new TraceChunk;
+        pBuffer->pNext = g_pThreadBuffers.load();
+        while (!g_pThreadBuffers.compare_exchange_weak(pBuffer->pNext, pBuffer))
+            ;
+        t_pThreadBuffer = pBuffer;
+    }
+
+    return t_pThreadBuffer;
+}
+
+static void
+AddEvent(char chPhase,
+         const string &strName,
+         uint64_t idFlow = 0)
+{
+    ThreadBuffer *pBuffer = GetThreadBuffer();
+    TraceChunk *pChunk = pBuffer->pCurrent;
+    size_t i = pChunk->cEvents.load(std::memory_order_relaxed);
+    if (i == EVENTS_PER_CHUNK)
+    {
+        if (pBuffer->cChunks == MAX_CHUNKS_PER_THREAD)
+            return;
+        auto pNew = new TraceChunk;
+        pChunk->pNext.store(pNew, std::memory_order_release);
+        pBuffer->pCurrent = pChunk = pNew;
+        ++pBuffer->cChunks;
+        i = 0;
+    }
+
+    TraceEvent &ev = pChunk->aEvents[i];
+    ev.uTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_tTraceStart).count();
+    ev.idFlow = idFlow;
+    ev.strName = strName;
+    ev.chPhase = chPhase;
+    pChunk->cEvents.store(i + 1, std::memory_order_release);
+}
+
+/**
+ *  Appends str to strJSON as a JSON string literal.
+ */
+static void
+AppendJSONString(string &strJSON,
+                 const string &str)
+{
+    strJSON += '"';
+    for (unsigned char c : str)
+    {
+        if (c == '"')
+            strJSON += "\\\"";
+        else if (c == '\\')
+            strJSON += "\\\\";
+        else if (c < 0x20)
+        {
+            char sz[8];
+            snprintf(sz, sizeof(sz), "\\u%04x", c);
+            strJSON += sz;
+        }
+        else
+            strJSON += (char)c;
+    }
+    strJSON += '"';
+}
+
+
+/***************************************************************************
+ *
+ *  TraceSink
+ *
+ **************************************************************************/
+
+/* static */
+void
+TraceSink::Init(const string &strFile)
+{
+    g_strTraceFile = strFile;
+    g_tTraceStart = std::chrono::steady_clock::now();
+    g_fTraceEnabled = true;
+}
+
+/* static */
+void
+TraceSink::Write()
+{
+    if (!g_fTraceEnabled)
+        return;
+
+    string strJSON = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    string strPrefix = "{\"pid\":" + to_string(getpid()) + ",\"tid\":";
+    size_t cEvents = 0;
+    for (ThreadBuffer *pBuffer = g_pThreadBuffers.load(); pBuffer; pBuffer = pBuffer->pNext)
+    {
+        for (TraceChunk *pChunk = pBuffer->pFirst; pChunk; pChunk = pChunk->pNext.load(std::memory_order_acquire))
+        {
+            size_t c = pChunk->cEvents.load(std::memory_order_acquire);
+            for (size_t i = 0; i < c; ++i)
+            {
+                const TraceEvent &ev = pChunk->aEvents[i];
+                if (cEvents++)
+                    strJSON += ",\n";
+
+                char sz[64];
+                snprintf(sz, sizeof(sz), ",\"ts\":%llu.%03u",
+                         (unsigned long long)(ev.uTimeNs / 1000),
+                         (unsigned)(ev.uTimeNs % 1000));
+                strJSON += strPrefix + to_string(pBuffer->tid) + sz + ",\"ph\":\"" + ev.chPhase + "\"";
+                switch (ev.chPhase)
+                {
+                    case 'M':
+                        strJSON += ",\"name\":\"thread_name\",\"args\":{\"name\":";
+                        AppendJSONString(strJSON, ev.strName);
+                        strJSON += "}";
+                    break;
+
+                    case 's':
+                    case 'f':
+                        strJSON += ",\"cat\":\"queue\",\"name\":";
+                        AppendJSONString(strJSON, ev.strName);
+                        strJSON += ",\"id\":\"" + to_string(ev.idFlow) + "\"";
+                        if (ev.chPhase == 'f')
+                            strJSON += ",\"bp\":\"e\"";
+                    break;
+
+                    case 'B':
+                        strJSON += ",\"name\":";
+                        AppendJSONString(strJSON, ev.strName);
+                    break;
+                }
+                strJSON += "}";
+            }
+        }
+    }
+    strJSON += "\n]}\n";
+
+    bool fOK = false;
+    FILE *pFile;
+    if ((pFile = fopen(g_strTraceFile.c_str(), "w")))
+    {
+        fOK = (fwrite(strJSON.data(), 1, strJSON.length(), pFile) == strJSON.length());
+        if (fclose(pFile) != 0)
+            fOK = false;
+    }
+    if (!fOK)
+        Debug::Log(DEBUG_ALWAYS, "Cannot write trace to " + quote(g_strTraceFile) + ": " + strerror(errno));
+    else
+        Debug::Log(DEBUG_ALWAYS, "Wrote " + to_string(cEvents) + " trace events to " + quote(g_strTraceFile));
+}
+
+/* static */
+void
+TraceSink::SetThreadName(const string &strName)
+{
+    if (g_fTraceEnabled)
+        AddEvent('M', strName);
+}
+
+/* static */
+void
+TraceSink::Begin(const string &strName)
+{
+    AddEvent('B', strName);
+}
+
+/* static */
+void
+TraceSink::End()
+{
+    AddEvent('E', string());
+}
+
+/* static */
+void
+TraceSink::FlowOut(const char *pcszQueue,
+                   uint64_t id)
+{
+    // Flow events need a slice to attach to.
+    string strName(pcszQueue);
+    AddEvent('B', "post to " + strName);
+    AddEvent('s', strName, id);
+    AddEvent('E', string());
+}
+
+/* static */
+void
+TraceSink::FlowIn(const char *pcszQueue,
+                  uint64_t id)
+{
+    string strName(pcszQueue);
+    AddEvent('B', "fetch from " + strName);
+    AddEvent('f', strName, id);
+    AddEvent('E', string());
+}
+
+} // namespace XWP